@@ -0,0 +1,233 @@
+#pragma once
+#include <array>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <assert.h>
+#include "Shape.h"
+#include "Memory.h"
+#include "Simd.h"
+#include "ndMask.h"
+#include "FixedArray.h"
+
+namespace Cnum
+{
+	template<typename T>
+	class ndArray;
+
+	/*
+		What is a Box?
+			An axis aligned box in D dimensions, the closed region [low, high] along every axis. It holds the 2 * D bounds
+			inline, low first and high after it, so it never allocates and an array of boxes is one contiguous block.
+			A box with low > high along some axis is empty, like the default constructed box, which unite() treats as the
+			identity.
+
+				Box<double, 3> box({ 0,0,0 }, { 1,2,3 });
+				bool inside = box.contains(point);
+				ndMask mask = box.contains(points);      // one bit for each row of the (N, 3) array of points
+
+			The tests of a single box are branchless loops of constant trip count. The batched contains() tests the rows of
+			an (N, D) array with Simd::boxContains, which reads the packed points without deinterleaving them.
+	*/
+	template<typename T, int D>
+	class Box
+	{
+		static_assert(D > 0, "A Box needs at least one axis");
+
+	public:
+
+		using value_type = T;
+
+		static constexpr int dims = D;
+
+		//--------------------------
+		// Constructors
+		// -------------------------
+
+		// An empty box
+		constexpr Box()
+		{
+			std::fill(m_bounds.begin(), m_bounds.begin() + D, std::numeric_limits<T>::max());
+			std::fill(m_bounds.begin() + D, m_bounds.end(), std::numeric_limits<T>::lowest());
+		}
+		constexpr Box(const FixedArray<T, D>& low, const FixedArray<T, D>& high)
+			: Box(low.data(), high.data())
+		{
+		}
+		constexpr Box(const T* low, const T* high)
+		{
+			std::copy(low, low + D, m_bounds.begin());
+			std::copy(high, high + D, m_bounds.begin() + D);
+		}
+
+		// The smallest box holding all rows of the (N, D) array of points
+		static Box bounding(const ndArray<T>& points)
+		{
+			const size_t n = rows(points);
+			Box out;
+			for (size_t p = 0; p < n; p++) {
+				out.expand(points.data() + p * D);
+			}
+			return out;
+		}
+
+		//--------------------------
+		// Access
+		// -------------------------
+
+		// The low bounds followed by the high bounds
+		constexpr T* data() { return m_bounds.data(); }
+		constexpr const T* data()const { return m_bounds.data(); }
+
+		constexpr T& low(int k) { return m_bounds[k]; }
+		constexpr T& high(int k) { return m_bounds[D + k]; }
+		constexpr T low(int k)const { return m_bounds[k]; }
+		constexpr T high(int k)const { return m_bounds[D + k]; }
+
+		constexpr FixedArray<T, D> low()const { return this->corner(0); }
+		constexpr FixedArray<T, D> high()const { return this->corner(D); }
+		constexpr FixedArray<T, D> center()const { return (this->low() + this->high()) / T(2); }
+
+		friend constexpr bool operator==(const Box& lhs, const Box& rhs) = default;
+
+		//--------------------------
+		// Tests
+		// -------------------------
+
+		constexpr bool isEmpty()const
+		{
+			bool empty = false;
+			for (int k = 0; k < D; k++) {
+				empty |= m_bounds[k] > m_bounds[D + k];
+			}
+			return empty;
+		}
+
+		constexpr bool contains(const T* point)const
+		{
+			bool inside = true;
+			for (int k = 0; k < D; k++) {
+				inside &= (m_bounds[k] <= point[k]) & (point[k] <= m_bounds[D + k]);
+			}
+			return inside;
+		}
+		constexpr bool contains(const FixedArray<T, D>& point)const
+		{
+			return this->contains(point.data());
+		}
+		// Every point of other is in the box. An empty box is in every box
+		constexpr bool contains(const Box& other)const
+		{
+			bool inside = true;
+			for (int k = 0; k < D; k++) {
+				inside &= (m_bounds[k] <= other.m_bounds[k]) & (other.m_bounds[D + k] <= m_bounds[D + k]);
+			}
+			return inside | other.isEmpty();
+		}
+
+		// The boxes share at least one point, which includes touching along a face
+		constexpr bool overlaps(const Box& other)const
+		{
+			bool overlapping = true;
+			for (int k = 0; k < D; k++) {
+				overlapping &= (m_bounds[k] <= other.m_bounds[D + k]) & (other.m_bounds[k] <= m_bounds[D + k]);
+				overlapping &= (m_bounds[k] <= m_bounds[D + k]) & (other.m_bounds[k] <= other.m_bounds[D + k]);
+			}
+			return overlapping;
+		}
+
+		// Bit p of the mask is set if row p of the (N, D) array of points is in the box
+		ndMask contains(const ndArray<T>& points)const
+		{
+			const size_t n = rows(points);
+			ndMask out(Shape{ 1, (int)n });
+			Simd::boxContains<D>(points.data(), n, m_bounds.data(), m_bounds.data() + D, out.words());
+			return out;
+		}
+
+		// Bit i of the mask is set if boxes[i] overlaps the box
+		ndMask overlaps(const std::vector<Box>& boxes)const
+		{
+			ndMask out(Shape{ 1, (int)boxes.size() });
+			uint64_t* words = out.words();
+			for (size_t i = 0; i < boxes.size(); i++) {
+				words[i / 64] |= (uint64_t)this->overlaps(boxes[i]) << (i % 64);
+			}
+			return out;
+		}
+
+		//--------------------------
+		// Set operations
+		// -------------------------
+
+		// The common region, which is empty if the boxes do not overlap
+		constexpr Box intersect(const Box& other)const
+		{
+			Box out;
+			for (int k = 0; k < D; k++) {
+				out.m_bounds[k] = std::max(m_bounds[k], other.m_bounds[k]);
+				out.m_bounds[D + k] = std::min(m_bounds[D + k], other.m_bounds[D + k]);
+			}
+			return out;
+		}
+
+		// The smallest box holding both
+		constexpr Box unite(const Box& other)const
+		{
+			Box out;
+			for (int k = 0; k < D; k++) {
+				out.m_bounds[k] = std::min(m_bounds[k], other.m_bounds[k]);
+				out.m_bounds[D + k] = std::max(m_bounds[D + k], other.m_bounds[D + k]);
+			}
+			return out;
+		}
+
+		// Grows the box to hold the point
+		constexpr Box& expand(const T* point)
+		{
+			for (int k = 0; k < D; k++) {
+				m_bounds[k] = std::min(m_bounds[k], point[k]);
+				m_bounds[D + k] = std::max(m_bounds[D + k], point[k]);
+			}
+			return *this;
+		}
+
+		// The product of the extents, zero for an empty box
+		constexpr T volume()const
+		{
+			T out = T(1);
+			for (int k = 0; k < D; k++) {
+				out *= (m_bounds[k] <= m_bounds[D + k]) ? m_bounds[D + k] - m_bounds[k] : T(0);
+			}
+			return out;
+		}
+
+	private:
+
+		static size_t rows(const ndArray<T>& points)
+		{
+			if (points.nDims() == 1) {
+				assert(points.size() == (size_t)D);
+				return 1;
+			}
+			assert(points.shape().size() == 2 && points.shape()[1] == D);
+			return (size_t)points.shape()[0];
+		}
+
+		constexpr FixedArray<T, D> corner(int offset)const
+		{
+			FixedArray<T, D> out;
+			std::copy(m_bounds.begin() + offset, m_bounds.begin() + offset + D, out.begin());
+			return out;
+		}
+
+	private:
+		std::array<T, 2 * D> m_bounds;
+	};
+
+	template<typename T>
+	using Box2 = Box<T, 2>;
+
+	template<typename T>
+	using Box3 = Box<T, 3>;
+}
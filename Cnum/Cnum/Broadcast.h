@@ -0,0 +1,97 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <assert.h>
+#include "Shape.h"
+
+namespace Cnum
+{
+namespace Broadcast
+{
+	/*
+		What is broadcasting?
+			Two shapes are broadcast together by aligning them to the right and pairing their axes. The axes of a pair must either
+			be equal, or one of them must be 1, in which case it is virtually repeated to the length of the other. Missing leading
+			axes count as 1.
+
+			Example: (4,3) and (1,3) give (4,3), where the single row of the second operand is used for all 4 rows.
+			         (4,1) and (3)   give (4,3).
+
+			Nothing is ever repeated in memory. A repeated axis is read with the stride 0, see IndexMap.
+	*/
+
+	inline bool compatible(const Shape& a, const Shape& b)
+	{
+		const int rank = (int)std::max(a.size(), b.size());
+		for (int i = 1; i <= rank; i++) {
+			const int da = (i <= (int)a.size()) ? a[a.size() - i] : 1;
+			const int db = (i <= (int)b.size()) ? b[b.size() - i] : 1;
+			if (da != db && da != 1 && db != 1)
+				return false;
+		}
+		return true;
+	}
+
+	inline Shape shape(const Shape& a, const Shape& b)
+	{
+		assert(compatible(a, b));
+
+		const size_t rank = std::max(a.size(), b.size());
+		Shape out(rank);
+		for (size_t i = 1; i <= rank; i++) {
+			const int da = (i <= a.size()) ? a[a.size() - i] : 1;
+			const int db = (i <= b.size()) ? b[b.size() - i] : 1;
+			out[rank - i] = (da == 1) ? db : da;
+		}
+		return out;
+	}
+
+
+	/*
+		Maps the flat index of an element in the broadcast shape to the flat index of the element it is read from in the operand.
+		The operand is indexed in its own row major order, so the map works for arrays, views and expressions alike.
+	*/
+	class IndexMap
+	{
+	public:
+		IndexMap() = default;
+		IndexMap(const Shape& operandShape, const Shape& broadcastShape)
+			: m_shape{ broadcastShape }, m_strides(broadcastShape.size(), 0)
+		{
+			assert(operandShape.size() <= broadcastShape.size());
+
+			int stride = 1;
+			for (size_t i = 1; i <= m_shape.size(); i++) {
+				const size_t axis = m_shape.size() - i;
+				const int dim = (i <= operandShape.size()) ? operandShape[operandShape.size() - i] : 1;
+				assert(dim == m_shape[axis] || dim == 1);
+
+				m_strides[axis] = (dim == m_shape[axis]) ? stride : 0;
+				m_isIdentity = m_isIdentity && (dim == m_shape[axis]);
+				stride *= dim;
+			}
+		}
+
+		size_t operator()(size_t flatIndex)const
+		{
+			size_t index = 0;
+			for (int i = (int)m_shape.size() - 1; i >= 0; i--) {
+				index += (flatIndex % m_shape[i]) * m_strides[i];
+				flatIndex /= m_shape[i];
+			}
+			return index;
+		}
+
+		// True if the operand has the broadcast shape, apart from leading axes of length 1
+		bool isIdentity()const { return m_isIdentity; }
+
+		// The stride along the last axis, 0 if the operand repeats a single element along it
+		int innerStride()const { return m_strides.empty() ? 1 : m_strides.back(); }
+
+	private:
+		Shape m_shape;
+		Shape m_strides;
+		bool m_isIdentity = true;
+	};
+}
+}
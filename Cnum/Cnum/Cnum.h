@@ -7,6 +7,11 @@
 #include <functional>
 #include <numbers>
 #include "Meta.h"
+#include "Gemm.h"
+#include "Concatenate.h"
+#include "Memory.h"
+#include "Npy.h"
+#include "Csv.h"
 #include <string_view>
 #include <fstream>
 #include <format>
@@ -33,8 +38,7 @@ namespace Cnum {
 	template<typename T>
 	class ndArray;
 
-	template<typename T>
-	class Rect;
+	class ndMask;
 
 
 	typedef ndArray<int> iArray;
@@ -70,11 +74,6 @@ namespace Cnum {
 
 
 
-	template<typename T>
-	static Rect<T> getRect(ndArray<T>& lowPoint, ndArray<T>& highPoint) {
-		return Rect(lowPoint, highPoint);
-	}
-	
 
 	// Static Creators
 
@@ -142,8 +141,13 @@ namespace Cnum {
 		}
 
 		template<typename T>
-		static ndArray<T> blend_if(ndArray<T> base, ndArray<T>& blendArray, iArray&& condition) {
-			return base.blend_if(std::move(blendArray), std::move(condition));
+		static ndArray<T> blend_if(ndArray<T> base, const ndArray<T>& blendArray, const ndMask& condition) {
+			return base.blend_if(blendArray, condition);
+		}
+
+		template<typename T>
+		static ndArray<T> blend_if(ndArray<T> base, const ndArray<T>& blendArray, iArray&& condition) {
+			return base.blend_if(blendArray, std::move(condition));
 		}
 
 		template<typename T>
@@ -151,11 +155,39 @@ namespace Cnum {
 			return arr1.concatenate(arr2, axis);
 		}
 
+		// The arrays, read with the given shapes, joined along the axis, see Concatenate.h
+		template<typename T>
+		static ndArray<T> joined(const std::vector<ndArray<T>>& arrays, const std::vector<Shape>& shapes, int axis, Execution execution) {
+			std::vector<const T*> data;
+			for (const ndArray<T>& arr : arrays) {
+				data.push_back(arr.data());
+			}
+			Memory::Buffer<T> out;
+			Shape shape = Concatenate::join(data, shapes, axis, out, execution);
+			return ndArray<T>(std::move(out), std::move(shape));
+		}
+
+		// Joins the arrays along the axis, where their lengths may differ, with a single allocation and block copies
+		template<typename T>
+		static ndArray<T> concatenate(const std::vector<ndArray<T>>& arrays, int axis, Execution execution = Parallel::defaultExecution()) {
+			std::vector<Shape> shapes;
+			for (const ndArray<T>& arr : arrays) {
+				shapes.push_back(arr.shape());
+			}
+			return Array::joined(arrays, shapes, axis, execution);
+		}
+
 		template<typename T>
 		static ndArray<T> erase(ndArray<T> arr, int index) {
 			return arr.erase(index);
 		}
 
+		template<typename T>
+		static iArray find(const ndArray<T>& arr, const ndMask& condition)
+		{
+			return arr.find(condition);
+		}
+
 		template<typename T>
 		static iArray find(ndArray<T> arr, iArray& condition)
 		{
@@ -173,6 +205,17 @@ namespace Cnum {
 			return arr.flatten();
 		}
 
+		// Joins 1d arrays into a longer 1d array, and other arrays along axis 1
+		template<typename T>
+		static ndArray<T> hstack(const std::vector<ndArray<T>>& arrays, Execution execution = Parallel::defaultExecution()) {
+			const bool all1d = std::all_of(arrays.begin(), arrays.end(), [](const ndArray<T>& arr) { return arr.nDims() == 1; });
+			std::vector<Shape> shapes;
+			for (const ndArray<T>& arr : arrays) {
+				shapes.push_back(all1d ? Shape{ (int)arr.size() } : arr.shape());
+			}
+			return Array::joined(arrays, shapes, all1d ? 0 : 1, execution);
+		}
+
 		template<typename T, typename iter>
 		static ndArray<T> insert(ndArray<T> arr, iter it, T value) {
 			return arr.insert(it, value);
@@ -269,6 +312,19 @@ namespace Cnum {
 			return arr.sortFlat();
 		}
 
+		// Joins arrays of the same shape along a new axis. 1d arrays count as having a single axis
+		template<typename T>
+		static ndArray<T> stack(const std::vector<ndArray<T>>& arrays, int axis, Execution execution = Parallel::defaultExecution()) {
+			std::vector<Shape> shapes;
+			for (const ndArray<T>& arr : arrays) {
+				Shape shape = (arr.nDims() == 1) ? Shape{ (int)arr.size() } : arr.shape();
+				assert(axis >= 0 && axis <= (int)shape.size());
+				shape.insert(shape.begin() + axis, 1);
+				shapes.push_back(shape);
+			}
+			return Array::joined(arrays, shapes, axis, execution);
+		}
+
 		template<typename T>
 		static ndArray<T> transpose(ndArray<T> arr) {
 			return arr.transpose();
@@ -279,24 +335,28 @@ namespace Cnum {
 			return arr.transpose(permutation);
 		}
 
+		// Joins arrays along axis 0, where 1d arrays count as rows
+		template<typename T>
+		static ndArray<T> vstack(const std::vector<ndArray<T>>& arrays, Execution execution = Parallel::defaultExecution()) {
+			std::vector<Shape> shapes;
+			for (const ndArray<T>& arr : arrays) {
+				shapes.push_back((arr.nDims() == 1) ? Shape{ 1, (int)arr.size() } : arr.shape());
+			}
+			return Array::joined(arrays, shapes, 0, execution);
+		}
+
 	}
 
 
 	
 
-	//template<typename T>
-	/*static ndArray<T> fromFile(std::string_view filePath, char delimiter = ' ') {
-
-		try {
-			auto dataFile = openFile(filePath);
-			return readDataFromFile(dataFile, delimiter);
-		}
-		catch (const std::exception& ex) {
-			std::cout << "Error in FromFile() -> ";
-			std::cout << ex.what() << std::endl;
-			exit(0);
-		}
-	}*/
+	// Reads a delimited text file, like the ones toFile() writes, into a 2d array. See Csv.h for headers, comments and column selection
+	template<typename T>
+	static ndArray<T> fromFile(std::string_view filePath, char delimiter = ' ') {
+		Csv::Options options;
+		options.delimiter = delimiter;
+		return Csv::read<T>(filePath, options);
+	}
 
 
 
@@ -313,23 +373,38 @@ namespace Cnum {
 		return std::inner_product(arr1.begin(), arr1.end(), arr2.begin(), 0);
 	}
 
+	/*
+		C = alpha * op(A) * op(B) + beta * C, where op() transposes its argument if the corresponding flag is set. See Gemm.h
+		A, B and C must all be 2d, with op(A) of shape (m,k), op(B) of shape (k,n) and C of shape (m,n)
+	*/
 	template<typename T>
-	static ndArray<T> matrixMul(ndArray<T>& arr1, ndArray<T>& arr2)
+	static ndArray<T>& gemm(bool transA, bool transB, T alpha, const ndArray<T>& A, const ndArray<T>& B, T beta, ndArray<T>& C,
+		Execution execution = Parallel::defaultExecution())
+	{
+		assert(A.shape().size() == 2 && B.shape().size() == 2 && C.shape().size() == 2);
+
+		const int m = A.shape()[transA ? 1 : 0];
+		const int k = A.shape()[transA ? 0 : 1];
+		const int n = B.shape()[transB ? 0 : 1];
+		assert(B.shape()[transB ? 1 : 0] == k);
+		assert(C.shape()[0] == m && C.shape()[1] == n);
+
+		Gemm::gemm<T>(transA, transB, m, n, k,
+			alpha, A.data(), A.shape()[1], B.data(), B.shape()[1],
+			beta, C.data(), n, execution);
+		return C;
+	}
+
+	template<typename T>
+	static ndArray<T> matrixMul(const ndArray<T>& arr1, const ndArray<T>& arr2, Execution execution = Parallel::defaultExecution())
 	{
 		// arr1 and 2 must both be 2d
 		// width of arr1 must be equal to the height of arr2
 
-		ndArray<T> output = ndArray({ arr1.shapeAlong(0), arr2.shapeAlong(1) }, 0);
-
-		for (int i = 0; i < arr1.shapeAlong(0); i++) {
-			for (int j = 0; j < arr2.shapeAlong(1); j++) {
-				T sum = 0;
-				for (int k = 0; k < arr1.shapeAlong(0); k++) {
-					sum += arr1.at({ i,k }) * arr2.at({ k,j });
-				}
-				output.at({ i,j }) = sum;
-			}
-		}
+		// Every constructor of an array initializes its elements, so the product is accumulated into the zeros with beta 1
+		// rather than having gemm clear them a second time
+		ndArray<T> output(std::vector<int>{ arr1.shape()[0], arr2.shape()[1] }, T(0));
+		gemm(false, false, T(1), arr1, arr2, T(1), output, execution);
 		return output;
 	}
 
@@ -369,32 +444,33 @@ namespace Cnum {
 	}
 
 	template<typename T>
-	static void toFile(std::string_view filename, ndArray<T>& data, char writeMode = 'w', char delimiter = ' ')
+	static void toFile(std::string_view filename, const ndArray<T>& data, char writeMode = 'w', char delimiter = ' ', int precision = -1)
 	{
 		// Problems:
 		//	Two different delimiters can be used if the write mode is append
 
-		if (data.nDims() > 2)
-			throw std::runtime_error("Cannot save data in higher dimension than 2");
-
 		if (writeMode != 'w' && writeMode != 'a')
 			throw std::invalid_argument("Write mode must be either 'w' or 'a'");
 
-		auto mode = (writeMode == 'w') ? std::ios::out : std::ios::app;
-		std::ofstream dataFile(filename.data(), mode);
-
-		int stride = data.getStride();
-
-		for (int i = 0; i < data.size(); i++) {
+		// Arrays of more than 2 dimensions are written as rows of their last axis, see Csv.h
+		Csv::WriteOptions options;
+		options.delimiter = delimiter;
+		options.precision = precision;
+		options.append = (writeMode == 'a');
+		Csv::write(filename, data, options);
+	}
 
-			std::string s = std::to_string(data.raw()[i]);
-			dataFile << s;
+	// Binary .npy files, which keep the exact values and any number of dimensions, see Npy.h
+	template<typename T>
+	static void save(std::string_view filename, const ndArray<T>& data)
+	{
+		Npy::save(filename, data);
+	}
 
-			if (fmod(i + 1, stride) == 0)
-				dataFile << "\n";
-			else
-				dataFile << delimiter;
-		}
+	template<typename T>
+	static ndArray<T> load(std::string_view filename)
+	{
+		return Npy::load<T>(filename);
 	}
 
 
@@ -416,24 +492,10 @@ namespace Cnum {
 	template<typename T>
 	static ndArray<T> readDataFromFile(std::fstream& dataFile, char delimiter = ' ') {
 
-		int rowCount = 0, colCount = 0, finalColCount = 0;
-		std::vector<T> initializer;
-
-		for (std::string line; std::getline(dataFile, line);) {
-			colCount = 0;
-			std::stringstream ss(line);
-			for (std::string element; std::getline(ss, element, delimiter);) {
-				initializer.push_back((T)stod(element));
-				colCount++;
-
-				if (rowCount > 0 && colCount > finalColCount) {
-					throw std::runtime_error("Non consistent column count in file");
-				}
-			}
-			finalColCount = colCount;
-			rowCount++;
-		}
-		return ndArray<T>(initializer, std::vector<int>{rowCount, finalColCount});
+		const std::string text(std::istreambuf_iterator<char>(dataFile), {});
+		Csv::Options options;
+		options.delimiter = delimiter;
+		return Csv::parse<T>(text, options);
 	}
 
 
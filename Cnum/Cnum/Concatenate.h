@@ -0,0 +1,104 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <assert.h>
+#include "Parallel.h"
+#include "Shape.h"
+
+namespace Cnum
+{
+namespace Concatenate
+{
+	/*
+		How are arrays joined?
+			Along an axis, every array is a sequence of contiguous blocks, one per index of the axes in front of it, each holding
+			its length along the axis times the size of the axes behind it. The output interleaves these blocks: row o of the
+			output is block o of the first array, then block o of the second array, and so on.
+
+			Example: joining (4,2) and (4,3) along axis 1 gives 4 rows of 2 + 3 elements, copied as blocks of 2 and 3.
+
+			The output is written in order, split evenly between the threads, whatever the sizes of the blocks are.
+	*/
+
+	// The blocks of one source, block o starts at data + o * stride
+	template<typename T>
+	struct Source
+	{
+		const T* data;
+		size_t length;
+		size_t stride;
+	};
+
+	// Fills nRows rows of dst, where each row is the concatenation of one block from every source
+	template<typename T>
+	void fill(const std::vector<Source<T>>& sources, size_t nRows, T* dst, Execution execution = Parallel::defaultExecution())
+	{
+		// Start of the blocks of each source within a row
+		std::vector<size_t> offsets(sources.size() + 1, 0);
+		for (size_t i = 0; i < sources.size(); i++) {
+			offsets[i + 1] = offsets[i] + sources[i].length;
+		}
+		const size_t rowLength = offsets.back();
+		if (rowLength == 0)
+			return;
+
+		Parallel::forChunks(nRows * rowLength, execution, [&](size_t begin, size_t end) {
+			size_t row = begin / rowLength;
+			size_t column = begin % rowLength;
+			size_t i = (size_t)(std::upper_bound(offsets.begin(), offsets.end(), column) - offsets.begin()) - 1;
+
+			for (size_t pos = begin; pos < end;) {
+				if (column == offsets[i + 1]) {
+					if (++i == sources.size()) {
+						i = 0;
+						column = 0;
+						row++;
+					}
+					continue;
+				}
+				const size_t n = std::min(end - pos, offsets[i + 1] - column);
+				const T* block = sources[i].data + row * sources[i].stride + (column - offsets[i]);
+				std::copy(block, block + n, dst + pos);
+				pos += n;
+				column += n;
+			}
+		});
+	}
+
+	/*
+		Joins arrays with the given shapes along the axis, where their lengths may differ, into out.
+		Returns the shape of the result.
+	*/
+	template<typename T, typename Allocator>
+	Shape join(const std::vector<const T*>& arrays, const std::vector<Shape>& shapes, int axis, std::vector<T, Allocator>& out,
+		Execution execution = Parallel::defaultExecution())
+	{
+		assert(!arrays.empty() && arrays.size() == shapes.size());
+		assert(axis >= 0 && axis < (int)shapes[0].size());
+
+		Shape shape = shapes[0];
+		shape[axis] = 0;
+		size_t nRows = 1, inner = 1;
+		for (int i = 0; i < (int)shape.size(); i++) {
+			if (i < axis) nRows *= (size_t)shape[i];
+			if (i > axis) inner *= (size_t)shape[i];
+		}
+
+		std::vector<Source<T>> sources;
+		sources.reserve(arrays.size());
+		for (size_t k = 0; k < arrays.size(); k++) {
+			assert(shapes[k].size() == shape.size());
+			for (int i = 0; i < (int)shape.size(); i++) {
+				assert(i == axis || shapes[k][i] == shape[i]);
+			}
+			const size_t length = (size_t)shapes[k][axis] * inner;
+			sources.push_back({ arrays[k], length, length });
+			shape[axis] += shapes[k][axis];
+		}
+
+		out.resize(nRows * (size_t)shape[axis] * inner);
+		fill(sources, nRows, out.data(), execution);
+		return shape;
+	}
+}
+}
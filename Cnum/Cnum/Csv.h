@@ -0,0 +1,485 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <charconv>
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <memory>
+#include <cstring>
+#include <numeric>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <format>
+#include <type_traits>
+#include <assert.h>
+#include "Shape.h"
+#include "Memory.h"
+#include "Parallel.h"
+
+namespace Cnum
+{
+	template<typename T>
+	class ndArray;
+
+namespace Csv
+{
+	/*
+		How is a delimited text file read?
+			The file is mapped into memory and split into chunks of whole lines. The chunks are parsed in parallel in two
+			passes: the first counts the data rows of every chunk, which tells where each chunk's rows start in the array,
+			and the second parses the numbers with std::from_chars straight into the storage of the array.
+
+			Every data line becomes a row of the 2d result. Blank lines and lines starting with the comment character are
+			skipped, and a header line can name the columns, which then may be selected by name.
+
+				Csv::Options options;
+				options.header = true;
+				options.columnNames = { "x", "y", "z" };
+				dArray points = Csv::read<double>("scan.csv", options);
+
+		An empty field is read as NaN for floating point types, and is an error for integers.
+
+		Writing goes the other way: chunks of rows are formatted with std::to_chars into buffers in parallel, and the
+		buffers are written in order. An array of more than two dimensions is written as rows of its last axis.
+	*/
+	struct Options
+	{
+		// Separates the fields of a line. A space separates them by any run of spaces and tabs
+		char delimiter = ',';
+
+		// Lines whose first non-blank character is the comment character are skipped. '\0' for no comments
+		char comment = '#';
+
+		// The first line after the skipped rows, blank lines and comments names the columns
+		bool header = false;
+
+		// Lines skipped at the start of the file, before the header
+		int skipRows = 0;
+
+		// The columns to read, in this order, by index and then by header name. All columns if both are empty
+		std::vector<int> columns;
+		std::vector<std::string> columnNames;
+
+		Execution execution = Parallel::defaultExecution();
+	};
+
+	namespace Detail
+	{
+		// Bytes of text per chunk
+		constexpr size_t chunkBytes = 1 << 18;
+
+		inline bool isBlank(char c, char delimiter)
+		{
+			return c == ' ' || (c == '\t' && delimiter != '\t');
+		}
+		inline bool isLineEnd(char c)
+		{
+			return c == '\n' || c == '\r';
+		}
+
+		inline const char* nextLine(const char* p, const char* end)
+		{
+			const void* newline = std::memchr(p, '\n', (size_t)(end - p));
+			return newline ? static_cast<const char*>(newline) + 1 : end;
+		}
+
+		// Whether the line at p holds data, rather than being blank or a comment
+		inline bool holdsData(const char* p, const char* end, char delimiter, char comment)
+		{
+			while (p < end && isBlank(*p, delimiter)) p++;
+			return p < end && !isLineEnd(*p) && *p != comment;
+		}
+
+		// Calls fn(first, last, index) for the fields of the line at p, without surrounding blanks, until fn returns false
+		template<typename Function>
+		const char* forEachField(const char* p, const char* end, char delimiter, Function fn)
+		{
+			const bool whitespace = (delimiter == ' ');
+			for (int index = 0;; index++) {
+				while (p < end && isBlank(*p, delimiter)) p++;
+				const char* first = p;
+				while (p < end && !isLineEnd(*p) && (whitespace ? !isBlank(*p, delimiter) : *p != delimiter)) p++;
+				const char* last = p;
+				while (last > first && isBlank(last[-1], delimiter)) last--;
+				if (whitespace) {
+					while (p < end && isBlank(*p, delimiter)) p++;
+				}
+
+				const bool more = p < end && !isLineEnd(*p);
+				if (!fn(first, last, index) || !more)
+					return p;
+				if (!whitespace)
+					p++;
+			}
+		}
+
+		template<typename T>
+		T parseValue(const char* first, const char* last, size_t row)
+		{
+			if (first < last && *first == '+')
+				first++;
+
+			T value{};
+			auto [ptr, error] = std::from_chars(first, last, value);
+			if constexpr (std::is_integral_v<T>) {
+				// Integers written as 1.0 or 1e3
+				if (error == std::errc() && ptr != last) {
+					double real = 0;
+					auto [realPtr, realError] = std::from_chars(first, last, real);
+					if (realError == std::errc() && realPtr == last)
+						return (T)real;
+				}
+			}
+			else {
+				if (first == last)
+					return std::numeric_limits<T>::quiet_NaN();
+			}
+			if (error != std::errc() || ptr != last)
+				throw std::runtime_error(std::format("Could not read '{}' as a number, on data row {}", std::string_view(first, (size_t)(last - first)), row + 1));
+			return value;
+		}
+
+		struct Layout
+		{
+			char delimiter;
+			char comment;
+
+			// The column of the array of each field of a line, -1 for fields that are not read
+			std::vector<int> slots;
+			int nColumns = 0;
+
+			// With a selection, lines may have more fields than are read
+			bool selected = false;
+		};
+
+		// Parses the data line at p into row, and returns the start of the next line
+		template<typename T>
+		const char* parseLine(const char* p, const char* end, const Layout& layout, T* row, size_t rowIndex)
+		{
+			const int nSlots = (int)layout.slots.size();
+			int nFields = 0;
+			p = forEachField(p, end, layout.delimiter, [&](const char* first, const char* last, int index) {
+				nFields = index + 1;
+				if (index < nSlots && layout.slots[index] >= 0) {
+					row[layout.slots[index]] = parseValue<T>(first, last, rowIndex);
+				}
+				return !layout.selected || nFields < nSlots;
+			});
+
+			if (layout.selected ? nFields < nSlots : nFields != nSlots)
+				throw std::runtime_error(std::format("Non consistent column count in file, on data row {}", rowIndex + 1));
+			return nextLine(p, end);
+		}
+
+		// Skips the rows before the data, and reads the column names of the header. Returns the start of the data
+		inline const char* skipPreamble(const char* p, const char* end, const Options& options, std::vector<std::string>& names)
+		{
+			if (end - p >= 3 && std::memcmp(p, "\xEF\xBB\xBF", 3) == 0)
+				p += 3;
+			for (int i = 0; i < options.skipRows; i++) {
+				p = nextLine(p, end);
+			}
+			if (!options.header)
+				return p;
+
+			while (p < end && !holdsData(p, end, options.delimiter, options.comment)) {
+				p = nextLine(p, end);
+			}
+			if (p == end)
+				return p;
+			p = forEachField(p, end, options.delimiter, [&](const char* first, const char* last, int) {
+				if (last - first >= 2 && (*first == '"' || *first == '\'') && last[-1] == *first) {
+					first++;
+					last--;
+				}
+				names.emplace_back(first, last);
+				return true;
+			});
+			return nextLine(p, end);
+		}
+
+		// Which fields go to which columns, from the options and the first data line
+		inline Layout layoutOf(const char* data, const char* end, const Options& options, const std::vector<std::string>& names)
+		{
+			Layout layout{ options.delimiter, options.comment, {} };
+
+			int nFields = (int)names.size();
+			for (const char* p = data; p < end; p = nextLine(p, end)) {
+				if (holdsData(p, end, options.delimiter, options.comment)) {
+					forEachField(p, end, options.delimiter, [&](const char*, const char*, int index) {
+						nFields = index + 1;
+						return true;
+					});
+					break;
+				}
+			}
+
+			std::vector<int> columns = options.columns;
+			for (const std::string& name : options.columnNames) {
+				auto it = std::find(names.begin(), names.end(), name);
+				if (it == names.end())
+					throw std::invalid_argument(std::format("No column named '{}' in the header", name));
+				columns.push_back((int)(it - names.begin()));
+			}
+
+			if (columns.empty()) {
+				layout.slots.resize((size_t)nFields);
+				std::iota(layout.slots.begin(), layout.slots.end(), 0);
+				layout.nColumns = nFields;
+				return layout;
+			}
+
+			layout.selected = true;
+			layout.nColumns = (int)columns.size();
+			layout.slots.assign((size_t)*std::max_element(columns.begin(), columns.end()) + 1, -1);
+			for (int j = 0; j < (int)columns.size(); j++) {
+				if (columns[j] < 0)
+					throw std::invalid_argument(std::format("Invalid column {}", columns[j]));
+				if (layout.slots[columns[j]] >= 0)
+					throw std::invalid_argument(std::format("Column {} is selected twice", columns[j]));
+				layout.slots[columns[j]] = j;
+			}
+			return layout;
+		}
+
+		// The data lines of [data, end) as rows of a 2d array. Errors count the rows from firstRow
+		template<typename T>
+		ndArray<T> parseRows(const char* data, const char* end, const Layout& layout, Execution execution, size_t firstRow = 0)
+		{
+			// Each chunk starts at the first line that starts in its range of bytes
+			const size_t nChunks = std::max<size_t>(1, ((size_t)(end - data) + chunkBytes - 1) / chunkBytes);
+			std::vector<const char*> bounds(nChunks + 1, end);
+			bounds[0] = data;
+			for (size_t k = 1; k < nChunks; k++) {
+				bounds[k] = std::max(bounds[k - 1], nextLine(data + k * chunkBytes - 1, end));
+			}
+
+			std::vector<size_t> rowsBefore(nChunks + 1, 0);
+			Parallel::forChunks(nChunks, execution, [&](size_t first, size_t last) {
+				for (size_t k = first; k < last; k++) {
+					size_t rows = 0;
+					for (const char* p = bounds[k]; p < bounds[k + 1]; p = nextLine(p, end)) {
+						rows += holdsData(p, end, layout.delimiter, layout.comment);
+					}
+					rowsBefore[k + 1] = rows;
+				}
+			}, chunkBytes);
+			std::partial_sum(rowsBefore.begin(), rowsBefore.end(), rowsBefore.begin());
+
+			const size_t nRows = rowsBefore[nChunks];
+			const size_t nColumns = (size_t)layout.nColumns;
+			Memory::Buffer<T> elements(nRows * nColumns);
+
+			Parallel::forChunks(nChunks, execution, [&](size_t first, size_t last) {
+				for (size_t k = first; k < last; k++) {
+					size_t row = rowsBefore[k];
+					for (const char* p = bounds[k]; p < bounds[k + 1];) {
+						if (holdsData(p, end, layout.delimiter, layout.comment)) {
+							p = parseLine(p, end, layout, elements.data() + row * nColumns, firstRow + row);
+							row++;
+						}
+						else {
+							p = nextLine(p, end);
+						}
+					}
+				}
+			}, chunkBytes);
+
+			return ndArray<T>(std::move(elements), Shape{ (int)nRows, (int)nColumns });
+		}
+	}
+
+
+	//--------------------------
+	// Reading
+	// -------------------------
+
+	// Parses delimited text into a 2d array, with one row per data line
+	template<typename T>
+	ndArray<T> parse(std::string_view text, const Options& options = Options())
+	{
+		static_assert(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>, "Only numbers can be read from text");
+		using namespace Detail;
+
+		const char* end = text.data() + text.size();
+		std::vector<std::string> names;
+		const char* data = skipPreamble(text.data(), end, options, names);
+		const Layout layout = layoutOf(data, end, options, names);
+
+		return parseRows<T>(data, end, layout, options.execution);
+	}
+
+	template<typename T>
+	ndArray<T> read(std::string_view path, const Options& options = Options())
+	{
+		const Memory::MappedFile file(path);
+		return parse<T>(std::string_view(file.data(), file.size()), options);
+	}
+
+	// The column names of the header, see Options::header
+	inline std::vector<std::string> header(std::string_view path, const Options& options = Options())
+	{
+		assert(options.header);
+		const Memory::MappedFile file(path);
+		std::vector<std::string> names;
+		Detail::skipPreamble(file.data(), file.data() + file.size(), options, names);
+		return names;
+	}
+
+
+	//--------------------------
+	// Writing
+	// -------------------------
+
+	struct WriteOptions
+	{
+		char delimiter = ',';
+
+		// Significant digits of floating point numbers in the notation, or the shortest text that reads back exactly if negative
+		int precision = -1;
+		std::chars_format notation = std::chars_format::general;
+
+		// Written as the first line, if not empty
+		std::vector<std::string> header;
+
+		// Adds to the end of the file, rather than replacing it
+		bool append = false;
+
+		Execution execution = Parallel::defaultExecution();
+	};
+
+	namespace Detail
+	{
+		// Chunks of rows formatted at once, before they are written
+		constexpr size_t chunksPerBatch = 64;
+
+		// Text that grows without initializing its memory, and keeps its capacity when cleared
+		class TextBuffer
+		{
+		public:
+			// Where at least n more characters can be written
+			char* reserve(size_t n)
+			{
+				if (m_size + n > m_capacity) {
+					const size_t capacity = std::max(m_size + n, 2 * m_capacity);
+					std::unique_ptr<char[]> grown(new char[capacity]);
+					if (m_size > 0)
+						std::memcpy(grown.get(), m_data.get(), m_size);
+					m_data = std::move(grown);
+					m_capacity = capacity;
+				}
+				return m_data.get() + m_size;
+			}
+			// Keeps what has been written up to end
+			void commit(const char* end) { m_size = (size_t)(end - m_data.get()); }
+			void clear() { m_size = 0; }
+
+			const char* data()const { return m_data.get(); }
+			size_t size()const { return m_size; }
+
+		private:
+			std::unique_ptr<char[]> m_data;
+			size_t m_size = 0;
+			size_t m_capacity = 0;
+		};
+
+		// The longest text of a single number
+		template<typename T>
+		size_t maxWidth(const WriteOptions& options)
+		{
+			if constexpr (std::is_floating_point_v<T>) {
+				const size_t digits = (size_t)std::max(options.precision, 0);
+				return (options.precision >= 0 && options.notation == std::chars_format::fixed) ? 320 + digits : 32 + digits;
+			}
+			else {
+				return 24;
+			}
+		}
+
+		template<typename T>
+		void formatRows(const T* data, size_t nRows, size_t nColumns, const WriteOptions& options, TextBuffer& out)
+		{
+			const size_t width = maxWidth<T>(options);
+			for (size_t i = 0; i < nRows; i++) {
+				char* p = out.reserve(nColumns * (width + 1));
+				char* const last = p + nColumns * (width + 1);
+				for (size_t j = 0; j < nColumns; j++) {
+					const T value = data[i * nColumns + j];
+					std::to_chars_result result;
+					if constexpr (std::is_floating_point_v<T>) {
+						result = (options.precision < 0) ? std::to_chars(p, last, value) : std::to_chars(p, last, value, options.notation, options.precision);
+					}
+					else {
+						result = std::to_chars(p, last, value);
+					}
+					p = result.ptr;
+					*p++ = (j + 1 < nColumns) ? options.delimiter : '\n';
+				}
+				out.commit(p);
+			}
+		}
+	}
+
+	// Writes the array as lines of text, one per row of its last axis. A 1d array is written as a column
+	template<typename T>
+	void write(std::ostream& stream, const ndArray<T>& arr, const WriteOptions& options = WriteOptions())
+	{
+		static_assert(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>, "Only numbers can be written as text");
+		using namespace Detail;
+
+		if (!options.header.empty()) {
+			std::string line;
+			for (const std::string& name : options.header) {
+				line += name;
+				line += options.delimiter;
+			}
+			line.back() = '\n';
+			stream.write(line.data(), (std::streamsize)line.size());
+		}
+
+		const size_t nColumns = (arr.size() == 0) ? 1 : (arr.nDims() == 1) ? 1 : (size_t)arr.shape().back();
+		const size_t nRows = arr.size() / nColumns;
+		const size_t rowsPerChunk = Parallel::chunkLength(nColumns);
+		const size_t nChunks = (nRows + rowsPerChunk - 1) / rowsPerChunk;
+
+		std::vector<TextBuffer> buffers(std::min(nChunks, chunksPerBatch));
+		for (size_t batch = 0; batch < nChunks; batch += buffers.size()) {
+			const size_t n = std::min(buffers.size(), nChunks - batch);
+			Parallel::forChunks(n, options.execution, [&](size_t first, size_t last) {
+				for (size_t k = first; k < last; k++) {
+					const size_t row = (batch + k) * rowsPerChunk;
+					buffers[k].clear();
+					formatRows(arr.data() + row * nColumns, std::min(rowsPerChunk, nRows - row), nColumns, options, buffers[k]);
+				}
+			}, rowsPerChunk * nColumns);
+
+			for (size_t k = 0; k < n; k++) {
+				stream.write(buffers[k].data(), (std::streamsize)buffers[k].size());
+			}
+		}
+		if (!stream)
+			throw std::runtime_error("Could not write the text");
+	}
+
+	template<typename T>
+	void write(std::string_view path, const ndArray<T>& arr, const WriteOptions& options = WriteOptions())
+	{
+		std::ofstream stream(std::string(path), std::ios::binary | (options.append ? std::ios::app : std::ios::trunc));
+		if (!stream.is_open())
+			throw std::runtime_error(std::format("Could not open file: {}", path));
+		write(stream, arr, options);
+	}
+
+	// The text that write() would write
+	template<typename T>
+	std::string format(const ndArray<T>& arr, const WriteOptions& options = WriteOptions())
+	{
+		std::ostringstream stream;
+		write(stream, arr, options);
+		return std::move(stream).str();
+	}
+}
+}
@@ -0,0 +1,385 @@
+#pragma once
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <cstdint>
+#include <assert.h>
+#include "Meta.h"
+#include "Broadcast.h"
+#include "Simd.h"
+#include "Parallel.h"
+
+namespace Cnum
+{
+	template<typename T>
+	class ndArray;
+
+namespace Expression
+{
+	/*
+		What is an expression?
+			The arithmetic operators (+ - * /) on ndArrays do not compute anything by themselves.
+			They return a light weight node which remembers the operands and the operation.
+			The nodes are only evaluated when they are assigned to an ndArray, or when eval() is called.
+
+			Example: a*b + c*d - e builds the tree
+				Binary(-, Binary(+, Binary(*, a, b), Binary(*, c, d)), e)
+			which is evaluated in one single loop with one single output allocation.
+
+		Operands that are lvalue ndArrays are kept by reference, all other operands (nodes and temporary ndArrays) are kept by value.
+		Hence a node must not outlive the named arrays that it refers to.
+	*/
+
+	template<typename Derived>
+	struct NodeBase
+	{
+		auto eval(Execution execution = Parallel::defaultExecution())const
+		{
+			return ndArray<typename Derived::value_type>(static_cast<const Derived&>(*this), execution);
+		}
+	};
+
+	template<typename T>
+	struct isNdArray : std::false_type {};
+
+	template<typename T>
+	struct isNdArray<ndArray<T>> : std::true_type {};
+
+	template<typename E>
+	concept Node = std::is_base_of_v<NodeBase<std::remove_cvref_t<E>>, std::remove_cvref_t<E>>;
+
+	template<typename E>
+	concept Operand = isNdArray<std::remove_cvref_t<E>>::value || Node<E>;
+
+	template<typename L, typename R>
+	concept BinaryOperands =
+		(Operand<L> && Operand<R>) ||
+		(Operand<L> && arithmetic<std::remove_cvref_t<R>>) ||
+		(arithmetic<std::remove_cvref_t<L>> && Operand<R>);
+
+
+	// A scalar taking part in an expression. It has no shape of its own
+	template<typename T>
+	struct Scalar
+	{
+		using value_type = T;
+		T operator[](size_t)const { return value; }
+		T value;
+	};
+
+	template<typename E>
+	struct isScalar : std::false_type {};
+
+	template<typename T>
+	struct isScalar<Scalar<T>> : std::true_type {};
+
+	// Flat element access. ndArray::operator[] is reserved for 1d indexing, so leaves are read through their raw data
+	template<typename E>
+	decltype(auto) element(const E& e, size_t i)
+	{
+		if constexpr (isNdArray<E>::value)
+			return e.buffer()[i];
+		else
+			return e[i];
+	}
+
+	// Lvalue ndArrays are stored as references, everything else by value
+	template<typename E>
+	using Stored = std::conditional_t<
+		std::is_lvalue_reference_v<E> && isNdArray<std::remove_cvref_t<E>>::value,
+		const std::remove_cvref_t<E>&,
+		std::remove_cvref_t<E>>;
+
+
+	template<typename L, typename R, typename Op>
+	class Binary : public NodeBase<Binary<L, R, Op>>
+	{
+	public:
+		using value_type = std::conditional_t<isScalar<std::remove_cvref_t<L>>::value,
+			typename std::remove_cvref_t<R>::value_type, typename std::remove_cvref_t<L>::value_type>;
+		using operation_type = Op;
+
+		Binary(L lhs, R rhs, Op op)
+			: m_lhs{ std::forward<L>(lhs) }, m_rhs{ std::forward<R>(rhs) }, m_op{ op }
+		{
+			// Operands of different shapes are broadcast, see Broadcast.h
+			if constexpr (!isScalar<std::remove_cvref_t<L>>::value && !isScalar<std::remove_cvref_t<R>>::value) {
+				if (!std::ranges::equal(m_lhs.shape(), m_rhs.shape())) {
+					m_shape = Broadcast::shape(m_lhs.shape(), m_rhs.shape());
+					m_lhsMap = Broadcast::IndexMap(m_lhs.shape(), m_shape);
+					m_rhsMap = Broadcast::IndexMap(m_rhs.shape(), m_shape);
+					m_broadcasts = !m_lhsMap.isIdentity() || !m_rhsMap.isIdentity();
+					m_size = (size_t)std::accumulate(m_shape.begin(), m_shape.end(), 1, std::multiplies<int>());
+				}
+			}
+		}
+
+		value_type operator[](size_t i)const
+		{
+			if (m_broadcasts)
+				return (value_type)m_op(element(m_lhs, m_lhsMap(i)), element(m_rhs, m_rhsMap(i)));
+			return (value_type)m_op(element(m_lhs, i), element(m_rhs, i));
+		}
+		const Shape& shape()const
+		{
+			if (m_broadcasts)
+				return m_shape;
+			if constexpr (isScalar<std::remove_cvref_t<L>>::value)
+				return m_rhs.shape();
+			else
+				return m_lhs.shape();
+		}
+		size_t size()const
+		{
+			if constexpr (isScalar<std::remove_cvref_t<L>>::value)
+				return m_rhs.size();
+			else if constexpr (isScalar<std::remove_cvref_t<R>>::value)
+				return m_lhs.size();
+			else
+				return m_broadcasts ? m_size : m_lhs.size();
+		}
+
+		const auto& lhs()const { return m_lhs; }
+		const auto& rhs()const { return m_rhs; }
+
+		bool broadcasts()const { return m_broadcasts; }
+		const Broadcast::IndexMap& lhsMap()const { return m_lhsMap; }
+		const Broadcast::IndexMap& rhsMap()const { return m_rhsMap; }
+
+	private:
+		L m_lhs;
+		R m_rhs;
+		Op m_op;
+
+		Shape m_shape;
+		Broadcast::IndexMap m_lhsMap;
+		Broadcast::IndexMap m_rhsMap;
+		size_t m_size = 0;
+		bool m_broadcasts = false;
+	};
+
+	template<typename E, typename Op>
+	class Unary : public NodeBase<Unary<E, Op>>
+	{
+	public:
+		using value_type = typename std::remove_cvref_t<E>::value_type;
+
+		Unary(E operand, Op op)
+			: m_operand{ std::forward<E>(operand) }, m_op{ op }
+		{}
+
+		value_type operator[](size_t i)const
+		{
+			return (value_type)m_op(element(m_operand, i));
+		}
+		const auto& shape()const { return m_operand.shape(); }
+		size_t size()const { return m_operand.size(); }
+
+		const auto& operand()const { return m_operand; }
+
+	private:
+		E m_operand;
+		Op m_op;
+	};
+
+
+	// Factories
+
+	template<typename E, typename V>
+	decltype(auto) makeOperand(E&& e)
+	{
+		if constexpr (Operand<E>)
+			return std::forward<E>(e);
+		else
+			return Scalar<V>{ (V)e };
+	}
+
+	template<typename L, typename R>
+	using ValueTypeOf = typename std::conditional_t<Operand<L>, std::remove_cvref_t<L>, std::remove_cvref_t<R>>::value_type;
+
+	template<typename L, typename R, typename Op>
+	auto makeBinary(L&& lhs, R&& rhs, Op op)
+	{
+		using V = ValueTypeOf<L, R>;
+		using LStored = std::conditional_t<Operand<L>, Stored<L>, Scalar<V>>;
+		using RStored = std::conditional_t<Operand<R>, Stored<R>, Scalar<V>>;
+		return Binary<LStored, RStored, Op>(
+			makeOperand<L, V>(std::forward<L>(lhs)),
+			makeOperand<R, V>(std::forward<R>(rhs)), op);
+	}
+
+	template<typename E, typename Op>
+	auto makeUnary(E&& operand, Op op)
+	{
+		return Unary<Stored<E>, Op>(std::forward<E>(operand), op);
+	}
+
+
+	// The vector kernel of an operation, if it has one
+	template<typename Op>
+	struct ArithOf { static constexpr bool exists = false; };
+	template<>
+	struct ArithOf<std::plus<>> { static constexpr bool exists = true; static constexpr Simd::Arith op = Simd::Arith::Add; };
+	template<>
+	struct ArithOf<std::minus<>> { static constexpr bool exists = true; static constexpr Simd::Arith op = Simd::Arith::Subtract; };
+	template<>
+	struct ArithOf<std::multiplies<>> { static constexpr bool exists = true; static constexpr Simd::Arith op = Simd::Arith::Multiply; };
+	template<>
+	struct ArithOf<std::divides<>> { static constexpr bool exists = true; static constexpr Simd::Arith op = Simd::Arith::Divide; };
+
+	// Leaves whose elements lie contiguously in memory, with the same type as the expression
+	template<typename E, typename V>
+	constexpr bool isLeafOf = std::is_same_v<std::remove_cvref_t<E>, ndArray<V>> || std::is_same_v<std::remove_cvref_t<E>, Scalar<V>>;
+
+	template<typename V, typename E>
+	Simd::Input<V> inputOf(const E& leaf)
+	{
+		if constexpr (isScalar<std::remove_cvref_t<E>>::value)
+			return Simd::Input<V>{ &leaf.value, true };
+		else
+			return Simd::Input<V>{ leaf.data(), false };
+	}
+
+	template<typename E>
+	struct isKernelBinary : std::false_type {};
+
+	template<typename L, typename R, typename Op>
+	struct isKernelBinary<Binary<L, R, Op>> : std::bool_constant<
+		ArithOf<Op>::exists &&
+		Simd::isVectorizable<typename Binary<L, R, Op>::value_type> &&
+		isLeafOf<L, typename Binary<L, R, Op>::value_type> &&
+		isLeafOf<R, typename Binary<L, R, Op>::value_type>> {};
+
+
+	// The input of a broadcast leaf for the row of the output starting at flatIndex. A repeated element along the row is passed as a scalar
+	template<typename V, typename E>
+	Simd::Input<V> rowInputOf(const E& leaf, const Broadcast::IndexMap& map, size_t flatIndex)
+	{
+		Simd::Input<V> input = inputOf<V>(leaf);
+		if (input.isScalar)
+			return input;
+		return Simd::Input<V>{ input.data + map(flatIndex), map.innerStride() == 0 };
+	}
+
+	/*
+		Does the expression read the memory [begin, end) anywhere else than at the element it writes?
+			Element i of the output is computed from element i of each leaf, so a leaf may be the output array itself. A view
+			or a broadcast operand maps i elsewhere, and would read elements that have already been overwritten, e.g. when
+			reversing an array into itself. mapped is set below a broadcast operand whose index map is not the identity.
+	*/
+	template<typename E>
+	bool aliases(const E& e, const void* begin, const void* end, bool mapped = false)
+	{
+		using Leaf = std::remove_cvref_t<E>;
+		const auto overlaps = [&](const void* first, const void* last) {
+			return (uintptr_t)first < (uintptr_t)end && (uintptr_t)begin < (uintptr_t)last;
+		};
+
+		if constexpr (isScalar<Leaf>::value) {
+			return false;
+		}
+		else if constexpr (isNdArray<Leaf>::value) {
+			return mapped && e.size() > 0 && overlaps(e.data(), e.data() + e.size());
+		}
+		else if constexpr (requires { e.lhs(); e.rhs(); }) {
+			return aliases(e.lhs(), begin, end, mapped || (e.broadcasts() && !e.lhsMap().isIdentity())) ||
+				aliases(e.rhs(), begin, end, mapped || (e.broadcasts() && !e.rhsMap().isIdentity()));
+		}
+		else if constexpr (requires { e.operand(); }) {
+			return aliases(e.operand(), begin, end, mapped);
+		}
+		else {
+			// A view, whose elements span the addresses between its lowest and its highest offset
+			if (e.size() == 0)
+				return false;
+			std::ptrdiff_t low = 0, high = 0;
+			for (size_t i = 0; i < e.shape().size(); i++) {
+				const std::ptrdiff_t extent = (std::ptrdiff_t)(e.shape()[i] - 1) * e.strides()[i];
+				low += std::min<std::ptrdiff_t>(extent, 0);
+				high += std::max<std::ptrdiff_t>(extent, 0);
+			}
+			if (!overlaps(e.data() + low, e.data() + high + 1))
+				return false;
+			return mapped || (const void*)e.data() != begin || !e.isContiguous();
+		}
+	}
+
+	// Evaluation. Writes the whole expression to out in one fused loop, split over threads for large expressions
+	template<Node E>
+	void evaluate(const E& expr, typename E::value_type* out, Execution execution = Parallel::defaultExecution())
+	{
+		if constexpr (isKernelBinary<E>::value) {
+			using V = typename E::value_type;
+			constexpr Simd::Arith op = ArithOf<typename E::operation_type>::op;
+
+			// A single operation on arrays and scalars runs on the vector kernels, one row at a time if an operand is broadcast
+			if (expr.broadcasts()) {
+				const size_t rowLength = (size_t)expr.shape().back();
+				const size_t nRows = (rowLength > 0) ? expr.size() / rowLength : 0;
+				Parallel::forChunks(nRows, execution, [&](size_t begin, size_t end) {
+					for (size_t row = begin; row < end; row++) {
+						const size_t first = row * rowLength;
+						Simd::arithmetic<op>(
+							rowInputOf<V>(expr.lhs(), expr.lhsMap(), first), rowInputOf<V>(expr.rhs(), expr.rhsMap(), first),
+							out + first, rowLength);
+					}
+				}, rowLength);
+				return;
+			}
+
+			Parallel::forChunks(expr.size(), execution, [&](size_t begin, size_t end) {
+				Simd::arithmetic<op>(inputOf<V>(expr.lhs()).from(begin), inputOf<V>(expr.rhs()).from(begin), out + begin, end - begin);
+			});
+			return;
+		}
+
+		Parallel::forChunks(expr.size(), execution, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				out[i] = expr[i];
+			}
+		});
+	}
+}
+
+
+	//--------------------------
+	// Arithmetic operators
+	// -------------------------
+
+	template<typename L, typename R> requires Expression::BinaryOperands<L, R>
+	auto operator+(L&& lhs, R&& rhs)
+	{
+		return Expression::makeBinary(std::forward<L>(lhs), std::forward<R>(rhs), std::plus<>());
+	}
+
+	template<typename L, typename R> requires Expression::BinaryOperands<L, R>
+	auto operator-(L&& lhs, R&& rhs)
+	{
+		return Expression::makeBinary(std::forward<L>(lhs), std::forward<R>(rhs), std::minus<>());
+	}
+
+	template<typename L, typename R> requires Expression::BinaryOperands<L, R>
+	auto operator*(L&& lhs, R&& rhs)
+	{
+		return Expression::makeBinary(std::forward<L>(lhs), std::forward<R>(rhs), std::multiplies<>());
+	}
+
+	template<typename L, typename R> requires Expression::BinaryOperands<L, R>
+	auto operator/(L&& lhs, R&& rhs)
+	{
+		if constexpr (Expression::isNdArray<std::remove_cvref_t<R>>::value) {
+			assert(std::find(rhs.begin(), rhs.end(), 0) == rhs.end());
+		}
+		return Expression::makeBinary(std::forward<L>(lhs), std::forward<R>(rhs), std::divides<>());
+	}
+
+	template<Expression::Operand E>
+	auto operator-(E&& operand)
+	{
+		return Expression::makeUnary(std::forward<E>(operand), std::negate<>());
+	}
+
+}
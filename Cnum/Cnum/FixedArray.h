@@ -0,0 +1,238 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include <algorithm>
+#include <concepts>
+#include <assert.h>
+#include "Shape.h"
+#include "Memory.h"
+
+namespace Cnum
+{
+	template<typename T>
+	class ndArray;
+
+	/*
+		What is a FixedArray?
+			An array whose shape is known at compile time, like FixedArray<double, 3> for a point or FixedArray<double, 3, 3>
+			for a rotation matrix. The elements are stored inline in row major order, so it never allocates, and every loop
+			has a constant trip count that the compiler unrolls. It is meant for the many small vectors and matrices of
+			geometry and physics code, where an ndArray would spend more time on its heap buffer than on the arithmetic.
+
+			Arithmetic is elementwise like for ndArray, see matrixMul(), dot() and cross() for the linear algebra.
+			An ndArray of the same number of elements converts to a FixedArray, and toArray() converts back.
+	*/
+	template<typename T, int... Dims>
+	class FixedArray
+	{
+		static_assert(sizeof...(Dims) > 0 && ((Dims > 0) && ...), "A FixedArray needs at least one axis, and no empty axes");
+
+	public:
+
+		using value_type = T;
+
+		static constexpr int rank = (int)sizeof...(Dims);
+		static constexpr size_t count = ((size_t)Dims * ...);
+		static constexpr std::array<int, sizeof...(Dims)> dims{ Dims... };
+
+		//--------------------------
+		// Constructors
+		// -------------------------
+
+		constexpr FixedArray() = default;
+		constexpr explicit FixedArray(T value)
+		{
+			m_data.fill(value);
+		}
+		// All elements in row major order
+		template<typename... Values>
+			requires (sizeof...(Values) == count && count > 1 && (std::convertible_to<Values, T> && ...))
+		constexpr FixedArray(Values... values)
+			: m_data{ (T)values... }
+		{
+		}
+		explicit FixedArray(const ndArray<T>& arr)
+		{
+			assert(arr.size() == count);
+			assert(rank == 1 ? arr.nDims() == 1 : arr.shape() == this->shape());
+			std::copy(arr.data(), arr.data() + count, m_data.begin());
+		}
+
+		static constexpr FixedArray identity() requires (rank == 2 && dims[0] == dims[1])
+		{
+			FixedArray out;
+			for (int i = 0; i < dims[0]; i++) {
+				out.at(i, i) = T(1);
+			}
+			return out;
+		}
+
+		ndArray<T> toArray()const
+		{
+			return ndArray<T>(Memory::Buffer<T>(m_data.begin(), m_data.end()), this->shape());
+		}
+
+		//--------------------------
+		// Access
+		// -------------------------
+
+		constexpr T& operator[](size_t i) { return m_data[i]; }
+		constexpr const T& operator[](size_t i)const { return m_data[i]; }
+
+		template<std::integral... Indices>
+			requires (sizeof...(Indices) == sizeof...(Dims))
+		constexpr T& at(Indices... indices) { return m_data[flatten(indices...)]; }
+		template<std::integral... Indices>
+			requires (sizeof...(Indices) == sizeof...(Dims))
+		constexpr const T& at(Indices... indices)const { return m_data[flatten(indices...)]; }
+
+		constexpr T* data() { return m_data.data(); }
+		constexpr const T* data()const { return m_data.data(); }
+		constexpr T* begin() { return m_data.data(); }
+		constexpr T* end() { return m_data.data() + count; }
+		constexpr const T* begin()const { return m_data.data(); }
+		constexpr const T* end()const { return m_data.data() + count; }
+
+		static constexpr size_t size() { return count; }
+		static Shape shape() { return Shape{ Dims... }; }
+
+		//--------------------------
+		// Arithmetic
+		// -------------------------
+
+		constexpr FixedArray& operator+=(const FixedArray& rhs) { return this->apply(rhs, [](T& a, T b) { a += b; }); }
+		constexpr FixedArray& operator-=(const FixedArray& rhs) { return this->apply(rhs, [](T& a, T b) { a -= b; }); }
+		constexpr FixedArray& operator*=(const FixedArray& rhs) { return this->apply(rhs, [](T& a, T b) { a *= b; }); }
+		constexpr FixedArray& operator/=(const FixedArray& rhs) { return this->apply(rhs, [](T& a, T b) { a /= b; }); }
+		constexpr FixedArray& operator+=(T rhs) { return this->apply(FixedArray(rhs), [](T& a, T b) { a += b; }); }
+		constexpr FixedArray& operator-=(T rhs) { return this->apply(FixedArray(rhs), [](T& a, T b) { a -= b; }); }
+		constexpr FixedArray& operator*=(T rhs) { return this->apply(FixedArray(rhs), [](T& a, T b) { a *= b; }); }
+		constexpr FixedArray& operator/=(T rhs) { return this->apply(FixedArray(rhs), [](T& a, T b) { a /= b; }); }
+
+		friend constexpr FixedArray operator+(FixedArray lhs, const FixedArray& rhs) { return lhs += rhs; }
+		friend constexpr FixedArray operator-(FixedArray lhs, const FixedArray& rhs) { return lhs -= rhs; }
+		friend constexpr FixedArray operator*(FixedArray lhs, const FixedArray& rhs) { return lhs *= rhs; }
+		friend constexpr FixedArray operator/(FixedArray lhs, const FixedArray& rhs) { return lhs /= rhs; }
+		friend constexpr FixedArray operator+(FixedArray lhs, T rhs) { return lhs += rhs; }
+		friend constexpr FixedArray operator-(FixedArray lhs, T rhs) { return lhs -= rhs; }
+		friend constexpr FixedArray operator*(FixedArray lhs, T rhs) { return lhs *= rhs; }
+		friend constexpr FixedArray operator/(FixedArray lhs, T rhs) { return lhs /= rhs; }
+		friend constexpr FixedArray operator+(T lhs, FixedArray rhs) { return rhs += lhs; }
+		friend constexpr FixedArray operator*(T lhs, FixedArray rhs) { return rhs *= lhs; }
+		friend constexpr FixedArray operator-(const FixedArray& arr) { return arr * T(-1); }
+
+		friend constexpr bool operator==(const FixedArray& lhs, const FixedArray& rhs) = default;
+
+		constexpr T sum()const
+		{
+			T out = T(0);
+			for (size_t i = 0; i < count; i++) {
+				out += m_data[i];
+			}
+			return out;
+		}
+		T norm()const
+		{
+			return (T)std::sqrt((*this * *this).sum());
+		}
+		FixedArray& normalize()
+		{
+			return *this /= this->norm();
+		}
+		FixedArray normalized()const
+		{
+			return *this / this->norm();
+		}
+
+	private:
+
+		template<typename Function>
+		constexpr FixedArray& apply(const FixedArray& rhs, Function fn)
+		{
+			for (size_t i = 0; i < count; i++) {
+				fn(m_data[i], rhs.m_data[i]);
+			}
+			return *this;
+		}
+
+		template<typename... Indices>
+		static constexpr size_t flatten(Indices... indices)
+		{
+			const int index[] = { (int)indices... };
+			size_t flat = 0;
+			for (int i = 0; i < rank; i++) {
+				assert(index[i] >= 0 && index[i] < dims[i]);
+				flat = flat * (size_t)dims[i] + (size_t)index[i];
+			}
+			return flat;
+		}
+
+	private:
+		std::array<T, count> m_data{};
+	};
+
+	template<typename T>
+	using Vector3 = FixedArray<T, 3>;
+
+	template<typename T>
+	using Matrix3 = FixedArray<T, 3, 3>;
+
+
+	//--------------------------
+	// Linear algebra
+	// -------------------------
+
+	template<typename T, int N>
+	constexpr T dot(const FixedArray<T, N>& a, const FixedArray<T, N>& b)
+	{
+		return (a * b).sum();
+	}
+
+	template<typename T>
+	constexpr Vector3<T> cross(const Vector3<T>& a, const Vector3<T>& b)
+	{
+		return Vector3<T>(
+			a[1] * b[2] - a[2] * b[1],
+			a[2] * b[0] - a[0] * b[2],
+			a[0] * b[1] - a[1] * b[0]);
+	}
+
+	template<typename T, int M, int K, int N>
+	constexpr FixedArray<T, M, N> matrixMul(const FixedArray<T, M, K>& a, const FixedArray<T, K, N>& b)
+	{
+		FixedArray<T, M, N> out;
+		for (int i = 0; i < M; i++) {
+			for (int p = 0; p < K; p++) {
+				const T scale = a.at(i, p);
+				for (int j = 0; j < N; j++) {
+					out.at(i, j) += scale * b.at(p, j);
+				}
+			}
+		}
+		return out;
+	}
+
+	template<typename T, int M, int K>
+	constexpr FixedArray<T, M> matrixMul(const FixedArray<T, M, K>& a, const FixedArray<T, K>& x)
+	{
+		FixedArray<T, M> out;
+		for (int i = 0; i < M; i++) {
+			for (int p = 0; p < K; p++) {
+				out[i] += a.at(i, p) * x[p];
+			}
+		}
+		return out;
+	}
+
+	template<typename T, int M, int N>
+	constexpr FixedArray<T, N, M> transpose(const FixedArray<T, M, N>& a)
+	{
+		FixedArray<T, N, M> out;
+		for (int i = 0; i < M; i++) {
+			for (int j = 0; j < N; j++) {
+				out.at(j, i) = a.at(i, j);
+			}
+		}
+		return out;
+	}
+}
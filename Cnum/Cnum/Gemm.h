@@ -0,0 +1,291 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <assert.h>
+#include "Simd.h"
+#include "Parallel.h"
+
+namespace Cnum
+{
+namespace Gemm
+{
+	/*
+		What is this?
+			The general matrix product C = alpha * op(A) * op(B) + beta * C on row major matrices, where op() optionally transposes.
+			op(A) is m x k, op(B) is k x n and C is m x n. Rows of a matrix are ld (leading dimension) elements apart.
+
+		How is it computed?
+			As in BLIS, the product is split into blocks which fit in the caches:
+				- A KC x NC block of op(B) is packed into panels of NR columns, which stay in the L3 cache
+				- A MC x KC block of op(A) is packed into panels of MR rows, which stay in the L2 cache
+				- A micro kernel multiplies one A panel with one B panel, keeping the MR x NR result in registers
+			Packing makes the micro kernel read both operands contiguously, whether they are transposed or not.
+			The MC blocks of A are spread over the threads, so every element of C is computed by exactly one thread,
+			always in the same order, which keeps the results reproducible.
+
+			float and double use AVX2 or AVX-512 micro kernels with fused multiply-add, other types a scalar micro kernel.
+	*/
+
+	// Block sizes, in elements
+	constexpr size_t KC = 256;
+	constexpr size_t MC = 96;
+	constexpr size_t NC = 4096;
+
+	// Products with fewer multiply-adds than this stay on the calling thread
+	constexpr double minParallelWork = 1 << 22;
+
+
+	//--------------------------
+	// Micro kernels
+	// -------------------------
+
+	/*
+		Writes the MR x NR product of a packed A panel (kc columns of MR values) and a packed B panel (kc rows of NR values) to acc.
+	*/
+	template<typename T>
+	struct ScalarKernel
+	{
+		static constexpr size_t MR = 4;
+		static constexpr size_t NR = 4;
+
+		static void tile(size_t kc, const T* a, const T* b, T* acc)
+		{
+			std::fill(acc, acc + MR * NR, T(0));
+			for (size_t p = 0; p < kc; p++, a += MR, b += NR) {
+				for (size_t i = 0; i < MR; i++) {
+					for (size_t j = 0; j < NR; j++) {
+						acc[i * NR + j] += a[i] * b[j];
+					}
+				}
+			}
+		}
+	};
+
+#if CNUM_SIMD_X86
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+	// Each row of the tile is held in two vector registers, so 6 rows use 12 accumulators
+	template<typename T, typename V>
+	struct VectorKernel
+	{
+		using Reg = typename V::Reg;
+		static constexpr size_t MR = 6;
+		static constexpr size_t NR = 2 * V::width;
+
+		CNUM_INLINE static inline void tile(size_t kc, const T* a, const T* b, T* acc)
+		{
+			Reg c[MR][2];
+			for (size_t i = 0; i < MR; i++) {
+				c[i][0] = V::set1(T(0));
+				c[i][1] = V::set1(T(0));
+			}
+			for (size_t p = 0; p < kc; p++, a += MR, b += NR) {
+				const Reg b0 = V::load(b);
+				const Reg b1 = V::load(b + V::width);
+				for (size_t i = 0; i < MR; i++) {
+					const Reg ai = V::set1(a[i]);
+					c[i][0] = V::fmadd(ai, b0, c[i][0]);
+					c[i][1] = V::fmadd(ai, b1, c[i][1]);
+				}
+			}
+			for (size_t i = 0; i < MR; i++) {
+				V::store(acc + i * NR, c[i][0]);
+				V::store(acc + i * NR + V::width, c[i][1]);
+			}
+		}
+	};
+
+	template<typename T>
+	using Avx2Kernel = VectorKernel<T, Simd::Detail::Avx2<T>>;
+
+	template<typename T>
+	using Avx512Kernel = VectorKernel<T, Simd::Detail::Avx512<T>>;
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif
+
+
+	//--------------------------
+	// Packing
+	// -------------------------
+
+	// Element (i, p) of a matrix is at data[i * rowStride + p * colStride], which covers both the plain and the transposed case
+	template<typename T>
+	struct MatrixRef
+	{
+		const T& operator()(size_t i, size_t p)const { return data[i * rowStride + p * colStride]; }
+		MatrixRef<T> offset(size_t i, size_t p)const { return { &(*this)(i, p), rowStride, colStride }; }
+
+		const T* data;
+		size_t rowStride;
+		size_t colStride;
+	};
+
+	// Packs the mc x kc block of A into panels of MR rows, padded with zeros
+	template<size_t MR, typename T>
+	void packA(size_t mc, size_t kc, MatrixRef<T> A, T* packed)
+	{
+		for (size_t ir = 0; ir < mc; ir += MR) {
+			const size_t mr = std::min(MR, mc - ir);
+			for (size_t p = 0; p < kc; p++) {
+				for (size_t i = 0; i < MR; i++) {
+					*packed++ = (i < mr) ? A(ir + i, p) : T(0);
+				}
+			}
+		}
+	}
+
+	// Packs the kc x nc block of B into panels of NR columns, padded with zeros
+	template<size_t NR, typename T>
+	void packB(size_t kc, size_t nc, MatrixRef<T> B, T* packed)
+	{
+		for (size_t jr = 0; jr < nc; jr += NR) {
+			const size_t nr = std::min(NR, nc - jr);
+			for (size_t p = 0; p < kc; p++) {
+				for (size_t j = 0; j < NR; j++) {
+					*packed++ = (j < nr) ? B(p, jr + j) : T(0);
+				}
+			}
+		}
+	}
+
+
+	//--------------------------
+	// Blocked product
+	// -------------------------
+
+	// C[mc x nc] += alpha * packedA * packedB. Always inlined, so that the vector tiles are compiled into the entry points
+	// of their instruction set below, and pass their registers the way the V:: functions expect in any build mode
+	template<typename Kernel, typename T>
+	CNUM_INLINE inline void macroKernel(size_t mc, size_t nc, size_t kc, const T* packedA, const T* packedB, T alpha, T* C, size_t ldc)
+	{
+		constexpr size_t MR = Kernel::MR;
+		constexpr size_t NR = Kernel::NR;
+		alignas(64) T acc[MR * NR];
+
+		for (size_t jr = 0; jr < nc; jr += NR) {
+			const size_t nr = std::min(NR, nc - jr);
+			for (size_t ir = 0; ir < mc; ir += MR) {
+				const size_t mr = std::min(MR, mc - ir);
+				Kernel::tile(kc, packedA + ir * kc, packedB + jr * kc, acc);
+
+				T* c = C + ir * ldc + jr;
+				for (size_t i = 0; i < mr; i++) {
+					for (size_t j = 0; j < nr; j++) {
+						c[i * ldc + j] += alpha * acc[i * NR + j];
+					}
+				}
+			}
+		}
+	}
+
+	template<typename T>
+	using MacroKernel = void(*)(size_t, size_t, size_t, const T*, const T*, T, T*, size_t);
+
+	template<typename T>
+	void macroScalar(size_t mc, size_t nc, size_t kc, const T* packedA, const T* packedB, T alpha, T* C, size_t ldc)
+	{
+		macroKernel<ScalarKernel<T>>(mc, nc, kc, packedA, packedB, alpha, C, ldc);
+	}
+
+#if CNUM_SIMD_X86
+	template<typename T>
+	CNUM_TARGET("avx2,fma") CNUM_FLATTEN void macroAvx2(size_t mc, size_t nc, size_t kc, const T* packedA, const T* packedB, T alpha, T* C, size_t ldc)
+	{
+		macroKernel<Avx2Kernel<T>>(mc, nc, kc, packedA, packedB, alpha, C, ldc);
+	}
+
+	template<typename T>
+	CNUM_TARGET("avx512f") CNUM_FLATTEN void macroAvx512(size_t mc, size_t nc, size_t kc, const T* packedA, const T* packedB, T alpha, T* C, size_t ldc)
+	{
+		macroKernel<Avx512Kernel<T>>(mc, nc, kc, packedA, packedB, alpha, C, ldc);
+	}
+#endif
+
+	template<size_t MR, size_t NR, typename T>
+	void blocked(size_t m, size_t n, size_t k, T alpha, MatrixRef<T> A, MatrixRef<T> B, T* C, size_t ldc, bool parallel, MacroKernel<T> macro)
+	{
+		std::vector<T> packedB(((std::min(NC, n) + NR - 1) / NR) * NR * std::min(KC, k));
+
+		for (size_t jc = 0; jc < n; jc += NC) {
+			const size_t nc = std::min(NC, n - jc);
+			for (size_t pc = 0; pc < k; pc += KC) {
+				const size_t kc = std::min(KC, k - pc);
+				packB<NR>(kc, nc, B.offset(pc, jc), packedB.data());
+
+				auto block = [&](size_t blockIndex) {
+					static thread_local std::vector<T> packedA;
+					const size_t ic = blockIndex * MC;
+					const size_t mc = std::min(MC, m - ic);
+					packedA.resize(((mc + MR - 1) / MR) * MR * kc);
+					packA<MR>(mc, kc, A.offset(ic, pc), packedA.data());
+					macro(mc, nc, kc, packedA.data(), packedB.data(), alpha, C + ic * ldc + jc, ldc);
+				};
+
+				const size_t nBlocks = (m + MC - 1) / MC;
+				if (parallel) {
+					ThreadPool::global().run(nBlocks, block);
+				}
+				else {
+					for (size_t b = 0; b < nBlocks; b++) {
+						block(b);
+					}
+				}
+			}
+		}
+	}
+
+
+	//--------------------------
+	// Interface
+	// -------------------------
+
+	template<typename T>
+	void gemm(bool transA, bool transB, size_t m, size_t n, size_t k,
+		T alpha, const T* A, size_t lda, const T* B, size_t ldb,
+		T beta, T* C, size_t ldc, Execution execution = Parallel::defaultExecution())
+	{
+		assert(ldc >= n);
+		assert(lda >= (transA ? m : k));
+		assert(ldb >= (transB ? k : n));
+
+		// beta == 0 overwrites C, so that garbage or NaNs in C do not propagate
+		for (size_t i = 0; i < m; i++) {
+			T* row = C + i * ldc;
+			if (beta == T(0))
+				std::fill(row, row + n, T(0));
+			else if (beta != T(1))
+				std::transform(row, row + n, row, [beta](T c) { return beta * c; });
+		}
+		if (m == 0 || n == 0 || k == 0 || alpha == T(0))
+			return;
+
+		MatrixRef<T> refA = transA ? MatrixRef<T>{ A, 1, lda } : MatrixRef<T>{ A, lda, 1 };
+		MatrixRef<T> refB = transB ? MatrixRef<T>{ B, 1, ldb } : MatrixRef<T>{ B, ldb, 1 };
+		const bool parallel = execution == Execution::Parallel && (double)m * n * k >= minParallelWork;
+
+#if CNUM_SIMD_X86
+		if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double>) {
+			switch (Simd::activeIsa()) {
+			case Simd::Isa::Avx512:
+				blocked<Avx512Kernel<T>::MR, Avx512Kernel<T>::NR>(m, n, k, alpha, refA, refB, C, ldc, parallel, &macroAvx512<T>);
+				return;
+			case Simd::Isa::Avx2:
+				blocked<Avx2Kernel<T>::MR, Avx2Kernel<T>::NR>(m, n, k, alpha, refA, refB, C, ldc, parallel, &macroAvx2<T>);
+				return;
+			default:
+				break;
+			}
+		}
+#endif
+		blocked<ScalarKernel<T>::MR, ScalarKernel<T>::NR>(m, n, k, alpha, refA, refB, C, ldc, parallel, &macroScalar<T>);
+	}
+}
+}
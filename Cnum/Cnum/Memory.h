@@ -0,0 +1,399 @@
+#pragma once
+#include <vector>
+#include <memory_resource>
+#include <new>
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+#include <string>
+#include <string_view>
+#include <stdexcept>
+#include <format>
+#include <assert.h>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Cnum
+{
+namespace Memory
+{
+	/*
+		Where does the memory of an ndArray come from?
+			From the current memory resource of the thread, which is the aligned resource unless a ScopedResource says otherwise.
+			Every block is aligned to 64 bytes, a cache line and the width of an AVX-512 register, whatever the resource is.
+
+			Ready made resources:
+				aligned()     operator new with 64 byte alignment, the default
+				hugePages()   large blocks straight from the OS in 2 MB pages, which saves TLB misses when walking big arrays
+				Arena         bump allocation from a few big chunks. Nothing is freed on its own, everything is released at once
+				threadPool()  pools of blocks of similar sizes, for one thread
+
+			Example: temporaries of a frame are bump allocated, and handed back in bulk when the frame is done
+				Memory::Arena& arena = Memory::threadArena();
+				{
+					Memory::ScopedResource scope(arena);
+					dArray a = ...;   // from the arena, and so is every temporary made in the scope
+				}
+				arena.reset();
+
+			An array keeps the resource it was made with, and a move constructed array takes the memory along. Assigning to
+			an array keeps its resource, the elements are copied over when they come from another one. Copies take the memory
+			from the current resource of the thread. Arrays from an Arena, or a per-thread resource, must not outlive it,
+			nor be released on another thread.
+	*/
+
+	constexpr size_t alignment = 64;
+
+	//--------------------------
+	// Resources
+	// -------------------------
+
+	class AlignedResource : public std::pmr::memory_resource
+	{
+	private:
+		void* do_allocate(size_t bytes, size_t align) override
+		{
+			return ::operator new(bytes, std::align_val_t(std::max(align, alignment)));
+		}
+		void do_deallocate(void* p, size_t, size_t align) override
+		{
+			::operator delete(p, std::align_val_t(std::max(align, alignment)));
+		}
+		bool do_is_equal(const std::pmr::memory_resource& other)const noexcept override
+		{
+			return dynamic_cast<const AlignedResource*>(&other) != nullptr;
+		}
+	};
+
+	inline AlignedResource& aligned()
+	{
+		static AlignedResource resource;
+		return resource;
+	}
+
+	// Blocks of at least minSize bytes are mapped in whole 2 MB pages, smaller ones come from the aligned resource
+	class HugePageResource : public std::pmr::memory_resource
+	{
+	public:
+		static constexpr size_t pageSize = size_t(2) << 20;
+		static constexpr size_t minSize = pageSize;
+
+	private:
+		static size_t roundUp(size_t bytes) { return (bytes + pageSize - 1) / pageSize * pageSize; }
+
+		void* do_allocate(size_t bytes, size_t align) override
+		{
+			if (bytes < minSize)
+				return aligned().allocate(bytes, align);
+#if defined(_WIN32)
+			// Large pages need the SeLockMemoryPrivilege, without it the pages are ordinary ones
+			const size_t large = GetLargePageMinimum();
+			void* p = nullptr;
+			if (large != 0)
+				p = VirtualAlloc(nullptr, (bytes + large - 1) / large * large, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			if (p == nullptr)
+				p = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+			if (p == nullptr)
+				throw std::bad_alloc();
+			return p;
+#elif defined(__unix__) || defined(__APPLE__)
+			void* p = mmap(nullptr, roundUp(bytes), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (p == MAP_FAILED)
+				throw std::bad_alloc();
+#if defined(MADV_HUGEPAGE)
+			madvise(p, roundUp(bytes), MADV_HUGEPAGE);
+#endif
+			return p;
+#else
+			return aligned().allocate(bytes, align);
+#endif
+		}
+		void do_deallocate(void* p, size_t bytes, size_t align) override
+		{
+			if (bytes < minSize) {
+				aligned().deallocate(p, bytes, align);
+				return;
+			}
+#if defined(_WIN32)
+			VirtualFree(p, 0, MEM_RELEASE);
+#elif defined(__unix__) || defined(__APPLE__)
+			munmap(p, roundUp(bytes));
+#else
+			aligned().deallocate(p, bytes, align);
+#endif
+		}
+		bool do_is_equal(const std::pmr::memory_resource& other)const noexcept override
+		{
+			return dynamic_cast<const HugePageResource*>(&other) != nullptr;
+		}
+	};
+
+	inline HugePageResource& hugePages()
+	{
+		static HugePageResource resource;
+		return resource;
+	}
+
+	// Bump allocation from chunks of the upstream resource. Deallocation does nothing, reset() makes all chunks free again
+	class Arena : public std::pmr::memory_resource
+	{
+	public:
+		explicit Arena(size_t chunkSize = size_t(1) << 22, std::pmr::memory_resource* upstream = &aligned())
+			: m_chunkSize{ chunkSize }, m_upstream{ upstream }
+		{
+		}
+		Arena(const Arena&) = delete;
+		Arena& operator=(const Arena&) = delete;
+		~Arena()
+		{
+			this->release();
+		}
+
+		// Everything allocated so far is given up, the chunks are kept for the next round. No array may still use the memory
+		void reset()
+		{
+			assert(m_live == 0 && "Arena::reset() with live allocations, an array from the arena outlived it");
+			m_current = 0;
+			m_offset = 0;
+		}
+		// Everything allocated so far is given up, and the chunks are returned upstream
+		void release()
+		{
+			for (const Chunk& chunk : m_chunks) {
+				m_upstream->deallocate(chunk.data, chunk.size, alignment);
+			}
+			m_chunks.clear();
+			this->reset();
+		}
+
+		size_t bytesReserved()const
+		{
+			size_t total = 0;
+			for (const Chunk& chunk : m_chunks) {
+				total += chunk.size;
+			}
+			return total;
+		}
+
+	private:
+		struct Chunk
+		{
+			std::byte* data;
+			size_t size;
+		};
+
+		void* do_allocate(size_t bytes, size_t align) override
+		{
+			m_live++;
+			align = std::max(align, alignment);
+			for (; m_current < m_chunks.size(); m_current++, m_offset = 0) {
+				const size_t start = (m_offset + align - 1) / align * align;
+				if (start + bytes <= m_chunks[m_current].size) {
+					m_offset = start + bytes;
+					return m_chunks[m_current].data + start;
+				}
+			}
+
+			const size_t size = std::max(m_chunkSize, bytes);
+			m_chunks.push_back({ static_cast<std::byte*>(m_upstream->allocate(size, alignment)), size });
+			m_current = m_chunks.size() - 1;
+			m_offset = bytes;
+			return m_chunks.back().data;
+		}
+		void do_deallocate(void*, size_t, size_t) override
+		{
+			m_live--;
+		}
+		bool do_is_equal(const std::pmr::memory_resource& other)const noexcept override
+		{
+			return this == &other;
+		}
+
+	private:
+		size_t m_chunkSize;
+		std::pmr::memory_resource* m_upstream;
+		std::vector<Chunk> m_chunks;
+		size_t m_current = 0;
+		size_t m_offset = 0;
+		// Allocations not yet deallocated, which reset() checks
+		size_t m_live = 0;
+	};
+
+	inline Arena& threadArena()
+	{
+		static thread_local Arena arena;
+		return arena;
+	}
+
+	inline std::pmr::unsynchronized_pool_resource& threadPool()
+	{
+		static thread_local std::pmr::unsynchronized_pool_resource pool(&aligned());
+		return pool;
+	}
+
+
+	//--------------------------
+	// Current resource
+	// -------------------------
+
+	inline std::pmr::memory_resource*& currentResourceRef()
+	{
+		static thread_local std::pmr::memory_resource* resource = &aligned();
+		return resource;
+	}
+
+	inline std::pmr::memory_resource* currentResource() { return currentResourceRef(); }
+
+	// Makes the resource the current one of the thread, until the scope ends. Arrays made in the scope keep the resource
+	// after it ends, while an array from outside that is assigned a result inside the scope keeps its own
+	class ScopedResource
+	{
+	public:
+		explicit ScopedResource(std::pmr::memory_resource& resource)
+			: m_previous{ currentResourceRef() }
+		{
+			currentResourceRef() = &resource;
+		}
+		ScopedResource(const ScopedResource&) = delete;
+		ScopedResource& operator=(const ScopedResource&) = delete;
+		~ScopedResource()
+		{
+			currentResourceRef() = m_previous;
+		}
+
+	private:
+		std::pmr::memory_resource* m_previous;
+	};
+
+
+	//--------------------------
+	// Allocator
+	// -------------------------
+
+	// Like std::pmr::polymorphic_allocator, but always 64 byte aligned, and the memory moves with a move constructed or
+	// swapped container. Move assignment keeps the resource of the target, as for polymorphic_allocator
+	template<typename T>
+	class Allocator
+	{
+	public:
+		using value_type = T;
+		using propagate_on_container_copy_assignment = std::false_type;
+		using propagate_on_container_move_assignment = std::false_type;
+		using propagate_on_container_swap = std::true_type;
+
+		Allocator() noexcept
+			: m_resource{ currentResource() }
+		{
+		}
+		Allocator(std::pmr::memory_resource* resource) noexcept
+			: m_resource{ resource }
+		{
+		}
+		template<typename U>
+		Allocator(const Allocator<U>& other) noexcept
+			: m_resource{ other.resource() }
+		{
+		}
+
+		T* allocate(size_t n)
+		{
+			return static_cast<T*>(m_resource->allocate(n * sizeof(T), std::max(alignment, alignof(T))));
+		}
+		void deallocate(T* p, size_t n) noexcept
+		{
+			m_resource->deallocate(p, n * sizeof(T), std::max(alignment, alignof(T)));
+		}
+
+		// A copy takes its memory from the current resource, not from the resource of the original
+		Allocator select_on_container_copy_construction()const
+		{
+			return Allocator();
+		}
+
+		std::pmr::memory_resource* resource()const noexcept { return m_resource; }
+
+		template<typename U>
+		bool operator==(const Allocator<U>& other)const noexcept { return m_resource->is_equal(*other.resource()); }
+
+	private:
+		std::pmr::memory_resource* m_resource;
+	};
+
+	template<typename T>
+	using Buffer = std::vector<T, Allocator<T>>;
+
+
+	//--------------------------
+	// Files
+	// -------------------------
+
+	// A whole file mapped read-only into memory. An empty file has no data
+	class MappedFile
+	{
+	public:
+		explicit MappedFile(std::string_view path)
+		{
+#if defined(_WIN32)
+			HANDLE file = CreateFileA(std::string(path).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+				throw std::runtime_error(std::format("Could not open file: {}", path));
+			LARGE_INTEGER size;
+			GetFileSizeEx(file, &size);
+			m_size = (size_t)size.QuadPart;
+			HANDLE mapping = (m_size > 0) ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+			m_data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+			if (mapping)
+				CloseHandle(mapping);
+			CloseHandle(file);
+#else
+			const int file = ::open(std::string(path).c_str(), O_RDONLY);
+			if (file < 0)
+				throw std::runtime_error(std::format("Could not open file: {}", path));
+			struct stat info;
+			fstat(file, &info);
+			m_size = (size_t)info.st_size;
+			if (m_size > 0) {
+				m_data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+				if (m_data == MAP_FAILED)
+					m_data = nullptr;
+			}
+			::close(file);
+#endif
+			if (m_data == nullptr && m_size > 0)
+				throw std::runtime_error(std::format("Could not map file: {}", path));
+		}
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		~MappedFile()
+		{
+			if (m_data == nullptr)
+				return;
+#if defined(_WIN32)
+			UnmapViewOfFile(m_data);
+#else
+			munmap(m_data, m_size);
+#endif
+		}
+
+		const char* data()const { return static_cast<const char*>(m_data); }
+		size_t size()const { return m_size; }
+
+	private:
+		void* m_data = nullptr;
+		size_t m_size = 0;
+	};
+}
+}
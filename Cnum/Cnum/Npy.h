@@ -0,0 +1,893 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <fstream>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <bit>
+#include <type_traits>
+#include <algorithm>
+#include <limits>
+#include <format>
+#include <assert.h>
+#include "Shape.h"
+#include "Memory.h"
+#include "ndView.h"
+
+namespace Cnum
+{
+	template<typename T>
+	class ndArray;
+
+namespace Npy
+{
+	/*
+		What is the .npy format?
+			The binary format of numpy.save: the magic string "\x93NUMPY", a version, and a header holding a Python dict like
+				{'descr': '<f8', 'fortran_order': False, 'shape': (3, 4), }
+			padded with spaces so the data after it starts at a multiple of 64 bytes. The data is the raw elements, in the
+			byte order and the type given by descr, in row major order unless fortran_order is set.
+
+			An .npz file is a zip archive of .npy files, one per array, as written by numpy.savez.
+
+		Loading reads the elements straight into the buffer of the ndArray, converting the type and byte order if they differ.
+		Mapping a file instead gives a read-only view of the elements in the file itself, which costs nothing up front
+		and pages the data in as it is read. The view must not outlive the Mapped object it came from.
+
+			Npy::save("points.npy", points);
+			dArray points = Npy::load<double>("points.npy");
+			Npy::Mapped<double> mapped = Npy::map<double>("points.npy");
+			double total = mapped.view().eval().sum({});
+
+		Compressed .npz entries, from numpy.savez_compressed, are not supported.
+	*/
+
+	//--------------------------
+	// Types
+	// -------------------------
+
+	template<typename T>
+	constexpr char kindOf()
+	{
+		static_assert(std::is_arithmetic_v<T>, "Only arithmetic types can be saved as .npy");
+		if constexpr (std::is_same_v<T, bool>) return 'b';
+		else if constexpr (std::is_floating_point_v<T>) return 'f';
+		else if constexpr (std::is_signed_v<T>) return 'i';
+		else return 'u';
+	}
+
+	constexpr char nativeByteOrder = (std::endian::native == std::endian::little) ? '<' : '>';
+
+	// The descr of the type in the byte order of this machine, e.g. '<f8' for double. Single bytes have no byte order, '|'
+	template<typename T>
+	std::string descrOf()
+	{
+		return std::string{ sizeof(T) == 1 ? '|' : nativeByteOrder, kindOf<T>() } + std::to_string(sizeof(T));
+	}
+
+
+	//--------------------------
+	// Header
+	// -------------------------
+
+	struct Header
+	{
+		std::string descr;
+		bool fortranOrder = false;
+		Shape shape;
+
+		// Bytes from the start of the file to the first element
+		size_t dataOffset = 0;
+
+		char byteOrder()const { return descr.at(0); }
+		char kind()const { return descr.at(1); }
+		size_t itemSize()const { return (size_t)std::stoul(descr.substr(2)); }
+		size_t count()const
+		{
+			size_t n = 1;
+			for (int dim : shape) n *= (size_t)dim;
+			return n;
+		}
+		bool swapsBytes()const { return this->itemSize() > 1 && this->byteOrder() != nativeByteOrder && this->byteOrder() != '='; }
+
+		template<typename T>
+		bool holds()const { return this->kind() == kindOf<T>() && this->itemSize() == sizeof(T) && !this->swapsBytes(); }
+	};
+
+	constexpr std::string_view magic = "\x93NUMPY";
+	constexpr size_t alignment = 64;
+
+	// The whole header, including the magic string, ready to be written in front of the elements. It is padded to minSize bytes
+	inline std::string encodeHeader(const std::string& descr, const Shape& shape, bool fortranOrder = false, size_t minSize = 0)
+	{
+		std::string dims;
+		for (int dim : shape) {
+			dims += std::to_string(dim) + ", ";
+		}
+		if (shape.size() > 1) {
+			dims.resize(dims.size() - 1);
+			dims.back() = ')';
+			dims.insert(dims.begin(), '(');
+		}
+		else {
+			dims = "(" + (dims.empty() ? "" : dims.substr(0, dims.size() - 1)) + ")";
+		}
+		std::string dict = "{'descr': '" + descr + "', 'fortran_order': " + (fortranOrder ? "True" : "False") + ", 'shape': " + dims + ", }";
+
+		// Version 1.0 stores the header length in 2 bytes, 2.0 in 4 bytes
+		const bool wide = dict.size() + 1 + 12 > 0xffff;
+		const size_t prefix = magic.size() + 2 + (wide ? 4 : 2);
+		const size_t length = std::max((prefix + dict.size() + 1 + alignment - 1) / alignment * alignment, minSize) - prefix;
+		dict.resize(length - 1, ' ');
+		dict += '\n';
+
+		std::string out(magic);
+		out += (char)(wide ? 2 : 1);
+		out += (char)0;
+		for (size_t i = 0; i < (wide ? 4u : 2u); i++) {
+			out += (char)((length >> (8 * i)) & 0xff);
+		}
+		return out + dict;
+	}
+
+	namespace Detail
+	{
+		// The value after 'key': in the header dict
+		inline std::string_view valueOf(std::string_view dict, std::string_view key)
+		{
+			const size_t at = dict.find("'" + std::string(key) + "'");
+			if (at == std::string_view::npos)
+				throw std::runtime_error(std::format("Invalid .npy header, no '{}'", key));
+			size_t begin = dict.find(':', at) + 1;
+			while (begin < dict.size() && dict[begin] == ' ') begin++;
+
+			size_t end = begin;
+			if (dict[begin] == '\'' || dict[begin] == '"')
+				end = dict.find(dict[begin], begin + 1) + 1;
+			else if (dict[begin] == '(')
+				end = dict.find(')', begin) + 1;
+			else
+				end = dict.find_first_of(",}", begin);
+			return dict.substr(begin, end - begin);
+		}
+
+		inline Shape parseShape(std::string_view tuple)
+		{
+			Shape shape;
+			const char* p = tuple.data() + 1;
+			const char* end = tuple.data() + tuple.size() - 1;
+			while (p < end) {
+				if (*p == ' ' || *p == ',') {
+					p++;
+					continue;
+				}
+				if (shape.size() == (size_t)Shape::maxRank)
+					throw std::runtime_error(std::format("Arrays of more than {} dimensions are not supported", Shape::maxRank));
+				int dim = 0;
+				for (; p < end && *p >= '0' && *p <= '9'; p++) {
+					dim = dim * 10 + (*p - '0');
+				}
+				if (p < end && *p == 'L') p++;
+				shape.push_back(dim);
+			}
+			return shape;
+		}
+	}
+
+	// Parses the header at the start of bytes, of which size are available
+	inline Header parseHeader(const char* bytes, size_t size)
+	{
+		if (size < 10 || std::string_view(bytes, magic.size()) != magic)
+			throw std::runtime_error("Not an .npy file");
+
+		const int version = (unsigned char)bytes[6];
+		const size_t prefix = magic.size() + 2 + (version == 1 ? 2 : 4);
+		if (size < prefix)
+			throw std::runtime_error("Truncated .npy header");
+		size_t length = 0;
+		for (size_t i = prefix; i-- > magic.size() + 2;) {
+			length = (length << 8) | (unsigned char)bytes[i];
+		}
+		if (size < prefix + length)
+			throw std::runtime_error("Truncated .npy header");
+
+		const std::string_view dict(bytes + prefix, length);
+		Header header;
+		const std::string_view descr = Detail::valueOf(dict, "descr");
+		header.descr = std::string(descr.substr(1, descr.size() - 2));
+		header.fortranOrder = Detail::valueOf(dict, "fortran_order") == "True";
+		header.shape = Detail::parseShape(Detail::valueOf(dict, "shape"));
+		header.dataOffset = prefix + length;
+
+		if (header.descr.size() < 3 || std::string_view("<>|=").find(header.byteOrder()) == std::string_view::npos)
+			throw std::runtime_error(std::format("Unsupported .npy type '{}'", header.descr));
+		return header;
+	}
+
+	inline Header readHeader(std::istream& stream)
+	{
+		std::string bytes(12, '\0');
+		stream.read(bytes.data(), 12);
+		if (stream.gcount() < 10)
+			throw std::runtime_error("Not an .npy file");
+
+		const size_t prefix = ((unsigned char)bytes[6] == 1) ? 10 : 12;
+		size_t length = 0;
+		for (size_t i = prefix; i-- > 8;) {
+			length = (length << 8) | (unsigned char)bytes[i];
+		}
+		bytes.resize(prefix + length);
+		stream.seekg((std::streamoff)prefix - stream.gcount(), std::ios::cur);
+		stream.read(bytes.data() + prefix, (std::streamsize)length);
+		return parseHeader(bytes.data(), bytes.size());
+	}
+
+
+	//--------------------------
+	// Conversion
+	// -------------------------
+
+	namespace Detail
+	{
+		template<typename S, typename T>
+		void convertFrom(const char* src, T* dst, size_t n, bool swapBytes)
+		{
+			if constexpr (std::is_same_v<S, T>) {
+				if (!swapBytes) {
+					std::memcpy(dst, src, n * sizeof(T));
+					return;
+				}
+			}
+			for (size_t i = 0; i < n; i++) {
+				char bytes[sizeof(S)];
+				std::memcpy(bytes, src + i * sizeof(S), sizeof(S));
+				if (swapBytes)
+					std::reverse(bytes, bytes + sizeof(S));
+				S value;
+				std::memcpy(&value, bytes, sizeof(S));
+				dst[i] = (T)value;
+			}
+		}
+	}
+
+	// Converts n elements of the type in the header to T
+	template<typename T>
+	void convert(const Header& header, const char* src, T* dst, size_t n)
+	{
+		const bool swap = header.swapsBytes();
+		switch (header.kind()) {
+		case 'f':
+			switch (header.itemSize()) {
+			case 4: return Detail::convertFrom<float>(src, dst, n, swap);
+			case 8: return Detail::convertFrom<double>(src, dst, n, swap);
+			}
+			break;
+		case 'i':
+			switch (header.itemSize()) {
+			case 1: return Detail::convertFrom<int8_t>(src, dst, n, swap);
+			case 2: return Detail::convertFrom<int16_t>(src, dst, n, swap);
+			case 4: return Detail::convertFrom<int32_t>(src, dst, n, swap);
+			case 8: return Detail::convertFrom<int64_t>(src, dst, n, swap);
+			}
+			break;
+		case 'u':
+			switch (header.itemSize()) {
+			case 1: return Detail::convertFrom<uint8_t>(src, dst, n, swap);
+			case 2: return Detail::convertFrom<uint16_t>(src, dst, n, swap);
+			case 4: return Detail::convertFrom<uint32_t>(src, dst, n, swap);
+			case 8: return Detail::convertFrom<uint64_t>(src, dst, n, swap);
+			}
+			break;
+		case 'b':
+			if (header.itemSize() == 1)
+				return Detail::convertFrom<bool>(src, dst, n, false);
+			break;
+		}
+		throw std::runtime_error(std::format("Unsupported .npy type '{}'", header.descr));
+	}
+
+	namespace Detail
+	{
+		// The array with the shape of the header, from elements in the order of the header
+		template<typename T>
+		ndArray<T> arrange(const Header& header, Memory::Buffer<T>&& elements)
+		{
+			if (header.shape.empty())
+				return ndArray<T>(std::move(elements), Shape{ 1 });
+			if (!header.fortranOrder || header.shape.size() == 1)
+				return ndArray<T>(std::move(elements), header.shape);
+
+			// Column major elements are the row major elements of the reversed shape
+			Shape reversed(header.shape.rbegin(), header.shape.rend());
+			ndArray<T> out(std::move(elements), reversed);
+			out.transpose();
+			return out;
+		}
+	}
+
+
+	//--------------------------
+	// Saving
+	// -------------------------
+
+	/*
+		Writes an .npy file block by block, for arrays that are produced piecewise or do not fit in memory at once.
+		The elements are written in row major order, and their total must add up to the shape.
+
+		If the first axis of the shape is -1, the number of rows is whatever has been written when the file is closed,
+		for streams of rows whose length is not known up front. The header is then completed by close().
+	*/
+	template<typename T>
+	class Writer
+	{
+	public:
+		Writer(std::string_view path, const Shape& shape)
+			: m_stream(std::string(path), std::ios::binary | std::ios::trunc), m_shape{ shape }
+		{
+			if (!m_stream.is_open())
+				throw std::runtime_error(std::format("Could not open file: {}", path));
+
+			// Room for any number of rows, as the header cannot grow once the elements follow it
+			Shape reserved = shape;
+			if (this->growing())
+				reserved[0] = std::numeric_limits<int>::max();
+			const std::string header = encodeHeader(descrOf<T>(), reserved);
+			m_headerSize = header.size();
+			m_stream.write(header.data(), (std::streamsize)header.size());
+		}
+		Writer(const Writer&) = delete;
+		Writer& operator=(const Writer&) = delete;
+		~Writer()
+		{
+			if (m_stream.is_open())
+				m_stream.close();
+		}
+
+		Writer& write(const T* data, size_t n)
+		{
+			assert(this->growing() || m_written + n <= this->count());
+			m_stream.write(reinterpret_cast<const char*>(data), (std::streamsize)(n * sizeof(T)));
+			m_written += n;
+			return *this;
+		}
+		Writer& write(const ndArray<T>& block)
+		{
+			return this->write(block.data(), block.size());
+		}
+
+		// Flushes the file, and checks that every element has been written
+		void close()
+		{
+			if (this->growing()) {
+				const size_t rowLength = this->rowLength();
+				if (rowLength == 0 || m_written % rowLength != 0)
+					throw std::runtime_error(std::format("{} elements do not make whole rows of {} elements", m_written, rowLength));
+				m_shape[0] = (int)(m_written / rowLength);
+
+				const std::string header = encodeHeader(descrOf<T>(), m_shape, false, m_headerSize);
+				m_stream.seekp(0);
+				m_stream.write(header.data(), (std::streamsize)header.size());
+			}
+			m_stream.close();
+			if (m_stream.fail())
+				throw std::runtime_error("Could not write the .npy file");
+			if (m_written != this->count())
+				throw std::runtime_error(std::format("The .npy file holds {} elements, but {} were written", this->count(), m_written));
+		}
+
+		size_t written()const { return m_written; }
+
+	private:
+		bool growing()const { return !m_shape.empty() && m_shape[0] == -1; }
+		size_t rowLength()const
+		{
+			size_t n = 1;
+			for (size_t i = 1; i < m_shape.size(); i++) n *= (size_t)m_shape[i];
+			return n;
+		}
+		size_t count()const { return Header{ "", false, m_shape }.count(); }
+
+	private:
+		std::ofstream m_stream;
+		Shape m_shape;
+		size_t m_headerSize = 0;
+		size_t m_written = 0;
+	};
+
+	// The shape as numpy sees it. A 1d array has a single axis, whatever way it is stored
+	template<typename T>
+	Shape shapeOf(const ndArray<T>& arr)
+	{
+		if (arr.shape().empty())
+			return Shape{ 0 };
+		if (arr.nDims() == 1)
+			return Shape{ (int)arr.size() };
+		return arr.shape();
+	}
+
+	template<typename T>
+	void save(std::string_view path, const ndArray<T>& arr)
+	{
+		Writer<T> writer(path, shapeOf(arr));
+		writer.write(arr);
+		writer.close();
+	}
+
+
+	//--------------------------
+	// Loading
+	// -------------------------
+
+	template<typename T>
+	ndArray<T> load(std::string_view path)
+	{
+		std::ifstream stream(std::string(path), std::ios::binary);
+		if (!stream.is_open())
+			throw std::runtime_error(std::format("Could not open file: {}", path));
+
+		const Header header = readHeader(stream);
+		const size_t n = header.count();
+		Memory::Buffer<T> elements(n);
+
+		if (header.holds<T>()) {
+			stream.read(reinterpret_cast<char*>(elements.data()), (std::streamsize)(n * sizeof(T)));
+		}
+		else {
+			// Converted a block at a time
+			const size_t itemSize = header.itemSize();
+			const size_t blockLength = std::max<size_t>(1, (1 << 20) / itemSize);
+			std::vector<char> block(blockLength * itemSize);
+			for (size_t i = 0; i < n; i += blockLength) {
+				const size_t length = std::min(blockLength, n - i);
+				stream.read(block.data(), (std::streamsize)(length * itemSize));
+				convert(header, block.data(), elements.data() + i, length);
+			}
+		}
+		if (!stream)
+			throw std::runtime_error(std::format("The .npy file is shorter than its header says: {}", path));
+
+		return Detail::arrange(header, std::move(elements));
+	}
+
+
+	//--------------------------
+	// Memory mapping
+	// -------------------------
+
+	// The elements of an .npy file, or of an entry of an .npz file, read in place
+	template<typename T>
+	class Mapped
+	{
+	public:
+		Mapped(std::shared_ptr<const Memory::MappedFile> file, const char* npy, size_t size)
+			: m_file{ std::move(file) }
+		{
+			const Header header = parseHeader(npy, size);
+			if (!header.holds<T>())
+				throw std::runtime_error(std::format("The .npy type '{}' cannot be mapped as '{}', load it instead", header.descr, descrOf<T>()));
+			if (header.dataOffset + header.count() * sizeof(T) > size)
+				throw std::runtime_error("The .npy data is shorter than its header says");
+			if (reinterpret_cast<uintptr_t>(npy + header.dataOffset) % alignof(T) != 0)
+				throw std::runtime_error("The .npy data is not aligned for mapping, load it instead");
+
+			m_data = reinterpret_cast<const T*>(npy + header.dataOffset);
+			m_shape = header.shape.empty() ? Shape{ 1 } : header.shape;
+
+			// Column major data is viewed through reversed strides
+			const int rank = (int)m_shape.size();
+			m_strides = Shape((size_t)rank, 1);
+			for (int i = rank - 2; i >= 0; i--) {
+				m_strides[i] = m_strides[i + 1] * m_shape[i + 1];
+			}
+			if (header.fortranOrder) {
+				m_strides[0] = 1;
+				for (int i = 1; i < rank; i++) {
+					m_strides[i] = m_strides[i - 1] * m_shape[i - 1];
+				}
+			}
+		}
+
+		ndView<const T> view()const { return ndView<const T>(m_data, m_shape, m_strides); }
+		const T* data()const { return m_data; }
+		const Shape& shape()const { return m_shape; }
+		size_t size()const
+		{
+			size_t n = 1;
+			for (int dim : m_shape) n *= (size_t)dim;
+			return n;
+		}
+
+		// A copy in memory, in row major order
+		ndArray<T> toArray()const { return this->view().eval(); }
+
+	private:
+		std::shared_ptr<const Memory::MappedFile> m_file;
+		const T* m_data = nullptr;
+		Shape m_shape;
+		Shape m_strides;
+	};
+
+	template<typename T>
+	Mapped<T> map(std::string_view path)
+	{
+		auto file = std::make_shared<const Memory::MappedFile>(path);
+		return Mapped<T>(file, file->data(), file->size());
+	}
+
+
+	//--------------------------
+	// .npz archives
+	// -------------------------
+
+	namespace Detail
+	{
+		// CRC-32 of zip, eight bytes at a time
+		inline uint32_t crc32(const char* data, size_t n, uint32_t crc = 0)
+		{
+			static const auto tables = [] {
+				std::array<std::array<uint32_t, 256>, 8> t{};
+				for (uint32_t i = 0; i < 256; i++) {
+					uint32_t c = i;
+					for (int k = 0; k < 8; k++) {
+						c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+					}
+					t[0][i] = c;
+				}
+				for (uint32_t i = 0; i < 256; i++) {
+					for (int k = 1; k < 8; k++) {
+						t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+					}
+				}
+				return t;
+			}();
+
+			const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+			crc = ~crc;
+			for (; n >= 8; n -= 8, p += 8) {
+				const uint32_t lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+				crc = tables[7][lo & 0xff] ^ tables[6][(lo >> 8) & 0xff] ^ tables[5][(lo >> 16) & 0xff] ^ tables[4][lo >> 24]
+					^ tables[3][p[4]] ^ tables[2][p[5]] ^ tables[1][p[6]] ^ tables[0][p[7]];
+			}
+			for (; n > 0; n--, p++) {
+				crc = tables[0][(crc ^ *p) & 0xff] ^ (crc >> 8);
+			}
+			return ~crc;
+		}
+
+		template<typename U>
+		U readLittle(const char* p)
+		{
+			U value = 0;
+			for (size_t i = sizeof(U); i-- > 0;) {
+				value = (U)((value << 8) | (unsigned char)p[i]);
+			}
+			return value;
+		}
+
+		template<typename U>
+		void appendLittle(std::string& out, U value)
+		{
+			for (size_t i = 0; i < sizeof(U); i++) {
+				out += (char)((uint64_t)value >> (8 * i) & 0xff);
+			}
+		}
+
+		constexpr uint32_t localSignature = 0x04034b50;
+		constexpr uint32_t centralSignature = 0x02014b50;
+		constexpr uint32_t endSignature = 0x06054b50;
+		constexpr uint32_t end64Signature = 0x06064b50;
+		constexpr uint32_t end64LocatorSignature = 0x07064b50;
+		constexpr uint16_t zip64Tag = 0x0001;
+		constexpr uint16_t paddingTag = 0xd935;
+		constexpr uint32_t overflow = 0xffffffff;
+	}
+
+	/*
+		Reads the arrays of an .npz file. The archive is mapped into memory once, loading an entry converts it into an ndArray,
+		and mapping an entry views it in place, which works for the entries that are stored without compression.
+	*/
+	class Archive
+	{
+	public:
+		struct Entry
+		{
+			std::string name;
+			uint64_t localOffset;
+			uint64_t size;
+			uint16_t method;
+		};
+
+		explicit Archive(std::string_view path)
+			: m_file{ std::make_shared<const Memory::MappedFile>(path) }
+		{
+			using namespace Detail;
+			const char* data = m_file->data();
+			const size_t size = m_file->size();
+
+			// The end of central directory record is at the end, before a comment of at most 64 kB
+			size_t end = std::string::npos;
+			for (size_t i = size >= 22 ? size - 22 : 0; size >= 22; i--) {
+				if (readLittle<uint32_t>(data + i) == endSignature) {
+					end = i;
+					break;
+				}
+				if (i == 0 || size - i > 22 + 0xffff)
+					break;
+			}
+			if (end == std::string::npos)
+				throw std::runtime_error(std::format("Not an .npz file: {}", path));
+
+			uint64_t nEntries = readLittle<uint16_t>(data + end + 10);
+			uint64_t directory = readLittle<uint32_t>(data + end + 16);
+			if (end >= 20 && readLittle<uint32_t>(data + end - 20) == end64LocatorSignature) {
+				const uint64_t end64 = readLittle<uint64_t>(data + end - 20 + 8);
+				nEntries = readLittle<uint64_t>(data + end64 + 32);
+				directory = readLittle<uint64_t>(data + end64 + 48);
+			}
+
+			const char* p = data + directory;
+			for (uint64_t k = 0; k < nEntries; k++) {
+				if (readLittle<uint32_t>(p) != centralSignature)
+					throw std::runtime_error("Corrupt .npz central directory");
+				Entry entry;
+				entry.method = readLittle<uint16_t>(p + 10);
+				uint64_t compressed = readLittle<uint32_t>(p + 20);
+				entry.size = readLittle<uint32_t>(p + 24);
+				const uint16_t nameLength = readLittle<uint16_t>(p + 28);
+				const uint16_t extraLength = readLittle<uint16_t>(p + 30);
+				const uint16_t commentLength = readLittle<uint16_t>(p + 32);
+				entry.localOffset = readLittle<uint32_t>(p + 42);
+				entry.name = std::string(p + 46, nameLength);
+
+				// Sizes and offsets that do not fit in 32 bits are in the zip64 extra field, in this order
+				for (const char* extra = p + 46 + nameLength; extra < p + 46 + nameLength + extraLength;) {
+					const uint16_t tag = readLittle<uint16_t>(extra);
+					const uint16_t length = readLittle<uint16_t>(extra + 2);
+					if (tag == zip64Tag) {
+						const char* field = extra + 4;
+						if (entry.size == overflow) { entry.size = readLittle<uint64_t>(field); field += 8; }
+						if (compressed == overflow) { compressed = readLittle<uint64_t>(field); field += 8; }
+						if (entry.localOffset == overflow) { entry.localOffset = readLittle<uint64_t>(field); }
+					}
+					extra += 4 + length;
+				}
+				m_entries.push_back(entry);
+				p += 46 + nameLength + extraLength + commentLength;
+			}
+		}
+
+		const std::vector<Entry>& entries()const { return m_entries; }
+
+		// The names of the arrays, as given to numpy.savez
+		std::vector<std::string> names()const
+		{
+			std::vector<std::string> out;
+			for (const Entry& entry : m_entries) {
+				out.push_back(entry.name.ends_with(".npy") ? entry.name.substr(0, entry.name.size() - 4) : entry.name);
+			}
+			return out;
+		}
+		bool contains(std::string_view name)const
+		{
+			return this->find(name) != nullptr;
+		}
+
+		template<typename T>
+		ndArray<T> load(std::string_view name)const
+		{
+			auto [npy, size] = this->npyOf(name);
+			const Header header = parseHeader(npy, size);
+			if (header.dataOffset + header.count() * header.itemSize() > size)
+				throw std::runtime_error("The .npy data is shorter than its header says");
+			Memory::Buffer<T> elements(header.count());
+			convert(header, npy + header.dataOffset, elements.data(), elements.size());
+			return Detail::arrange(header, std::move(elements));
+		}
+
+		template<typename T>
+		Mapped<T> map(std::string_view name)const
+		{
+			auto [npy, size] = this->npyOf(name);
+			return Mapped<T>(m_file, npy, size);
+		}
+
+	private:
+		const Entry* find(std::string_view name)const
+		{
+			for (const Entry& entry : m_entries) {
+				if (entry.name == name || (entry.name.size() == name.size() + 4 && entry.name.starts_with(name) && entry.name.ends_with(".npy")))
+					return &entry;
+			}
+			return nullptr;
+		}
+
+		// The .npy file of the entry, inside the mapped archive
+		std::pair<const char*, size_t> npyOf(std::string_view name)const
+		{
+			const Entry* entry = this->find(name);
+			if (entry == nullptr)
+				throw std::invalid_argument(std::format("No array named '{}' in the .npz file", name));
+			if (entry->method != 0)
+				throw std::runtime_error(std::format("The .npz entry '{}' is compressed, which is not supported", name));
+
+			const char* local = m_file->data() + entry->localOffset;
+			if (Detail::readLittle<uint32_t>(local) != Detail::localSignature)
+				throw std::runtime_error("Corrupt .npz entry");
+			const size_t start = 30 + Detail::readLittle<uint16_t>(local + 26) + Detail::readLittle<uint16_t>(local + 28);
+			if (entry->localOffset + start + entry->size > m_file->size())
+				throw std::runtime_error("Truncated .npz entry");
+			return { local + start, (size_t)entry->size };
+		}
+
+	private:
+		std::shared_ptr<const Memory::MappedFile> m_file;
+		std::vector<Entry> m_entries;
+	};
+
+	/*
+		Writes an .npz file that numpy.load reads, one array at a time. The entries are stored without compression, and padded
+		so that the elements of every entry start at a multiple of 64 bytes in the file, which lets Archive::map view them.
+	*/
+	class ArchiveWriter
+	{
+	public:
+		explicit ArchiveWriter(std::string_view path)
+			: m_stream(std::string(path), std::ios::binary | std::ios::trunc)
+		{
+			if (!m_stream.is_open())
+				throw std::runtime_error(std::format("Could not open file: {}", path));
+		}
+		ArchiveWriter(const ArchiveWriter&) = delete;
+		ArchiveWriter& operator=(const ArchiveWriter&) = delete;
+		~ArchiveWriter()
+		{
+			if (!m_closed) {
+				try { this->close(); }
+				catch (...) {}
+			}
+		}
+
+		template<typename T>
+		ArchiveWriter& add(std::string_view name, const ndArray<T>& arr)
+		{
+			using namespace Detail;
+			const std::string fileName = std::string(name) + ".npy";
+			const std::string header = encodeHeader(descrOf<T>(), shapeOf(arr));
+			const char* elements = reinterpret_cast<const char*>(arr.data());
+			const uint64_t size = header.size() + arr.size() * sizeof(T);
+			const uint32_t crc = crc32(elements, arr.size() * sizeof(T), crc32(header.data(), header.size()));
+			const bool large = size >= overflow;
+
+			std::string local;
+			appendLittle<uint32_t>(local, localSignature);
+			appendLittle<uint16_t>(local, large ? 45 : 20);
+			appendLittle<uint16_t>(local, 0);
+			appendLittle<uint16_t>(local, 0);
+			appendLittle<uint16_t>(local, 0);
+			appendLittle<uint16_t>(local, 0x21);
+			appendLittle<uint32_t>(local, crc);
+			appendLittle<uint32_t>(local, large ? overflow : (uint32_t)size);
+			appendLittle<uint32_t>(local, large ? overflow : (uint32_t)size);
+			appendLittle<uint16_t>(local, (uint16_t)fileName.size());
+			const size_t extraAt = local.size();
+			appendLittle<uint16_t>(local, 0);
+			local += fileName;
+
+			std::string extra;
+			if (large) {
+				appendLittle<uint16_t>(extra, zip64Tag);
+				appendLittle<uint16_t>(extra, 16);
+				appendLittle<uint64_t>(extra, size);
+				appendLittle<uint64_t>(extra, size);
+			}
+			// Padding, so the elements after the 64 byte multiple .npy header are aligned
+			const size_t unpadded = m_offset + local.size() + extra.size() + 4;
+			const size_t padding = (alignment - unpadded % alignment) % alignment;
+			appendLittle<uint16_t>(extra, paddingTag);
+			appendLittle<uint16_t>(extra, (uint16_t)padding);
+			extra.append(padding, '\0');
+			local[extraAt] = (char)(extra.size() & 0xff);
+			local[extraAt + 1] = (char)(extra.size() >> 8);
+			local += extra;
+
+			m_entries.push_back({ fileName, m_offset, size, crc });
+			m_stream.write(local.data(), (std::streamsize)local.size());
+			m_stream.write(header.data(), (std::streamsize)header.size());
+			m_stream.write(elements, (std::streamsize)(arr.size() * sizeof(T)));
+			m_offset += local.size() + size;
+			return *this;
+		}
+
+		// Writes the central directory, after which the file is complete
+		void close()
+		{
+			using namespace Detail;
+			m_closed = true;
+			std::string directory;
+			for (const Written& entry : m_entries) {
+				const bool large = entry.size >= overflow || entry.offset >= overflow;
+				std::string extra;
+				if (large) {
+					appendLittle<uint16_t>(extra, zip64Tag);
+					appendLittle<uint16_t>(extra, 24);
+					appendLittle<uint64_t>(extra, entry.size);
+					appendLittle<uint64_t>(extra, entry.size);
+					appendLittle<uint64_t>(extra, entry.offset);
+				}
+				appendLittle<uint32_t>(directory, centralSignature);
+				appendLittle<uint16_t>(directory, 45);
+				appendLittle<uint16_t>(directory, large ? 45 : 20);
+				appendLittle<uint16_t>(directory, 0);
+				appendLittle<uint16_t>(directory, 0);
+				appendLittle<uint16_t>(directory, 0);
+				appendLittle<uint16_t>(directory, 0x21);
+				appendLittle<uint32_t>(directory, entry.crc);
+				appendLittle<uint32_t>(directory, large ? overflow : (uint32_t)entry.size);
+				appendLittle<uint32_t>(directory, large ? overflow : (uint32_t)entry.size);
+				appendLittle<uint16_t>(directory, (uint16_t)entry.name.size());
+				appendLittle<uint16_t>(directory, (uint16_t)extra.size());
+				appendLittle<uint16_t>(directory, 0);
+				appendLittle<uint16_t>(directory, 0);
+				appendLittle<uint16_t>(directory, 0);
+				appendLittle<uint32_t>(directory, 0);
+				appendLittle<uint32_t>(directory, large ? overflow : (uint32_t)entry.offset);
+				directory += entry.name;
+				directory += extra;
+			}
+
+			const uint64_t directoryOffset = m_offset;
+			const uint64_t nEntries = m_entries.size();
+			const bool large = directoryOffset >= overflow || nEntries >= 0xffff;
+			if (large) {
+				const uint64_t end64 = directoryOffset + directory.size();
+				appendLittle<uint32_t>(directory, end64Signature);
+				appendLittle<uint64_t>(directory, 44);
+				appendLittle<uint16_t>(directory, 45);
+				appendLittle<uint16_t>(directory, 45);
+				appendLittle<uint32_t>(directory, 0);
+				appendLittle<uint32_t>(directory, 0);
+				appendLittle<uint64_t>(directory, nEntries);
+				appendLittle<uint64_t>(directory, nEntries);
+				appendLittle<uint64_t>(directory, end64 - directoryOffset);
+				appendLittle<uint64_t>(directory, directoryOffset);
+				appendLittle<uint32_t>(directory, end64LocatorSignature);
+				appendLittle<uint32_t>(directory, 0);
+				appendLittle<uint64_t>(directory, end64);
+				appendLittle<uint32_t>(directory, 1);
+			}
+			const uint64_t directorySize = directory.size() - (large ? 76 : 0);
+			appendLittle<uint32_t>(directory, endSignature);
+			appendLittle<uint16_t>(directory, 0);
+			appendLittle<uint16_t>(directory, 0);
+			appendLittle<uint16_t>(directory, large ? 0xffff : (uint16_t)nEntries);
+			appendLittle<uint16_t>(directory, large ? 0xffff : (uint16_t)nEntries);
+			appendLittle<uint32_t>(directory, large ? overflow : (uint32_t)directorySize);
+			appendLittle<uint32_t>(directory, large ? overflow : (uint32_t)directoryOffset);
+			appendLittle<uint16_t>(directory, 0);
+
+			m_stream.write(directory.data(), (std::streamsize)directory.size());
+			m_stream.close();
+			if (m_stream.fail())
+				throw std::runtime_error("Could not write the .npz file");
+		}
+
+	private:
+		struct Written
+		{
+			std::string name;
+			uint64_t offset;
+			uint64_t size;
+			uint32_t crc;
+		};
+
+		std::ofstream m_stream;
+		std::vector<Written> m_entries;
+		uint64_t m_offset = 0;
+		bool m_closed = false;
+	};
+}
+}
@@ -0,0 +1,287 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <exception>
+#include <algorithm>
+#include <assert.h>
+
+namespace Cnum
+{
+	/*
+		What is the execution policy?
+			Large arrays are split into chunks which are processed by a pool of worker threads, together with the calling thread.
+			Each operation that supports it takes an Execution argument, which defaults to the global default set with
+			Parallel::setDefaultExecution(). Arrays smaller than Parallel::minParallelSize() are always processed serially.
+
+		Are the results reproducible?
+			Yes. The chunks are of a fixed size which only depends on the number of elements, never on the number of threads,
+			and partial results are combined in chunk order. Hence a parallel reduction always gives the same result,
+			although it may round differently from the serial one, as it sums in another order.
+	*/
+	enum class Execution
+	{
+		Serial,
+		Parallel
+	};
+
+
+	class ThreadPool
+	{
+	public:
+
+		//--------------------------
+		// Constructors
+		// -------------------------
+
+		// The calling thread takes part in the work, so nThreads - 1 workers are started
+		explicit ThreadPool(unsigned nThreads = std::max(1u, std::thread::hardware_concurrency()))
+		{
+			for (unsigned i = 1; i < nThreads; i++) {
+				m_workers.emplace_back([this]() { this->work(); });
+			}
+		}
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_stop = true;
+			}
+			m_wake.notify_all();
+			for (auto& worker : m_workers) {
+				worker.join();
+			}
+		}
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		static ThreadPool& global()
+		{
+			static ThreadPool pool;
+			return pool;
+		}
+
+		//--------------------------
+		// Public Interface
+		// -------------------------
+
+		// Calls task(i) for every i in [0, nTasks) and returns when all have finished. The first exception thrown by a task is rethrown
+		void run(size_t nTasks, const std::function<void(size_t)>& task)
+		{
+			// Tasks started from within a task run serially, since the workers may all be busy waiting for them
+			if (nTasks <= 1 || m_workers.empty() || insideTask()) {
+				for (size_t i = 0; i < nTasks; i++) {
+					task(i);
+				}
+				return;
+			}
+
+			std::lock_guard<std::mutex> runLock(m_runMutex);
+			auto job = std::make_shared<Job>(task, nTasks);
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_job = job;
+			}
+			m_wake.notify_all();
+
+			this->process(*job);
+
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_done.wait(lock, [&]() { return job->finished == job->nTasks; });
+			m_job.reset();
+			if (job->error) {
+				std::rethrow_exception(job->error);
+			}
+		}
+
+		size_t nThreads()const { return m_workers.size() + 1; }
+
+	private:
+
+		struct Job
+		{
+			Job(const std::function<void(size_t)>& task, size_t nTasks)
+				: task{ task }, nTasks{ nTasks }
+			{}
+
+			const std::function<void(size_t)>& task;
+			const size_t nTasks;
+			std::atomic<size_t> next = 0;
+			size_t finished = 0;
+			std::exception_ptr error;
+		};
+
+		static bool& insideTask()
+		{
+			static thread_local bool inside = false;
+			return inside;
+		}
+
+		void work()
+		{
+			std::shared_ptr<Job> last;
+			while (true) {
+				std::shared_ptr<Job> job;
+				{
+					std::unique_lock<std::mutex> lock(m_mutex);
+					m_wake.wait(lock, [&]() { return m_stop || (m_job && m_job != last); });
+					if (m_stop)
+						return;
+					job = m_job;
+				}
+				this->process(*job);
+				last = std::move(job);
+			}
+		}
+
+		void process(Job& job)
+		{
+			insideTask() = true;
+			size_t i;
+			while ((i = job.next++) < job.nTasks) {
+				std::exception_ptr error;
+				try {
+					job.task(i);
+				}
+				catch (...) {
+					error = std::current_exception();
+				}
+
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (error && !job.error) {
+					job.error = error;
+				}
+				if (++job.finished == job.nTasks) {
+					m_done.notify_all();
+				}
+			}
+			insideTask() = false;
+		}
+
+	private:
+
+		//--------------------------
+		// Member variables
+		// -------------------------
+
+		std::vector<std::thread> m_workers;
+		std::mutex m_mutex;
+		std::mutex m_runMutex;
+		std::condition_variable m_wake;
+		std::condition_variable m_done;
+		std::shared_ptr<Job> m_job;
+		bool m_stop = false;
+	};
+
+
+namespace Parallel
+{
+	// Number of elements per chunk
+	constexpr size_t grainSize = 1 << 15;
+
+	inline Execution& defaultExecutionRef()
+	{
+		static Execution execution = Execution::Parallel;
+		return execution;
+	}
+	inline size_t& minParallelSizeRef()
+	{
+		static size_t minSize = 1 << 17;
+		return minSize;
+	}
+
+	inline Execution defaultExecution() { return defaultExecutionRef(); }
+	inline void setDefaultExecution(Execution execution) { defaultExecutionRef() = execution; }
+
+	inline size_t minParallelSize() { return minParallelSizeRef(); }
+	inline void setMinParallelSize(size_t minSize) { minParallelSizeRef() = minSize; }
+
+	inline bool isParallel(size_t nElements, Execution execution)
+	{
+		return execution == Execution::Parallel && nElements >= minParallelSize() && nElements > grainSize;
+	}
+
+	// Number of items per chunk, when each item holds elementsPerItem elements
+	inline size_t chunkLength(size_t elementsPerItem)
+	{
+		return std::max<size_t>(1, grainSize / std::max<size_t>(1, elementsPerItem));
+	}
+
+	/*
+		Calls fn(begin, end) for consecutive chunks of the items [0, n), in parallel if the policy and the size allow it.
+		Items may be single elements, or e.g. whole lanes of elementsPerItem elements each.
+	*/
+	template<typename Function>
+	void forChunks(size_t n, Execution execution, Function fn, size_t elementsPerItem = 1)
+	{
+		if (!isParallel(n * elementsPerItem, execution)) {
+			if (n > 0) {
+				fn((size_t)0, n);
+			}
+			return;
+		}
+
+		const size_t length = chunkLength(elementsPerItem);
+		const size_t nChunks = (n + length - 1) / length;
+		ThreadPool::global().run(nChunks, [&](size_t chunk) {
+			size_t begin = chunk * length;
+			fn(begin, std::min(n, begin + length));
+		});
+	}
+
+	// The results of fn(begin, end) for all chunks, in chunk order
+	template<typename R, typename Function>
+	std::vector<R> mapChunks(size_t n, Execution execution, Function fn)
+	{
+		if (!isParallel(n, execution)) {
+			return (n > 0) ? std::vector<R>{ fn((size_t)0, n) } : std::vector<R>{};
+		}
+
+		const size_t nChunks = (n + grainSize - 1) / grainSize;
+		std::vector<R> results(nChunks);
+		ThreadPool::global().run(nChunks, [&](size_t chunk) {
+			size_t begin = chunk * grainSize;
+			results[chunk] = fn(begin, std::min(n, begin + grainSize));
+		});
+		return results;
+	}
+
+	// Sorts the chunks in parallel, and then merges neighbouring runs pairwise until one sorted run remains
+	template<typename T, typename Compare = std::less<>>
+	void sort(T* data, size_t n, Execution execution, Compare comp = Compare())
+	{
+		if (!isParallel(n, execution)) {
+			std::sort(data, data + n, comp);
+			return;
+		}
+
+		const size_t nChunks = (n + grainSize - 1) / grainSize;
+		ThreadPool::global().run(nChunks, [&](size_t chunk) {
+			size_t begin = chunk * grainSize;
+			std::sort(data + begin, data + std::min(n, begin + grainSize), comp);
+		});
+
+		std::vector<T> buffer(n);
+		T* from = data;
+		T* to = buffer.data();
+		for (size_t run = grainSize; run < n; run *= 2) {
+			const size_t nPairs = (n + 2 * run - 1) / (2 * run);
+			ThreadPool::global().run(nPairs, [&](size_t pair) {
+				size_t begin = pair * 2 * run;
+				size_t middle = std::min(n, begin + run);
+				size_t end = std::min(n, begin + 2 * run);
+				std::merge(from + begin, from + middle, from + middle, from + end, to + begin, comp);
+			});
+			std::swap(from, to);
+		}
+		if (from != data) {
+			std::copy(from, from + n, data);
+		}
+	}
+}
+
+}
@@ -1,21 +1,25 @@
 #pragma once
-//#include "ndArray.h"
 #include <cmath>
 #include <assert.h>
-
-template<typename T>
-class ndArray;
+#include "FixedArray.h"
 
 namespace Cnum
 {
+	template<typename T>
+	class ndArray;
 
 	template<typename T>
 	class Quaternion
 	{
 
 	public:
+		constexpr Quaternion(T realPart, const Vector3<T>& imaginaryPart)
+			: m_real{ realPart }, m_imag{ imaginaryPart }
+		{
+		}
+
 		Quaternion(const ndArray<T>& arr)
-			: m_real{ arr[0] }, m_imag{ arr.extract(1, -1) }
+			: m_real{ arr.data()[0] }, m_imag{ arr.data()[1], arr.data()[2], arr.data()[3] }
 		{
 			assert(arr.nDims() == 1);
 			assert(arr.size() == 4);
@@ -24,24 +28,42 @@ namespace Cnum
 		Quaternion(T realPart, const ndArray<T>& imaginaryPart)
 			: m_real{ realPart }, m_imag{ imaginaryPart }
 		{
-			assert(m_imag.nDims() == 1);
-			assert(m_imag.size() == 3);
 		}
 
+		// The rotation by theta radians around the axis, which does not have to be normalized
+		static Quaternion fromAxisAngle(const Vector3<T>& axisOfRotation, T theta)
+		{
+			return Quaternion((T)std::cos(theta / 2), axisOfRotation.normalized() * (T)std::sin(theta / 2));
+		}
 
-		Quaternion<T> operator*(const ndArray<T>& rhs) {
-			assert(rhs.size() == 3);
-			assert(rhs.nDims() == 1);
+		constexpr Quaternion<T> operator*(const Vector3<T>& rhs)const {
 			return *this * Quaternion<T>(0, rhs);
 		}
-		Quaternion<T> operator*(const Quaternion<T>& rhs)
+		Quaternion<T> operator*(const ndArray<T>& rhs)const {
+			return *this * Vector3<T>(rhs);
+		}
+		constexpr Quaternion<T> operator*(const Quaternion<T>& rhs)const
 		{
-			ndArray<T>imag = ndArray<T>();
-			T realPart = m_real * rhs.m_real - m_imag[0] * rhs.m_imag[0] - m_imag[0] * rhs.m_imag[0] - m_imag[0] * rhs.m_imag[0];
-			imag.append(m_real * rhs.m_imag[0] + m_imag[0] * rhs.m_real + m_imag[1] * rhs.m_imag[2] - m_imag[2] * rhs.m_imag[1]);
-			imag.append(m_real * rhs.m_imag[1] - m_imag[0] * rhs.m_imag[2] + m_imag[1] * rhs.m_real + m_imag[2] * rhs.m_imag[0]);
-			imag.append(m_real * rhs.m_imag[2] + m_imag[0] * rhs.m_imag[1] - m_imag[1] * rhs.m_imag[0] + m_imag[2] * rhs.m_real);
-			return Quaternion(realPart, imag);
+			// Hamilton product, (a, u)(b, v) = (ab - u.v, av + bu + u x v)
+			return Quaternion(m_real * rhs.m_real - dot(m_imag, rhs.m_imag),
+				m_real * rhs.m_imag + rhs.m_real * m_imag + cross(m_imag, rhs.m_imag));
+		}
+
+		// Rotates the point by this quaternion, which must be normalized. Same as (q * pos * q.inverse()).to3D()
+		constexpr Vector3<T> rotate(const Vector3<T>& pos)const
+		{
+			const Vector3<T> t = T(2) * cross(m_imag, pos);
+			return pos + m_real * t + cross(m_imag, t);
+		}
+
+		// The rotation matrix of this quaternion, which must be normalized. Rotating many points by it is cheaper than rotate()
+		constexpr Matrix3<T> toMatrix()const
+		{
+			const T w = m_real, x = m_imag[0], y = m_imag[1], z = m_imag[2];
+			return Matrix3<T>(
+				1 - 2 * (y * y + z * z), 2 * (x * y - w * z), 2 * (x * z + w * y),
+				2 * (x * y + w * z), 1 - 2 * (x * x + z * z), 2 * (y * z - w * x),
+				2 * (x * z - w * y), 2 * (y * z + w * x), 1 - 2 * (x * x + y * y));
 		}
 
 		static ndArray<T> Rotate(ndArray<T> pos, ndArray<T>&& axisOfRotation, T theta) {
@@ -51,23 +73,26 @@ namespace Cnum
 			assert(axisOfRotation.nDims() == 1);
 
 			theta /= (180.0f / 3.14159265f);
-			axisOfRotation.normalize();
-			Quaternion q1(std::cos(theta / 2), axisOfRotation * std::sin(theta / 2));
-			Quaternion qRes = q1 * pos * q1.inverse();
-			return qRes.m_imag.normalize();
+			return fromAxisAngle(Vector3<T>(axisOfRotation), theta).rotate(Vector3<T>(pos)).toArray();
+		}
+		constexpr Quaternion conjugate()const {
+			return Quaternion(m_real, -m_imag);
 		}
-		Quaternion inverse() {
-			return Quaternion(m_real, m_imag * -1);
+		constexpr Quaternion inverse()const {
+			const T normSquared = m_real * m_real + dot(m_imag, m_imag);
+			return Quaternion(m_real / normSquared, -m_imag / normSquared);
 		}
-		ndArray<T> to3D() {
-			return m_imag;
+		ndArray<T> to3D()const {
+			return m_imag.toArray();
 		}
 
+		constexpr T real()const { return m_real; }
+		constexpr const Vector3<T>& imag()const { return m_imag; }
+
 	private:
 		T m_real;
-		ndArray<T> m_imag;
+		Vector3<T> m_imag;
 
 	};
 }
 
-
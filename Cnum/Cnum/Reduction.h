@@ -0,0 +1,379 @@
+#pragma once
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <assert.h>
+#include "Simd.h"
+#include "Parallel.h"
+#include "Memory.h"
+#include "Shape.h"
+
+namespace Cnum
+{
+namespace Reduction
+{
+	/*
+		How are axes reduced?
+			The array is walked once, in storage order, and every element is folded into the accumulator of its output.
+			Neighbouring axes which are both reduced, or both kept, are merged first, and axes of length 1 are dropped.
+			What remains alternates between kept and reduced groups, and the last group is contiguous in memory:
+				- If it is reduced, each contiguous row folds into a single output, with SIMD accumulators.
+				- If it is kept, each row folds elementwise into a row of outputs. Short rows are first folded into a wider
+				  buffer, which holds several rows of accumulators, so the SIMD loops run over long enough stretches.
+
+			Example: the column sums of a (10^7, 16) array fold rows of 16 values into 16 outputs, and none of the
+			elements is visited twice.
+
+		A reducer provides
+			rows(in, acc, n)    acc[i] = acc[i] op in[i], for n contiguous elements with n different outputs
+			row(in, n, acc)     acc op in[0] op ... op in[n - 1], for n contiguous elements with the same output
+			combine(a, b)       merges two accumulators
+			init                the starting value of every accumulator
+		Partial results from different threads, or from a wider buffer, are only merged if the reducer is combinable,
+		i.e. init is the identity of an associative op. Otherwise the threads only ever split the outputs between them.
+	*/
+
+	//--------------------------
+	// Reducers
+	// -------------------------
+
+	template<typename T, Simd::Arith op, bool squared = false>
+	struct Fold
+	{
+		static constexpr bool combinable = true;
+
+		static T identity()
+		{
+			if constexpr (op == Simd::Arith::Add)
+				return T(0);
+			else if constexpr (op == Simd::Arith::Multiply)
+				return T(1);
+			else if constexpr (op == Simd::Arith::Min)
+				return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+			else
+				return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest();
+		}
+
+		void rows(const T* in, T* acc, size_t n)const { Simd::fold<op, squared>(in, acc, n); }
+		T row(const T* in, size_t n, T acc)const { return Simd::reduce<op, squared>(in, n, acc); }
+		T combine(T a, T b)const { return Simd::apply<op>(a, b); }
+
+		T init = identity();
+	};
+
+	template<typename T>
+	using Sum = Fold<T, Simd::Arith::Add>;
+
+	template<typename T>
+	using SumOfSquares = Fold<T, Simd::Arith::Add, true>;
+
+	template<typename T>
+	using Product = Fold<T, Simd::Arith::Multiply>;
+
+	template<typename T>
+	using Min = Fold<T, Simd::Arith::Min>;
+
+	template<typename T>
+	using Max = Fold<T, Simd::Arith::Max>;
+
+	// 1 if any, or all, of the elements are non-zero
+	template<typename T, bool all>
+	struct Logical
+	{
+		static constexpr bool combinable = true;
+
+		void rows(const T* in, T* acc, size_t n)const
+		{
+			for (size_t i = 0; i < n; i++) {
+				acc[i] = this->combine(acc[i], in[i]);
+			}
+		}
+		T row(const T* in, size_t n, T acc)const
+		{
+			for (size_t i = 0; i < n && (acc != T(0)) == all; i++) {
+				acc = this->combine(acc, in[i]);
+			}
+			return acc;
+		}
+		T combine(T a, T b)const
+		{
+			return all ? T(a != T(0) && b != T(0)) : T(a != T(0) || b != T(0));
+		}
+
+		T init = T(all);
+	};
+
+	template<typename T>
+	using Any = Logical<T, false>;
+
+	template<typename T>
+	using All = Logical<T, true>;
+
+	// Any binary operation, applied element by element in storage order, starting from init
+	template<typename T, typename Operation>
+	struct Generic
+	{
+		static constexpr bool combinable = false;
+
+		void rows(const T* in, T* acc, size_t n)const
+		{
+			for (size_t i = 0; i < n; i++) {
+				acc[i] = op(acc[i], in[i]);
+			}
+		}
+		T row(const T* in, size_t n, T acc)const
+		{
+			for (size_t i = 0; i < n; i++) {
+				acc = op(acc, in[i]);
+			}
+			return acc;
+		}
+		T combine(T a, T b)const { return op(a, b); }
+
+		T init;
+		Operation op;
+	};
+
+
+	//--------------------------
+	// Layout
+	// -------------------------
+
+	struct Plan
+	{
+		Plan(const Shape& shape, const std::vector<bool>& isReduced)
+		{
+			assert(shape.size() == isReduced.size());
+
+			for (size_t i = 0; i < shape.size(); i++) {
+				size *= (size_t)shape[i];
+				if (!isReduced[i])
+					outSize *= (size_t)shape[i];
+				if (shape[i] == 1)
+					continue;
+				if (!dims.empty() && reduced.back() == isReduced[i])
+					dims.back() *= (size_t)shape[i];
+				else {
+					dims.push_back((size_t)shape[i]);
+					reduced.push_back(isReduced[i]);
+				}
+			}
+			if (dims.empty()) {
+				dims.push_back(1);
+				reduced.push_back(false);
+			}
+
+			const size_t nGroups = dims.size();
+			srcStrides.assign(nGroups, 1);
+			outStrides.assign(nGroups, 0);
+			size_t outStride = 1;
+			for (size_t g = nGroups; g-- > 0;) {
+				if (g + 1 < nGroups)
+					srcStrides[g] = srcStrides[g + 1] * dims[g + 1];
+				if (!reduced[g]) {
+					outStrides[g] = outStride;
+					outStride *= dims[g];
+				}
+			}
+
+			// A kept last group is folded together with the reduced group in front of it
+			last = nGroups - 1;
+			kernelGroup = (!reduced[last] && last > 0) ? last - 1 : last;
+		}
+
+		std::vector<size_t> dims;
+		std::vector<bool> reduced;
+		std::vector<size_t> srcStrides;
+		std::vector<size_t> outStrides;
+		size_t last = 0;
+		size_t kernelGroup = 0;
+		size_t size = 1;
+		size_t outSize = 1;
+	};
+
+	// Rows of at most this many elements are folded through a wider buffer of accumulators
+	constexpr size_t wideLength = 256;
+
+	// The fewest columns a thread is given, when the threads split the outputs by column
+	constexpr size_t minColumns = 1024;
+
+	// Folds nRows rows of width elements, rowStride apart, into the same width outputs
+	template<typename T, typename Reducer>
+	void foldRows(const T* src, size_t nRows, size_t rowStride, size_t width, T* out, const Reducer& reducer)
+	{
+		if constexpr (Reducer::combinable) {
+			if (width < wideLength && rowStride == width && nRows > 1) {
+				const size_t rowsPerBlock = std::min(nRows, wideLength / width);
+				const size_t length = rowsPerBlock * width;
+				static thread_local std::vector<T> wide;
+				wide.assign(length, reducer.init);
+
+				size_t r = 0;
+				for (; r + rowsPerBlock <= nRows; r += rowsPerBlock) {
+					reducer.rows(src + r * width, wide.data(), length);
+				}
+				reducer.rows(src + r * width, wide.data(), (nRows - r) * width);
+
+				for (size_t k = 0; k < rowsPerBlock; k++) {
+					for (size_t j = 0; j < width; j++) {
+						out[j] = reducer.combine(out[j], wide[k * width + j]);
+					}
+				}
+				return;
+			}
+		}
+		for (size_t r = 0; r < nRows; r++) {
+			reducer.rows(src + r * rowStride, out, width);
+		}
+	}
+
+	// Folds the items [begin, end) of group g, and all groups after it, restricted to the columns [c0, c1) of a kept last group
+	template<typename T, typename Reducer>
+	void walk(const Plan& plan, size_t g, const T* src, T* out, size_t begin, size_t end, size_t c0, size_t c1, const Reducer& reducer)
+	{
+		if (g < plan.kernelGroup) {
+			for (size_t i = begin; i < end; i++) {
+				walk(plan, g + 1, src + i * plan.srcStrides[g], out + i * plan.outStrides[g], 0, plan.dims[g + 1], c0, c1, reducer);
+			}
+		}
+		else if (plan.reduced[plan.last]) {
+			*out = reducer.row(src + begin, end - begin, *out);
+		}
+		else if (g == plan.last) {
+			reducer.rows(src + begin, out + begin, end - begin);
+		}
+		else {
+			const size_t width = plan.dims[plan.last];
+			foldRows(src + begin * width + c0, end - begin, width, c1 - c0, out + c0, reducer);
+		}
+	}
+
+
+	//--------------------------
+	// Interface
+	// -------------------------
+
+	/*
+		Reduces the axes of data, with the given shape, for which isReduced is set.
+		Returns the outputs in row major order of the kept axes.
+	*/
+	template<typename T, typename Reducer>
+	Memory::Buffer<T> reduce(const T* data, const Shape& shape, const std::vector<bool>& isReduced, const Reducer& reducer,
+		Execution execution = Parallel::defaultExecution())
+	{
+		const Plan plan(shape, isReduced);
+		Memory::Buffer<T> out(plan.outSize, reducer.init);
+		if (plan.size == 0)
+			return out;
+
+		const size_t columns = plan.reduced[plan.last] ? 1 : plan.dims[plan.last];
+		const size_t n0 = plan.dims[0];
+
+		if (!Parallel::isParallel(plan.size, execution)) {
+			walk(plan, 0, data, out.data(), 0, n0, 0, columns, reducer);
+		}
+		else if (!plan.reduced[0]) {
+			// Every output belongs to a single item of the first group
+			Parallel::forChunks(n0, execution, [&](size_t begin, size_t end) {
+				walk(plan, 0, data, out.data(), begin, end, 0, columns, reducer);
+			}, plan.size / n0);
+		}
+		else if (Reducer::combinable && plan.outSize <= Parallel::grainSize) {
+			// Each chunk of the first group folds into its own outputs, which are merged in chunk order
+			const size_t length = Parallel::chunkLength(plan.size / n0);
+			const size_t nChunks = (n0 + length - 1) / length;
+			std::vector<std::vector<T>> partials(nChunks);
+			ThreadPool::global().run(nChunks, [&](size_t chunk) {
+				partials[chunk].assign(plan.outSize, reducer.init);
+				const size_t begin = chunk * length;
+				walk(plan, 0, data, partials[chunk].data(), begin, std::min(n0, begin + length), 0, columns, reducer);
+			});
+			for (const std::vector<T>& partial : partials) {
+				for (size_t i = 0; i < plan.outSize; i++) {
+					out[i] = reducer.combine(out[i], partial[i]);
+				}
+			}
+		}
+		else if (columns >= 2 * minColumns) {
+			// The columns of the last group have separate outputs. Every chunk walks all rows, so the chunks are kept wide
+			const size_t nChunks = std::min<size_t>(ThreadPool::global().nThreads(), columns / minColumns);
+			ThreadPool::global().run(nChunks, [&](size_t chunk) {
+				walk(plan, 0, data, out.data(), 0, n0, columns * chunk / nChunks, columns * (chunk + 1) / nChunks, reducer);
+			});
+		}
+		else {
+			walk(plan, 0, data, out.data(), 0, n0, 0, columns, reducer);
+		}
+		return out;
+	}
+
+	/*
+		The index along the axis of the first element for which better(element, best) holds against all others, for every lane
+		along the axis. The lanes are compared row by row in storage order.
+	*/
+	template<typename T, typename Better>
+	Memory::Buffer<int> argBest(const T* data, const Shape& shape, int axis, Better better,
+		Execution execution = Parallel::defaultExecution())
+	{
+		assert(axis >= 0 && axis < (int)shape.size());
+
+		size_t outer = 1, inner = 1;
+		const size_t length = (size_t)shape[axis];
+		for (int i = 0; i < (int)shape.size(); i++) {
+			if (i < axis) outer *= (size_t)shape[i];
+			if (i > axis) inner *= (size_t)shape[i];
+		}
+		assert(length > 0);
+
+		Memory::Buffer<int> indices(outer * inner, 0);
+		if (indices.empty())
+			return indices;
+
+		// Scans the rows [begin, end) of one lane block, starting from row begin
+		auto scan = [&](const T* block, size_t begin, size_t end, T* best, int* index) {
+			std::copy(block + begin * inner, block + (begin + 1) * inner, best);
+			std::fill(index, index + inner, (int)begin);
+			for (size_t r = begin + 1; r < end; r++) {
+				const T* row = block + r * inner;
+				for (size_t k = 0; k < inner; k++) {
+					if (better(row[k], best[k])) {
+						best[k] = row[k];
+						index[k] = (int)r;
+					}
+				}
+			}
+		};
+
+		if (outer > 1 || !Parallel::isParallel(length * inner, execution)) {
+			Parallel::forChunks(outer, execution, [&](size_t begin, size_t end) {
+				std::vector<T> best(inner);
+				for (size_t o = begin; o < end; o++) {
+					scan(data + o * length * inner, 0, length, best.data(), indices.data() + o * inner);
+				}
+			}, length * inner);
+			return indices;
+		}
+
+		// A single lane block, whose rows are split between the chunks. Ties go to the earlier chunk
+		const size_t rowsPerChunk = Parallel::chunkLength(inner);
+		const size_t nChunks = (length + rowsPerChunk - 1) / rowsPerChunk;
+		std::vector<std::vector<T>> bests(nChunks, std::vector<T>(inner));
+		std::vector<std::vector<int>> partials(nChunks, std::vector<int>(inner));
+		ThreadPool::global().run(nChunks, [&](size_t chunk) {
+			const size_t begin = chunk * rowsPerChunk;
+			scan(data, begin, std::min(length, begin + rowsPerChunk), bests[chunk].data(), partials[chunk].data());
+		});
+		std::vector<T> best = bests[0];
+		indices.assign(partials[0].begin(), partials[0].end());
+		for (size_t chunk = 1; chunk < nChunks; chunk++) {
+			for (size_t k = 0; k < inner; k++) {
+				if (better(bests[chunk][k], best[k])) {
+					best[k] = bests[chunk][k];
+					indices[k] = partials[chunk][k];
+				}
+			}
+		}
+		return indices;
+	}
+}
+}
@@ -0,0 +1,193 @@
+#pragma once
+#include <vector>
+#include <array>
+#include <iterator>
+#include <algorithm>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <assert.h>
+
+namespace Cnum
+{
+	/*
+		What is a Shape?
+			The lengths of the axes of an array, or its strides, or an index into it. It behaves like a std::vector<int>,
+			but holds up to maxRank values inline, so creating, copying or moving an array never allocates for its shape.
+
+			It converts to and from std::vector<int> where a vector is needed, and compares equal to a vector with the same values.
+			Growing a shape past maxRank values throws std::length_error.
+	*/
+	class Shape
+	{
+	public:
+		static constexpr int maxRank = 8;
+
+		using value_type = int;
+		using size_type = size_t;
+		using difference_type = std::ptrdiff_t;
+		using reference = int&;
+		using const_reference = const int&;
+		using iterator = int*;
+		using const_iterator = const int*;
+		using reverse_iterator = std::reverse_iterator<iterator>;
+		using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+		//--------------------------
+		// Constructors
+		// -------------------------
+
+		Shape() = default;
+		explicit Shape(size_t size, int value = 0)
+		{
+			this->resize(size, value);
+		}
+		Shape(std::initializer_list<int> init)
+			: Shape(init.begin(), init.end())
+		{
+		}
+		template<std::input_iterator Iterator>
+		Shape(Iterator first, Iterator last)
+		{
+			this->assign(first, last);
+		}
+		Shape(const std::vector<int>& values)
+			: Shape(values.begin(), values.end())
+		{
+		}
+
+		operator std::vector<int>()const
+		{
+			return std::vector<int>(this->begin(), this->end());
+		}
+
+		//--------------------------
+		// Access
+		// -------------------------
+
+		size_t size()const { return (size_t)m_size; }
+		bool empty()const { return m_size == 0; }
+
+		int* data() { return m_values.data(); }
+		const int* data()const { return m_values.data(); }
+
+		int& operator[](size_t i) { assert(i < size()); return m_values[i]; }
+		const int& operator[](size_t i)const { assert(i < size()); return m_values[i]; }
+
+		int& at(size_t i)
+		{
+			if (i >= size())
+				throw std::out_of_range("Shape::at");
+			return m_values[i];
+		}
+		const int& at(size_t i)const
+		{
+			if (i >= size())
+				throw std::out_of_range("Shape::at");
+			return m_values[i];
+		}
+
+		int& front() { return (*this)[0]; }
+		const int& front()const { return (*this)[0]; }
+		int& back() { return (*this)[size() - 1]; }
+		const int& back()const { return (*this)[size() - 1]; }
+
+		iterator begin() { return m_values.data(); }
+		iterator end() { return m_values.data() + m_size; }
+		const_iterator begin()const { return m_values.data(); }
+		const_iterator end()const { return m_values.data() + m_size; }
+		reverse_iterator rbegin() { return reverse_iterator(this->end()); }
+		reverse_iterator rend() { return reverse_iterator(this->begin()); }
+		const_reverse_iterator rbegin()const { return const_reverse_iterator(this->end()); }
+		const_reverse_iterator rend()const { return const_reverse_iterator(this->begin()); }
+
+		//--------------------------
+		// Modifiers
+		// -------------------------
+
+		template<std::input_iterator Iterator>
+		void assign(Iterator first, Iterator last)
+		{
+			m_size = 0;
+			for (; first != last; ++first) {
+				this->push_back((int)*first);
+			}
+		}
+		void assign(size_t size, int value)
+		{
+			m_size = 0;
+			this->resize(size, value);
+		}
+		void clear() { m_size = 0; }
+
+		void resize(size_t size, int value = 0)
+		{
+			checkRank(size);
+			if (size > this->size())
+				std::fill(this->end(), m_values.data() + size, value);
+			m_size = (int)size;
+		}
+		void push_back(int value)
+		{
+			checkRank(size() + 1);
+			m_values[m_size++] = value;
+		}
+		void pop_back()
+		{
+			assert(m_size > 0);
+			m_size--;
+		}
+
+		iterator insert(const_iterator position, int value)
+		{
+			checkRank(size() + 1);
+			int* at = this->begin() + (position - this->begin());
+			std::copy_backward(at, this->end(), this->end() + 1);
+			*at = value;
+			m_size++;
+			return at;
+		}
+		iterator insert(const_iterator position, size_t count, int value)
+		{
+			checkRank(size() + count);
+			int* at = this->begin() + (position - this->begin());
+			std::copy_backward(at, this->end(), this->end() + count);
+			std::fill(at, at + count, value);
+			m_size += (int)count;
+			return at;
+		}
+		iterator erase(const_iterator position)
+		{
+			return this->erase(position, position + 1);
+		}
+		iterator erase(const_iterator first, const_iterator last)
+		{
+			int* from = this->begin() + (first - this->begin());
+			int* to = this->begin() + (last - this->begin());
+			std::copy(to, this->end(), from);
+			m_size -= (int)(to - from);
+			return from;
+		}
+
+		//--------------------------
+		// Comparison
+		// -------------------------
+
+		friend bool operator==(const Shape& lhs, const Shape& rhs)
+		{
+			return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+		}
+
+	private:
+
+		static void checkRank(size_t size)
+		{
+			if (size > (size_t)maxRank)
+				throw std::length_error("Shape: more than " + std::to_string(maxRank) + " axes are not supported");
+		}
+
+	private:
+		std::array<int, maxRank> m_values{};
+		int m_size = 0;
+	};
+}
@@ -0,0 +1,796 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <type_traits>
+#include <algorithm>
+#include <bit>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define CNUM_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#else
+#define CNUM_SIMD_X86 0
+#endif
+
+// The vector kernels are compiled for their instruction set only, and are chosen at runtime.
+// MSVC emits any instruction set through intrinsics without the need for per function targets
+#if defined(__GNUC__) || defined(__clang__)
+#define CNUM_TARGET(isa) __attribute__((target(isa)))
+#define CNUM_FLATTEN __attribute__((flatten))
+#define CNUM_INLINE __attribute__((always_inline))
+#else
+#define CNUM_TARGET(isa)
+#define CNUM_FLATTEN
+#define CNUM_INLINE
+#endif
+
+// Kernels that promise the same result on every instruction set keep their multiplies and adds apart. GCC fuses them into
+// FMAs whenever the target has them, also through intrinsics. Clang only fuses within one expression, and MSVC not by default
+#if defined(__GNUC__) && !defined(__clang__)
+#define CNUM_NO_CONTRACT __attribute__((optimize("fp-contract=off")))
+#else
+#define CNUM_NO_CONTRACT
+#endif
+
+namespace Cnum
+{
+namespace Simd
+{
+	/*
+		What is this?
+			Explicit AVX2 and AVX-512 kernels for the elementwise arithmetic, the comparisons, abs and the sum, product, min and max
+			reductions of float, double and int arrays, for the rotation of packed points, for the distances of points stored one
+			axis after another, for testing packed points against a box, and for the bitwise operations on the words of masks.
+			The widest instruction set supported by the CPU is detected once, and a scalar loop is used when none is available.
+
+			An operand is either an array or a single value which is broadcast over all elements, see Input.
+	*/
+
+	enum class Isa
+	{
+		Scalar,
+		Avx2,
+		Avx512
+	};
+
+	enum class Arith
+	{
+		Add,
+		Subtract,
+		Multiply,
+		Divide,
+		Min,
+		Max
+	};
+
+	enum class Compare
+	{
+		Equal,
+		NotEqual,
+		Less,
+		Greater,
+		LessEqual,
+		GreaterEqual
+	};
+
+	// AndNot is a & ~b
+	enum class BitOp
+	{
+		And,
+		Or,
+		Xor,
+		AndNot
+	};
+
+	template<typename T>
+	struct Input
+	{
+		T at(size_t i)const { return isScalar ? data[0] : data[i]; }
+		Input<T> from(size_t i)const { return isScalar ? *this : Input<T>{ data + i, false }; }
+
+		const T* data;
+		bool isScalar = false;
+	};
+
+	template<typename T>
+	constexpr bool isVectorizable = std::is_same_v<T, float> || std::is_same_v<T, double> || std::is_same_v<T, int>;
+
+
+	//--------------------------
+	// Instruction set selection
+	// -------------------------
+
+	inline Isa detectIsa()
+	{
+#if CNUM_SIMD_X86
+#if defined(__GNUC__) || defined(__clang__)
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f"))
+			return Isa::Avx512;
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+			return Isa::Avx2;
+#else
+		int info[4];
+		__cpuid(info, 0);
+		const int maxLeaf = info[0];
+		__cpuid(info, 1);
+		const bool osUsesXsave = (info[2] & (1 << 27)) != 0;
+		const bool hasAvx = (info[2] & (1 << 28)) != 0;
+		const bool hasFma = (info[2] & (1 << 12)) != 0;
+		if (maxLeaf < 7 || !osUsesXsave || !hasAvx || !hasFma)
+			return Isa::Scalar;
+
+		// The OS must save the ymm, and for AVX-512 also the zmm and mask, registers on context switches
+		const unsigned long long xcr0 = _xgetbv(0);
+		__cpuidex(info, 7, 0);
+		if ((info[1] & (1 << 16)) && (xcr0 & 0xe6) == 0xe6)
+			return Isa::Avx512;
+		if ((info[1] & (1 << 5)) && (xcr0 & 0x6) == 0x6)
+			return Isa::Avx2;
+#endif
+#endif
+		return Isa::Scalar;
+	}
+
+	inline Isa& isaLimit()
+	{
+		static Isa limit = Isa::Avx512;
+		return limit;
+	}
+
+	// Caps the instruction set used by the kernels, e.g. to compare against the scalar results
+	inline void setMaxIsa(Isa isa)
+	{
+		isaLimit() = isa;
+	}
+
+	inline Isa activeIsa()
+	{
+		static const Isa detected = detectIsa();
+		return (detected < isaLimit()) ? detected : isaLimit();
+	}
+
+
+	//--------------------------
+	// Scalar operations
+	// -------------------------
+
+	template<Arith op, typename T>
+	inline T apply(T a, T b)
+	{
+		if constexpr (op == Arith::Add) return a + b;
+		else if constexpr (op == Arith::Subtract) return a - b;
+		else if constexpr (op == Arith::Multiply) return a * b;
+		else if constexpr (op == Arith::Divide) return a / b;
+		else if constexpr (op == Arith::Min) return (a < b) ? a : b;
+		else return (a > b) ? a : b;
+	}
+
+	template<Compare op, typename T>
+	inline bool apply(T a, T b)
+	{
+		if constexpr (op == Compare::Equal) return a == b;
+		else if constexpr (op == Compare::NotEqual) return a != b;
+		else if constexpr (op == Compare::Less) return a < b;
+		else if constexpr (op == Compare::Greater) return a > b;
+		else if constexpr (op == Compare::LessEqual) return a <= b;
+		else return a >= b;
+	}
+
+	template<BitOp op>
+	inline uint64_t apply(uint64_t a, uint64_t b)
+	{
+		if constexpr (op == BitOp::And) return a & b;
+		else if constexpr (op == BitOp::Or) return a | b;
+		else if constexpr (op == BitOp::Xor) return a ^ b;
+		else return a & ~b;
+	}
+
+	// The comparison of the last n < 64 elements as one word
+	template<Compare op, typename T>
+	inline uint64_t compareTail(Input<T> a, Input<T> b, size_t n)
+	{
+		uint64_t word = 0;
+		for (size_t j = 0; j < n; j++) {
+			word |= (uint64_t)apply<op>(a.at(j), b.at(j)) << j;
+		}
+		return word;
+	}
+
+
+#if CNUM_SIMD_X86
+
+namespace Detail
+{
+	//--------------------------
+	// AVX2
+	// -------------------------
+
+	template<typename T>
+	struct Avx2;
+
+	template<>
+	struct Avx2<float>
+	{
+		using Reg = __m256;
+		using Mask = __m256;
+		static constexpr size_t width = 8;
+
+		CNUM_TARGET("avx2") static inline Reg load(const float* p) { return _mm256_loadu_ps(p); }
+		CNUM_TARGET("avx2") static inline Reg set1(float v) { return _mm256_set1_ps(v); }
+		CNUM_TARGET("avx2") static inline void store(float* p, Reg r) { _mm256_storeu_ps(p, r); }
+
+		template<Arith op>
+		CNUM_TARGET("avx2") static inline Reg arith(Reg a, Reg b)
+		{
+			if constexpr (op == Arith::Add) return _mm256_add_ps(a, b);
+			else if constexpr (op == Arith::Subtract) return _mm256_sub_ps(a, b);
+			else if constexpr (op == Arith::Multiply) return _mm256_mul_ps(a, b);
+			else if constexpr (op == Arith::Divide) return _mm256_div_ps(a, b);
+			else if constexpr (op == Arith::Min) return _mm256_min_ps(a, b);
+			else return _mm256_max_ps(a, b);
+		}
+		CNUM_TARGET("avx2,fma") static inline Reg fmadd(Reg a, Reg b, Reg c) { return _mm256_fmadd_ps(a, b, c); }
+		CNUM_TARGET("avx2") static inline Reg abs(Reg a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+
+		template<Compare op>
+		CNUM_TARGET("avx2") static inline Mask compare(Reg a, Reg b)
+		{
+			if constexpr (op == Compare::Equal) return _mm256_cmp_ps(a, b, _CMP_EQ_OQ);
+			else if constexpr (op == Compare::NotEqual) return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ);
+			else if constexpr (op == Compare::Less) return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+			else if constexpr (op == Compare::Greater) return _mm256_cmp_ps(a, b, _CMP_GT_OQ);
+			else if constexpr (op == Compare::LessEqual) return _mm256_cmp_ps(a, b, _CMP_LE_OQ);
+			else return _mm256_cmp_ps(a, b, _CMP_GE_OQ);
+		}
+		// One bit per element, the first element in the lowest bit
+		CNUM_TARGET("avx2") static inline uint32_t bits(Mask m) { return (uint32_t)_mm256_movemask_ps(m); }
+	};
+
+	template<>
+	struct Avx2<double>
+	{
+		using Reg = __m256d;
+		using Mask = __m256d;
+		static constexpr size_t width = 4;
+
+		CNUM_TARGET("avx2") static inline Reg load(const double* p) { return _mm256_loadu_pd(p); }
+		CNUM_TARGET("avx2") static inline Reg set1(double v) { return _mm256_set1_pd(v); }
+		CNUM_TARGET("avx2") static inline void store(double* p, Reg r) { _mm256_storeu_pd(p, r); }
+
+		template<Arith op>
+		CNUM_TARGET("avx2") static inline Reg arith(Reg a, Reg b)
+		{
+			if constexpr (op == Arith::Add) return _mm256_add_pd(a, b);
+			else if constexpr (op == Arith::Subtract) return _mm256_sub_pd(a, b);
+			else if constexpr (op == Arith::Multiply) return _mm256_mul_pd(a, b);
+			else if constexpr (op == Arith::Divide) return _mm256_div_pd(a, b);
+			else if constexpr (op == Arith::Min) return _mm256_min_pd(a, b);
+			else return _mm256_max_pd(a, b);
+		}
+		CNUM_TARGET("avx2,fma") static inline Reg fmadd(Reg a, Reg b, Reg c) { return _mm256_fmadd_pd(a, b, c); }
+		CNUM_TARGET("avx2") static inline Reg abs(Reg a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+
+		template<Compare op>
+		CNUM_TARGET("avx2") static inline Mask compare(Reg a, Reg b)
+		{
+			if constexpr (op == Compare::Equal) return _mm256_cmp_pd(a, b, _CMP_EQ_OQ);
+			else if constexpr (op == Compare::NotEqual) return _mm256_cmp_pd(a, b, _CMP_NEQ_UQ);
+			else if constexpr (op == Compare::Less) return _mm256_cmp_pd(a, b, _CMP_LT_OQ);
+			else if constexpr (op == Compare::Greater) return _mm256_cmp_pd(a, b, _CMP_GT_OQ);
+			else if constexpr (op == Compare::LessEqual) return _mm256_cmp_pd(a, b, _CMP_LE_OQ);
+			else return _mm256_cmp_pd(a, b, _CMP_GE_OQ);
+		}
+		// One bit per element, the first element in the lowest bit
+		CNUM_TARGET("avx2") static inline uint32_t bits(Mask m) { return (uint32_t)_mm256_movemask_pd(m); }
+	};
+
+	template<>
+	struct Avx2<int>
+	{
+		using Reg = __m256i;
+		using Mask = __m256i;
+		static constexpr size_t width = 8;
+
+		CNUM_TARGET("avx2") static inline Reg load(const int* p) { return _mm256_loadu_si256((const __m256i*)p); }
+		CNUM_TARGET("avx2") static inline Reg set1(int v) { return _mm256_set1_epi32(v); }
+		CNUM_TARGET("avx2") static inline void store(int* p, Reg r) { _mm256_storeu_si256((__m256i*)p, r); }
+
+		// There is no vector integer division
+		template<Arith op>
+		CNUM_TARGET("avx2") static inline Reg arith(Reg a, Reg b)
+		{
+			static_assert(op != Arith::Divide);
+			if constexpr (op == Arith::Add) return _mm256_add_epi32(a, b);
+			else if constexpr (op == Arith::Subtract) return _mm256_sub_epi32(a, b);
+			else if constexpr (op == Arith::Multiply) return _mm256_mullo_epi32(a, b);
+			else if constexpr (op == Arith::Min) return _mm256_min_epi32(a, b);
+			else return _mm256_max_epi32(a, b);
+		}
+		template<BitOp op>
+		CNUM_TARGET("avx2") static inline Reg bitwise(Reg a, Reg b)
+		{
+			if constexpr (op == BitOp::And) return _mm256_and_si256(a, b);
+			else if constexpr (op == BitOp::Or) return _mm256_or_si256(a, b);
+			else if constexpr (op == BitOp::Xor) return _mm256_xor_si256(a, b);
+			else return _mm256_andnot_si256(b, a);
+		}
+		CNUM_TARGET("avx2") static inline Reg abs(Reg a) { return _mm256_abs_epi32(a); }
+
+		template<Compare op>
+		CNUM_TARGET("avx2") static inline Mask compare(Reg a, Reg b)
+		{
+			const Reg allSet = _mm256_set1_epi32(-1);
+			if constexpr (op == Compare::Equal) return _mm256_cmpeq_epi32(a, b);
+			else if constexpr (op == Compare::NotEqual) return _mm256_xor_si256(_mm256_cmpeq_epi32(a, b), allSet);
+			else if constexpr (op == Compare::Less) return _mm256_cmpgt_epi32(b, a);
+			else if constexpr (op == Compare::Greater) return _mm256_cmpgt_epi32(a, b);
+			else if constexpr (op == Compare::LessEqual) return _mm256_xor_si256(_mm256_cmpgt_epi32(a, b), allSet);
+			else return _mm256_xor_si256(_mm256_cmpgt_epi32(b, a), allSet);
+		}
+		// One bit per element, the first element in the lowest bit
+		CNUM_TARGET("avx2") static inline uint32_t bits(Mask m) { return (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(m)); }
+	};
+
+
+	//--------------------------
+	// AVX-512
+	// -------------------------
+
+	template<typename T>
+	struct Avx512;
+
+	template<>
+	struct Avx512<float>
+	{
+		using Reg = __m512;
+		using Mask = __mmask16;
+		static constexpr size_t width = 16;
+
+		CNUM_TARGET("avx512f") static inline Reg load(const float* p) { return _mm512_loadu_ps(p); }
+		CNUM_TARGET("avx512f") static inline Reg set1(float v) { return _mm512_set1_ps(v); }
+		CNUM_TARGET("avx512f") static inline void store(float* p, Reg r) { _mm512_storeu_ps(p, r); }
+
+		template<Arith op>
+		CNUM_TARGET("avx512f") static inline Reg arith(Reg a, Reg b)
+		{
+			if constexpr (op == Arith::Add) return _mm512_add_ps(a, b);
+			else if constexpr (op == Arith::Subtract) return _mm512_sub_ps(a, b);
+			else if constexpr (op == Arith::Multiply) return _mm512_mul_ps(a, b);
+			else if constexpr (op == Arith::Divide) return _mm512_div_ps(a, b);
+			else if constexpr (op == Arith::Min) return _mm512_min_ps(a, b);
+			else return _mm512_max_ps(a, b);
+		}
+		CNUM_TARGET("avx512f") static inline Reg fmadd(Reg a, Reg b, Reg c) { return _mm512_fmadd_ps(a, b, c); }
+		CNUM_TARGET("avx512f") static inline Reg abs(Reg a) { return _mm512_abs_ps(a); }
+
+		template<Compare op>
+		CNUM_TARGET("avx512f") static inline Mask compare(Reg a, Reg b)
+		{
+			if constexpr (op == Compare::Equal) return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ);
+			else if constexpr (op == Compare::NotEqual) return _mm512_cmp_ps_mask(a, b, _CMP_NEQ_UQ);
+			else if constexpr (op == Compare::Less) return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ);
+			else if constexpr (op == Compare::Greater) return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ);
+			else if constexpr (op == Compare::LessEqual) return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ);
+			else return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ);
+		}
+		// One bit per element, the first element in the lowest bit
+		CNUM_TARGET("avx512f") static inline uint32_t bits(Mask m) { return (uint32_t)m; }
+	};
+
+	template<>
+	struct Avx512<double>
+	{
+		using Reg = __m512d;
+		using Mask = __mmask8;
+		static constexpr size_t width = 8;
+
+		CNUM_TARGET("avx512f") static inline Reg load(const double* p) { return _mm512_loadu_pd(p); }
+		CNUM_TARGET("avx512f") static inline Reg set1(double v) { return _mm512_set1_pd(v); }
+		CNUM_TARGET("avx512f") static inline void store(double* p, Reg r) { _mm512_storeu_pd(p, r); }
+
+		template<Arith op>
+		CNUM_TARGET("avx512f") static inline Reg arith(Reg a, Reg b)
+		{
+			if constexpr (op == Arith::Add) return _mm512_add_pd(a, b);
+			else if constexpr (op == Arith::Subtract) return _mm512_sub_pd(a, b);
+			else if constexpr (op == Arith::Multiply) return _mm512_mul_pd(a, b);
+			else if constexpr (op == Arith::Divide) return _mm512_div_pd(a, b);
+			else if constexpr (op == Arith::Min) return _mm512_min_pd(a, b);
+			else return _mm512_max_pd(a, b);
+		}
+		CNUM_TARGET("avx512f") static inline Reg fmadd(Reg a, Reg b, Reg c) { return _mm512_fmadd_pd(a, b, c); }
+		CNUM_TARGET("avx512f") static inline Reg abs(Reg a) { return _mm512_abs_pd(a); }
+
+		template<Compare op>
+		CNUM_TARGET("avx512f") static inline Mask compare(Reg a, Reg b)
+		{
+			if constexpr (op == Compare::Equal) return _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ);
+			else if constexpr (op == Compare::NotEqual) return _mm512_cmp_pd_mask(a, b, _CMP_NEQ_UQ);
+			else if constexpr (op == Compare::Less) return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ);
+			else if constexpr (op == Compare::Greater) return _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ);
+			else if constexpr (op == Compare::LessEqual) return _mm512_cmp_pd_mask(a, b, _CMP_LE_OQ);
+			else return _mm512_cmp_pd_mask(a, b, _CMP_GE_OQ);
+		}
+		// One bit per element, the first element in the lowest bit
+		CNUM_TARGET("avx512f") static inline uint32_t bits(Mask m) { return (uint32_t)m; }
+	};
+
+	template<>
+	struct Avx512<int>
+	{
+		using Reg = __m512i;
+		using Mask = __mmask16;
+		static constexpr size_t width = 16;
+
+		CNUM_TARGET("avx512f") static inline Reg load(const int* p) { return _mm512_loadu_si512(p); }
+		CNUM_TARGET("avx512f") static inline Reg set1(int v) { return _mm512_set1_epi32(v); }
+		CNUM_TARGET("avx512f") static inline void store(int* p, Reg r) { _mm512_storeu_si512(p, r); }
+
+		template<Arith op>
+		CNUM_TARGET("avx512f") static inline Reg arith(Reg a, Reg b)
+		{
+			static_assert(op != Arith::Divide);
+			if constexpr (op == Arith::Add) return _mm512_add_epi32(a, b);
+			else if constexpr (op == Arith::Subtract) return _mm512_sub_epi32(a, b);
+			else if constexpr (op == Arith::Multiply) return _mm512_mullo_epi32(a, b);
+			else if constexpr (op == Arith::Min) return _mm512_min_epi32(a, b);
+			else return _mm512_max_epi32(a, b);
+		}
+		template<BitOp op>
+		CNUM_TARGET("avx512f") static inline Reg bitwise(Reg a, Reg b)
+		{
+			if constexpr (op == BitOp::And) return _mm512_and_si512(a, b);
+			else if constexpr (op == BitOp::Or) return _mm512_or_si512(a, b);
+			else if constexpr (op == BitOp::Xor) return _mm512_xor_si512(a, b);
+			else return _mm512_andnot_si512(b, a);
+		}
+		CNUM_TARGET("avx512f") static inline Reg abs(Reg a) { return _mm512_abs_epi32(a); }
+
+		template<Compare op>
+		CNUM_TARGET("avx512f") static inline Mask compare(Reg a, Reg b)
+		{
+			if constexpr (op == Compare::Equal) return _mm512_cmp_epi32_mask(a, b, _MM_CMPINT_EQ);
+			else if constexpr (op == Compare::NotEqual) return _mm512_cmp_epi32_mask(a, b, _MM_CMPINT_NE);
+			else if constexpr (op == Compare::Less) return _mm512_cmp_epi32_mask(a, b, _MM_CMPINT_LT);
+			else if constexpr (op == Compare::Greater) return _mm512_cmp_epi32_mask(a, b, _MM_CMPINT_NLE);
+			else if constexpr (op == Compare::LessEqual) return _mm512_cmp_epi32_mask(a, b, _MM_CMPINT_LE);
+			else return _mm512_cmp_epi32_mask(a, b, _MM_CMPINT_NLT);
+		}
+		// One bit per element, the first element in the lowest bit
+		CNUM_TARGET("avx512f") static inline uint32_t bits(Mask m) { return (uint32_t)m; }
+	};
+
+
+	//--------------------------
+	// Loops, shared by the instruction sets
+	// -------------------------
+
+	/*
+		Why are the loops compiled once for each instruction set?
+			A loop keeps its values in registers of the instruction set and passes them to the functions of V. Compiled
+			without the instruction set, it would pass them in memory while those functions expect them in registers, which
+			only works out if everything is inlined. So the loops are compiled for the instruction set of their entry point
+			and always inlined into it, in any build mode.
+	*/
+	namespace Avx2Loops
+	{
+#define CNUM_LOOP CNUM_TARGET("avx2,fma") CNUM_INLINE
+#include "SimdLoops.h"
+#undef CNUM_LOOP
+	}
+
+	namespace Avx512Loops
+	{
+#define CNUM_LOOP CNUM_TARGET("avx512f") CNUM_INLINE
+#include "SimdLoops.h"
+#undef CNUM_LOOP
+	}
+
+	inline size_t popcountLoop(const uint64_t* words, size_t nWords)
+	{
+		size_t count = 0;
+		for (size_t i = 0; i < nWords; i++) {
+			count += (size_t)std::popcount(words[i]);
+		}
+		return count;
+	}
+
+
+	// Entry points, compiled for their instruction set
+
+	template<Arith op, typename T>
+	CNUM_TARGET("avx2,fma") CNUM_FLATTEN void arithmeticAvx2(Input<T> a, Input<T> b, T* out, size_t n) { Avx2Loops::arithmeticLoop<Avx2<T>, op>(a, b, out, n); }
+	template<Arith op, typename T>
+	CNUM_TARGET("avx512f") CNUM_FLATTEN void arithmeticAvx512(Input<T> a, Input<T> b, T* out, size_t n) { Avx512Loops::arithmeticLoop<Avx512<T>, op>(a, b, out, n); }
+
+	template<Compare op, typename T>
+	CNUM_TARGET("avx2,fma") CNUM_FLATTEN void compareAvx2(Input<T> a, Input<T> b, uint64_t* out, size_t n) { Avx2Loops::compareLoop<Avx2<T>, op>(a, b, out, n); }
+	template<Compare op, typename T>
+	CNUM_TARGET("avx512f") CNUM_FLATTEN void compareAvx512(Input<T> a, Input<T> b, uint64_t* out, size_t n) { Avx512Loops::compareLoop<Avx512<T>, op>(a, b, out, n); }
+
+	template<BitOp op>
+	CNUM_TARGET("avx2,fma") CNUM_FLATTEN void bitwiseAvx2(const uint64_t* a, const uint64_t* b, uint64_t* out, size_t nWords) { Avx2Loops::bitwiseLoop<Avx2<int>, op>(a, b, out, nWords); }
+	template<BitOp op>
+	CNUM_TARGET("avx512f") CNUM_FLATTEN void bitwiseAvx512(const uint64_t* a, const uint64_t* b, uint64_t* out, size_t nWords) { Avx512Loops::bitwiseLoop<Avx512<int>, op>(a, b, out, nWords); }
+
+	// Every CPU with AVX2 has the popcnt instruction
+	CNUM_TARGET("popcnt") CNUM_FLATTEN inline size_t popcountFast(const uint64_t* words, size_t nWords) { return popcountLoop(words, nWords); }
+
+	template<Arith op, bool squared, typename T>
+	CNUM_TARGET("avx2,fma") CNUM_FLATTEN void foldAvx2(const T* in, T* acc, size_t n) { Avx2Loops::foldLoop<Avx2<T>, op, squared>(in, acc, n); }
+	template<Arith op, bool squared, typename T>
+	CNUM_TARGET("avx512f") CNUM_FLATTEN void foldAvx512(const T* in, T* acc, size_t n) { Avx512Loops::foldLoop<Avx512<T>, op, squared>(in, acc, n); }
+
+	template<Arith op, bool squared, typename T>
+	CNUM_TARGET("avx2,fma") CNUM_FLATTEN T reduceAvx2(const T* in, size_t n, T init) { return Avx2Loops::reduceLoop<Avx2<T>, op, squared>(in, n, init); }
+	template<Arith op, bool squared, typename T>
+	CNUM_TARGET("avx512f") CNUM_FLATTEN T reduceAvx512(const T* in, size_t n, T init) { return Avx512Loops::reduceLoop<Avx512<T>, op, squared>(in, n, init); }
+
+	template<typename T>
+	CNUM_TARGET("avx2,fma") CNUM_FLATTEN void transform3Avx2(const T* in, T* out, size_t nPoints, const T* matrix) { Avx2Loops::transform3Loop<Avx2<T>>(in, out, nPoints, matrix); }
+	template<typename T>
+	CNUM_TARGET("avx512f") CNUM_FLATTEN void transform3Avx512(const T* in, T* out, size_t nPoints, const T* matrix) { Avx512Loops::transform3Loop<Avx512<T>>(in, out, nPoints, matrix); }
+
+	template<typename T>
+	CNUM_TARGET("avx2,fma") CNUM_FLATTEN void rotateAvx2(const T* quaternions, T* points, size_t nPoints) { Avx2Loops::rotateLoop<Avx2<T>>(quaternions, points, nPoints); }
+	template<typename T>
+	CNUM_TARGET("avx512f") CNUM_FLATTEN void rotateAvx512(const T* quaternions, T* points, size_t nPoints) { Avx512Loops::rotateLoop<Avx512<T>>(quaternions, points, nPoints); }
+
+	template<int D, typename T>
+	CNUM_TARGET("avx2,fma") CNUM_FLATTEN void boxContainsAvx2(const T* points, size_t nPoints, const T* low, const T* high, uint64_t* out) { Avx2Loops::boxContainsLoop<Avx2<T>, D>(points, nPoints, low, high, out); }
+	template<int D, typename T>
+	CNUM_TARGET("avx512f") CNUM_FLATTEN void boxContainsAvx512(const T* points, size_t nPoints, const T* low, const T* high, uint64_t* out) { Avx512Loops::boxContainsLoop<Avx512<T>, D>(points, nPoints, low, high, out); }
+
+	template<typename T>
+	CNUM_TARGET("avx2,fma") CNUM_FLATTEN CNUM_NO_CONTRACT void squaredDistanceAvx2(const T* coordinates, size_t stride, int dims, size_t n, const T* point, T* out) { Avx2Loops::squaredDistanceLoop<Avx2<T>>(coordinates, stride, dims, n, point, out); }
+	template<typename T>
+	CNUM_TARGET("avx512f") CNUM_FLATTEN CNUM_NO_CONTRACT void squaredDistanceAvx512(const T* coordinates, size_t stride, int dims, size_t n, const T* point, T* out) { Avx512Loops::squaredDistanceLoop<Avx512<T>>(coordinates, stride, dims, n, point, out); }
+
+	template<typename T>
+	CNUM_TARGET("avx2,fma") CNUM_FLATTEN void absAvx2(const T* in, T* out, size_t n) { Avx2Loops::absLoop<Avx2<T>>(in, out, n); }
+	template<typename T>
+	CNUM_TARGET("avx512f") CNUM_FLATTEN void absAvx512(const T* in, T* out, size_t n) { Avx512Loops::absLoop<Avx512<T>>(in, out, n); }
+}
+
+#endif
+
+
+	//--------------------------
+	// Kernels
+	// -------------------------
+
+	// out[i] = a[i] op b[i]
+	template<Arith op, typename T>
+	void arithmetic(Input<T> a, Input<T> b, T* out, size_t n)
+	{
+#if CNUM_SIMD_X86
+		if constexpr (isVectorizable<T> && !(std::is_integral_v<T> && op == Arith::Divide)) {
+			switch (activeIsa()) {
+			case Isa::Avx512: Detail::arithmeticAvx512<op>(a, b, out, n); return;
+			case Isa::Avx2: Detail::arithmeticAvx2<op>(a, b, out, n); return;
+			default: break;
+			}
+		}
+#endif
+		for (size_t i = 0; i < n; i++) {
+			out[i] = apply<op>(a.at(i), b.at(i));
+		}
+	}
+
+	// Bit i of out is set if a[i] op b[i] holds. Writes ceil(n / 64) words, with the bits past n cleared
+	template<Compare op, typename T>
+	void compare(Input<T> a, Input<T> b, uint64_t* out, size_t n)
+	{
+#if CNUM_SIMD_X86
+		if constexpr (isVectorizable<T>) {
+			switch (activeIsa()) {
+			case Isa::Avx512: Detail::compareAvx512<op>(a, b, out, n); return;
+			case Isa::Avx2: Detail::compareAvx2<op>(a, b, out, n); return;
+			default: break;
+			}
+		}
+#endif
+		for (size_t i = 0; i < n; i += 64) {
+			out[i / 64] = compareTail<op>(a.from(i), b.from(i), std::min<size_t>(64, n - i));
+		}
+	}
+
+	// out[i] = a[i] op b[i] on whole words
+	template<BitOp op>
+	void bitwise(const uint64_t* a, const uint64_t* b, uint64_t* out, size_t nWords)
+	{
+#if CNUM_SIMD_X86
+		switch (activeIsa()) {
+		case Isa::Avx512: Detail::bitwiseAvx512<op>(a, b, out, nWords); return;
+		case Isa::Avx2: Detail::bitwiseAvx2<op>(a, b, out, nWords); return;
+		default: break;
+		}
+#endif
+		for (size_t i = 0; i < nWords; i++) {
+			out[i] = apply<op>(a[i], b[i]);
+		}
+	}
+
+	// Number of set bits
+	inline size_t popcount(const uint64_t* words, size_t nWords)
+	{
+#if CNUM_SIMD_X86
+		if (activeIsa() != Isa::Scalar)
+			return Detail::popcountFast(words, nWords);
+#endif
+		size_t count = 0;
+		for (size_t i = 0; i < nWords; i++) {
+			count += (size_t)std::popcount(words[i]);
+		}
+		return count;
+	}
+
+	// acc[i] = acc[i] op in[i], or acc[i] op in[i]^2 if squared
+	template<Arith op, bool squared = false, typename T>
+	void fold(const T* in, T* acc, size_t n)
+	{
+#if CNUM_SIMD_X86
+		if constexpr (isVectorizable<T> && op != Arith::Divide) {
+			switch (activeIsa()) {
+			case Isa::Avx512: Detail::foldAvx512<op, squared>(in, acc, n); return;
+			case Isa::Avx2: Detail::foldAvx2<op, squared>(in, acc, n); return;
+			default: break;
+			}
+		}
+#endif
+		for (size_t i = 0; i < n; i++) {
+			acc[i] = apply<op>(acc[i], squared ? in[i] * in[i] : in[i]);
+		}
+	}
+
+	// init op in[0] op ... op in[n - 1], or of the squares. The elements are combined in any order
+	template<Arith op, bool squared = false, typename T>
+	T reduce(const T* in, size_t n, T init)
+	{
+		static_assert(op == Arith::Add || op == Arith::Multiply || op == Arith::Min || op == Arith::Max);
+#if CNUM_SIMD_X86
+		if constexpr (isVectorizable<T>) {
+			switch (activeIsa()) {
+			case Isa::Avx512: return Detail::reduceAvx512<op, squared>(in, n, init);
+			case Isa::Avx2: return Detail::reduceAvx2<op, squared>(in, n, init);
+			default: break;
+			}
+		}
+#endif
+		T result = init;
+		for (size_t i = 0; i < n; i++) {
+			result = apply<op>(result, squared ? in[i] * in[i] : in[i]);
+		}
+		return result;
+	}
+
+	// out[i] = |in[i]|, in and out may be the same
+	template<typename T>
+	void abs(const T* in, T* out, size_t n)
+	{
+#if CNUM_SIMD_X86
+		if constexpr (isVectorizable<T>) {
+			switch (activeIsa()) {
+			case Isa::Avx512: Detail::absAvx512(in, out, n); return;
+			case Isa::Avx2: Detail::absAvx2(in, out, n); return;
+			default: break;
+			}
+		}
+#endif
+		for (size_t i = 0; i < n; i++) {
+			out[i] = (in[i] < 0) ? -in[i] : in[i];
+		}
+	}
+
+	// out[i] = M * in[i] for nPoints packed (x,y,z) points, with the 3x3 matrix M in row major order. in and out may be the same
+	template<typename T>
+	void transform3(const T* in, T* out, size_t nPoints, const T* matrix)
+	{
+#if CNUM_SIMD_X86
+		if constexpr (std::is_floating_point_v<T> && isVectorizable<T>) {
+			switch (activeIsa()) {
+			case Isa::Avx512: Detail::transform3Avx512(in, out, nPoints, matrix); return;
+			case Isa::Avx2: Detail::transform3Avx2(in, out, nPoints, matrix); return;
+			default: break;
+			}
+		}
+#endif
+		for (size_t i = 0; i < nPoints; i++) {
+			const T x = in[3 * i], y = in[3 * i + 1], z = in[3 * i + 2];
+			for (int r = 0; r < 3; r++) {
+				out[3 * i + r] = matrix[3 * r] * x + matrix[3 * r + 1] * y + matrix[3 * r + 2] * z;
+			}
+		}
+	}
+
+	// out[i] = |p_i - point|^2 for n points stored one axis after another, coordinate k of point i at coordinates[k * stride + i].
+	// The sum is taken in the order of the axes with separate multiplies and adds, so every instruction set gives the same result
+	template<typename T>
+	CNUM_NO_CONTRACT void squaredDistance(const T* coordinates, size_t stride, int dims, size_t n, const T* point, T* out)
+	{
+#if CNUM_SIMD_X86
+		if constexpr (std::is_floating_point_v<T> && isVectorizable<T>) {
+			switch (activeIsa()) {
+			case Isa::Avx512: Detail::squaredDistanceAvx512(coordinates, stride, dims, n, point, out); return;
+			case Isa::Avx2: Detail::squaredDistanceAvx2(coordinates, stride, dims, n, point, out); return;
+			default: break;
+			}
+		}
+#endif
+		for (size_t i = 0; i < n; i++) {
+			T acc = T(0);
+			for (int k = 0; k < dims; k++) {
+				const T diff = coordinates[k * stride + i] - point[k];
+				const T square = diff * diff;
+				acc = acc + square;
+			}
+			out[i] = acc;
+		}
+	}
+
+	// Bit p of out is set if the packed point p of D coordinates is inside the closed box [low, high].
+	// Writes ceil(nPoints / 64) words, with the bits past nPoints cleared
+	template<int D, typename T>
+	void boxContains(const T* points, size_t nPoints, const T* low, const T* high, uint64_t* out)
+	{
+#if CNUM_SIMD_X86
+		if constexpr (isVectorizable<T>) {
+			switch (activeIsa()) {
+			case Isa::Avx512:
+				if constexpr (D * Detail::Avx512<T>::width <= 64) {
+					Detail::boxContainsAvx512<D>(points, nPoints, low, high, out);
+					return;
+				}
+				[[fallthrough]];
+			case Isa::Avx2:
+				if constexpr (D * Detail::Avx2<T>::width <= 64) {
+					Detail::boxContainsAvx2<D>(points, nPoints, low, high, out);
+					return;
+				}
+				break;
+			default: break;
+			}
+		}
+#endif
+		std::fill(out, out + (nPoints + 63) / 64, uint64_t(0));
+		for (size_t p = 0; p < nPoints; p++) {
+			bool inside = true;
+			for (int k = 0; k < D; k++) {
+				inside &= (low[k] <= points[p * D + k]) & (points[p * D + k] <= high[k]);
+			}
+			out[p / 64] |= (uint64_t)inside << (p % 64);
+		}
+	}
+
+	// Rotates point i, packed as (x,y,z), by the normalized quaternion i, packed as (w,x,y,z)
+	template<typename T>
+	void rotate(const T* quaternions, T* points, size_t nPoints)
+	{
+#if CNUM_SIMD_X86
+		if constexpr (std::is_floating_point_v<T> && isVectorizable<T>) {
+			switch (activeIsa()) {
+			case Isa::Avx512: Detail::rotateAvx512(quaternions, points, nPoints); return;
+			case Isa::Avx2: Detail::rotateAvx2(quaternions, points, nPoints); return;
+			default: break;
+			}
+		}
+#endif
+		for (size_t i = 0; i < nPoints; i++) {
+			const T* q = quaternions + 4 * i;
+			T* v = points + 3 * i;
+			const T tx = 2 * (q[2] * v[2] - q[3] * v[1]);
+			const T ty = 2 * (q[3] * v[0] - q[1] * v[2]);
+			const T tz = 2 * (q[1] * v[1] - q[2] * v[0]);
+			v[0] += q[0] * tx + q[2] * tz - q[3] * ty;
+			v[1] += q[0] * ty + q[3] * tx - q[1] * tz;
+			v[2] += q[0] * tz + q[1] * ty - q[2] * tx;
+		}
+	}
+
+}
+}
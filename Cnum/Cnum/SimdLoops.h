@@ -0,0 +1,309 @@
+// The loops shared by the instruction sets. Simd.h includes this file once for each instruction set, inside a namespace
+// of its own and with CNUM_LOOP defined to compile the loops for that instruction set, so there is no #pragma once
+
+	template<typename V, Arith op, typename T>
+	CNUM_LOOP inline void arithmeticLoop(Input<T> a, Input<T> b, T* out, size_t n)
+	{
+		using Reg = typename V::Reg;
+		const Reg splatA = V::set1(a.data[0]);
+		const Reg splatB = V::set1(b.data[0]);
+
+		size_t i = 0;
+		for (; i + V::width <= n; i += V::width) {
+			Reg va = a.isScalar ? splatA : V::load(a.data + i);
+			Reg vb = b.isScalar ? splatB : V::load(b.data + i);
+			V::store(out + i, V::template arith<op>(va, vb));
+		}
+		for (; i < n; i++) {
+			out[i] = apply<op>(a.at(i), b.at(i));
+		}
+	}
+
+	// Writes ceil(n / 64) words, the bits past n in the last word are zero
+	template<typename V, Compare op, typename T>
+	CNUM_LOOP inline void compareLoop(Input<T> a, Input<T> b, uint64_t* out, size_t n)
+	{
+		using Reg = typename V::Reg;
+		const Reg splatA = V::set1(a.data[0]);
+		const Reg splatB = V::set1(b.data[0]);
+
+		size_t i = 0;
+		for (; i + 64 <= n; i += 64) {
+			uint64_t word = 0;
+			for (size_t j = 0; j < 64; j += V::width) {
+				Reg va = a.isScalar ? splatA : V::load(a.data + i + j);
+				Reg vb = b.isScalar ? splatB : V::load(b.data + i + j);
+				word |= (uint64_t)V::bits(V::template compare<op>(va, vb)) << j;
+			}
+			out[i / 64] = word;
+		}
+		if (i < n) {
+			out[i / 64] = compareTail<op>(a.from(i), b.from(i), n - i);
+		}
+	}
+
+	template<typename V, BitOp op>
+	CNUM_LOOP inline void bitwiseLoop(const uint64_t* a, const uint64_t* b, uint64_t* out, size_t nWords)
+	{
+		constexpr size_t width = sizeof(typename V::Reg) / sizeof(uint64_t);
+		size_t i = 0;
+		for (; i + width <= nWords; i += width) {
+			V::store((int*)(out + i), V::template bitwise<op>(V::load((const int*)(a + i)), V::load((const int*)(b + i))));
+		}
+		for (; i < nWords; i++) {
+			out[i] = apply<op>(a[i], b[i]);
+		}
+	}
+
+	template<typename V, typename T>
+	CNUM_LOOP inline void absLoop(const T* in, T* out, size_t n)
+	{
+		size_t i = 0;
+		for (; i + V::width <= n; i += V::width) {
+			V::store(out + i, V::abs(V::load(in + i)));
+		}
+		for (; i < n; i++) {
+			out[i] = (in[i] < 0) ? -in[i] : in[i];
+		}
+	}
+
+
+	template<typename V, bool squared, typename T>
+	CNUM_LOOP inline typename V::Reg loadOperand(const T* p)
+	{
+		typename V::Reg v = V::load(p);
+		if constexpr (squared)
+			return V::template arith<Arith::Multiply>(v, v);
+		else
+			return v;
+	}
+
+	template<typename V, Arith op, bool squared, typename T>
+	CNUM_LOOP inline void foldLoop(const T* in, T* acc, size_t n)
+	{
+		size_t i = 0;
+		for (; i + V::width <= n; i += V::width) {
+			V::store(acc + i, V::template arith<op>(V::load(acc + i), loadOperand<V, squared>(in + i)));
+		}
+		for (; i < n; i++) {
+			acc[i] = apply<op>(acc[i], squared ? in[i] * in[i] : in[i]);
+		}
+	}
+
+	// Four independent accumulators hide the latency of op
+	template<typename V, Arith op, bool squared, typename T>
+	CNUM_LOOP inline T reduceLoop(const T* in, size_t n, T init)
+	{
+		using Reg = typename V::Reg;
+		constexpr size_t W = V::width;
+
+		T result = init;
+		size_t i = 0;
+		if (n >= 4 * W) {
+			Reg acc[4] = { loadOperand<V, squared>(in), loadOperand<V, squared>(in + W), loadOperand<V, squared>(in + 2 * W), loadOperand<V, squared>(in + 3 * W) };
+			for (i = 4 * W; i + 4 * W <= n; i += 4 * W) {
+				for (size_t k = 0; k < 4; k++) {
+					acc[k] = V::template arith<op>(acc[k], loadOperand<V, squared>(in + i + k * W));
+				}
+			}
+			for (; i + W <= n; i += W) {
+				acc[0] = V::template arith<op>(acc[0], loadOperand<V, squared>(in + i));
+			}
+			acc[0] = V::template arith<op>(V::template arith<op>(acc[0], acc[1]), V::template arith<op>(acc[2], acc[3]));
+
+			alignas(64) T lanes[W];
+			V::store(lanes, acc[0]);
+			for (size_t k = 0; k < W; k++) {
+				result = apply<op>(result, lanes[k]);
+			}
+		}
+		for (; i < n; i++) {
+			result = apply<op>(result, squared ? in[i] * in[i] : in[i]);
+		}
+		return result;
+	}
+
+
+	/*
+		How are points transformed without deinterleaving them?
+			Element k of a block of packed (x,y,z) points belongs to coordinate r = k % 3, and is the sum over the shifts
+			d = -2..2 of M[r][r + d] * in[k + d], where the terms with r + d outside [0, 3) have a zero coefficient. Each
+			shift is a plain unaligned load, so a block of width points takes 15 loads and multiply-adds of whole registers,
+			with the coefficients set up once.
+
+			The block is first copied into a buffer with zeros around it, so the loads never leave it, the last block
+			can be partial, and out may be the same as in.
+	*/
+	template<typename V, typename T>
+	CNUM_LOOP inline void transform3Loop(const T* in, T* out, size_t nPoints, const T* matrix)
+	{
+		constexpr size_t width = V::width;
+		constexpr size_t block = 3 * width;
+
+		typename V::Reg coefficients[5][3];
+		for (int d = 0; d < 5; d++) {
+			for (size_t j = 0; j < 3; j++) {
+				T lanes[width];
+				for (size_t l = 0; l < width; l++) {
+					const int r = (int)((j * width + l) % 3);
+					const int c = r + d - 2;
+					lanes[l] = (c >= 0 && c < 3) ? matrix[r * 3 + c] : T(0);
+				}
+				coefficients[d][j] = V::load(lanes);
+			}
+		}
+
+		T buffer[block + 4] = {};
+		for (size_t p = 0; p < nPoints; p += width) {
+			const size_t n = 3 * std::min(width, nPoints - p);
+			std::copy(in + 3 * p, in + 3 * p + n, buffer + 2);
+			std::fill(buffer + 2 + n, buffer + 2 + block, T(0));
+
+			for (size_t j = 0; j < 3; j++) {
+				const T* shifted = buffer + j * width;
+				typename V::Reg acc = V::template arith<Arith::Multiply>(coefficients[0][j], V::load(shifted));
+				for (int d = 1; d < 5; d++) {
+					acc = V::fmadd(coefficients[d][j], V::load(shifted + d), acc);
+				}
+				if (n == block) {
+					V::store(out + 3 * p + j * width, acc);
+				}
+				else if (j * width < n) {
+					T lanes[width];
+					V::store(lanes, acc);
+					std::copy(lanes, lanes + std::min(width, n - j * width), out + 3 * p + j * width);
+				}
+			}
+		}
+	}
+
+
+	// a x b - c x d, for one coordinate of a cross product. A function rather than a lambda, which would not be compiled
+	// for the instruction set of the loop
+	template<typename V>
+	CNUM_LOOP inline typename V::Reg crossed(typename V::Reg a, typename V::Reg b, typename V::Reg c, typename V::Reg d)
+	{
+		return V::template arith<Arith::Subtract>(V::template arith<Arith::Multiply>(a, b), V::template arith<Arith::Multiply>(c, d));
+	}
+
+	// The points and quaternions of a block are gathered into one register per coordinate, rotated, and scattered back
+	template<typename V, typename T>
+	CNUM_LOOP inline void rotateLoop(const T* quaternions, T* points, size_t nPoints)
+	{
+		using Reg = typename V::Reg;
+		constexpr size_t width = V::width;
+
+		T lanes[7][width] = {};
+		for (size_t p = 0; p < nPoints; p += width) {
+			const size_t n = std::min(width, nPoints - p);
+			for (size_t l = 0; l < n; l++) {
+				for (size_t c = 0; c < 4; c++) lanes[c][l] = quaternions[4 * (p + l) + c];
+				for (size_t c = 0; c < 3; c++) lanes[4 + c][l] = points[3 * (p + l) + c];
+			}
+			const Reg w = V::load(lanes[0]), qx = V::load(lanes[1]), qy = V::load(lanes[2]), qz = V::load(lanes[3]);
+			const Reg x = V::load(lanes[4]), y = V::load(lanes[5]), z = V::load(lanes[6]);
+
+			// t = 2 q x v, v' = v + w t + q x t
+			const Reg two = V::set1(T(2));
+			const Reg tx = V::template arith<Arith::Multiply>(two, crossed<V>(qy, z, qz, y));
+			const Reg ty = V::template arith<Arith::Multiply>(two, crossed<V>(qz, x, qx, z));
+			const Reg tz = V::template arith<Arith::Multiply>(two, crossed<V>(qx, y, qy, x));
+			V::store(lanes[4], V::fmadd(w, tx, V::template arith<Arith::Add>(x, crossed<V>(qy, tz, qz, ty))));
+			V::store(lanes[5], V::fmadd(w, ty, V::template arith<Arith::Add>(y, crossed<V>(qz, tx, qx, tz))));
+			V::store(lanes[6], V::fmadd(w, tz, V::template arith<Arith::Add>(z, crossed<V>(qx, ty, qy, tx))));
+
+			for (size_t l = 0; l < n; l++) {
+				for (size_t c = 0; c < 3; c++) points[3 * (p + l) + c] = lanes[4 + c][l];
+			}
+		}
+	}
+
+
+	// The squared distances of a block of points to one point, accumulated one axis at a time in the order of the scalar loop.
+	// The last partial block is copied into lanes and goes through the same vector operations as the full blocks
+	template<typename V, typename T>
+	CNUM_LOOP inline void squaredDistanceLoop(const T* coordinates, size_t stride, int dims, size_t n, const T* point, T* out)
+	{
+		using Reg = typename V::Reg;
+		constexpr size_t width = V::width;
+
+		T lanes[width] = {};
+		for (size_t i = 0; i < n; i += width) {
+			const size_t count = std::min(width, n - i);
+			Reg acc = V::set1(T(0));
+			for (int k = 0; k < dims; k++) {
+				const T* axis = coordinates + k * stride + i;
+				Reg x;
+				if (count == width) {
+					x = V::load(axis);
+				}
+				else {
+					std::copy(axis, axis + count, lanes);
+					x = V::load(lanes);
+				}
+				const Reg diff = V::template arith<Arith::Subtract>(x, V::set1(point[k]));
+				acc = V::template arith<Arith::Add>(acc, V::template arith<Arith::Multiply>(diff, diff));
+			}
+			if (count == width) {
+				V::store(out + i, acc);
+			}
+			else {
+				V::store(lanes, acc);
+				std::copy(lanes, lanes + count, out + i);
+			}
+		}
+	}
+
+
+	/*
+		How are packed points tested against a box without deinterleaving them?
+			A block of width points of D coordinates is D registers, where lane l of register j holds coordinate
+			(j * width + l) % D. The bounds are set up once in the same repeating pattern, so each register is compared
+			with two plain loads. The D * width comparison bits are concatenated, each point is the AND of its D consecutive
+			bits, and those are packed to one bit per point. This needs D * width <= 64, wider points use the scalar loop.
+	*/
+	template<typename V, int D, typename T>
+	CNUM_LOOP inline void boxContainsLoop(const T* points, size_t nPoints, const T* low, const T* high, uint64_t* out)
+	{
+		using Reg = typename V::Reg;
+		constexpr size_t width = V::width;
+		static_assert(D * width <= 64);
+
+		Reg lows[D], highs[D];
+		for (size_t j = 0; j < (size_t)D; j++) {
+			T lowLanes[width], highLanes[width];
+			for (size_t l = 0; l < width; l++) {
+				lowLanes[l] = low[(j * width + l) % D];
+				highLanes[l] = high[(j * width + l) % D];
+			}
+			lows[j] = V::load(lowLanes);
+			highs[j] = V::load(highLanes);
+		}
+
+		std::fill(out, out + (nPoints + 63) / 64, uint64_t(0));
+		size_t p = 0;
+		for (; p + width <= nPoints; p += width) {
+			uint64_t bits = 0;
+			for (size_t j = 0; j < (size_t)D; j++) {
+				const Reg x = V::load(points + p * D + j * width);
+				const uint64_t inside = V::bits(V::template compare<Compare::GreaterEqual>(x, lows[j])) & V::bits(V::template compare<Compare::LessEqual>(x, highs[j]));
+				bits |= inside << (j * width);
+			}
+			uint64_t all = bits;
+			for (int k = 1; k < D; k++) {
+				all &= bits >> k;
+			}
+			uint64_t packed = 0;
+			for (size_t l = 0; l < width; l++) {
+				packed |= ((all >> (l * D)) & 1) << l;
+			}
+			out[p / 64] |= packed << (p % 64);
+		}
+		for (; p < nPoints; p++) {
+			bool inside = true;
+			for (int k = 0; k < D; k++) {
+				inside &= (low[k] <= points[p * D + k]) & (points[p * D + k] <= high[k]);
+			}
+			out[p / 64] |= (uint64_t)inside << (p % 64);
+		}
+	}
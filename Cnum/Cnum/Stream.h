@@ -0,0 +1,489 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <future>
+#include <fstream>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <format>
+#include <type_traits>
+#include <assert.h>
+#include "Shape.h"
+#include "Memory.h"
+#include "Parallel.h"
+#include "Npy.h"
+#include "Csv.h"
+
+namespace Cnum
+{
+	template<typename T>
+	class ndArray;
+
+namespace Stream
+{
+	/*
+		What is streaming?
+			Processing a file that is too large for memory a block of rows at a time. Only the current block and the one
+			being read ahead are held in memory, and the next block is read on another thread while the current one is
+			being used, so the disk and the cores work at the same time.
+
+				auto blocks = Stream::Blocks<double>::npy("day.npy", 1 << 16);
+				Stream::Summary<double> summary = Stream::summarize(blocks);
+				dArray means = summary.mean();
+
+			A row is everything along the first axis of the file, so a block of an (N, a, b) .npy file has the shape
+			(rows, a, b), and the rows of a text file are its lines. Reductions along axis 0 treat a row as a flat run of
+			rowLength() elements.
+	*/
+
+	//--------------------------
+	// Sources
+	// -------------------------
+
+	// Where the rows come from
+	template<typename T>
+	class Source
+	{
+	public:
+		virtual ~Source() = default;
+
+		// The next nRows rows, fewer at the end of the file, and none after it
+		virtual ndArray<T> read(size_t nRows) = 0;
+
+		// The shape of a single row
+		virtual const Shape& rowShape()const = 0;
+	};
+
+	// The rows of an .npy file, in any type that Npy::load() reads
+	template<typename T>
+	class NpySource : public Source<T>
+	{
+	public:
+		explicit NpySource(std::string_view path)
+			: m_stream(std::string(path), std::ios::binary)
+		{
+			if (!m_stream.is_open())
+				throw std::runtime_error(std::format("Could not open file: {}", path));
+			m_header = Npy::readHeader(m_stream);
+			if (m_header.fortranOrder && m_header.shape.size() > 1)
+				throw std::runtime_error("A column major .npy file cannot be read row by row");
+
+			m_rows = m_header.shape.empty() ? 1 : (size_t)m_header.shape[0];
+			if (m_header.shape.size() > 1)
+				m_rowShape.assign(m_header.shape.begin() + 1, m_header.shape.end());
+			m_rowLength = 1;
+			for (int dim : m_rowShape) m_rowLength *= (size_t)dim;
+		}
+
+		ndArray<T> read(size_t nRows) override
+		{
+			nRows = std::min(nRows, m_rows - m_next);
+			const size_t n = nRows * m_rowLength;
+			Memory::Buffer<T> elements(n);
+
+			if (m_header.holds<T>()) {
+				m_stream.read(reinterpret_cast<char*>(elements.data()), (std::streamsize)(n * sizeof(T)));
+			}
+			else {
+				m_bytes.resize(n * m_header.itemSize());
+				m_stream.read(m_bytes.data(), (std::streamsize)m_bytes.size());
+				Npy::convert(m_header, m_bytes.data(), elements.data(), n);
+			}
+			if (!m_stream)
+				throw std::runtime_error("The .npy file is shorter than its header says");
+			m_next += nRows;
+
+			Shape shape = m_rowShape;
+			shape.insert(shape.begin(), (int)nRows);
+			return ndArray<T>(std::move(elements), shape);
+		}
+
+		const Shape& rowShape()const override { return m_rowShape; }
+
+	private:
+		std::ifstream m_stream;
+		Npy::Header m_header;
+		Shape m_rowShape;
+		size_t m_rowLength = 1;
+		size_t m_rows = 0;
+		size_t m_next = 0;
+		std::vector<char> m_bytes;
+	};
+
+	// The data lines of a delimited text file, read with the options of Csv::read()
+	template<typename T>
+	class TextSource : public Source<T>
+	{
+	public:
+		TextSource(std::string_view path, const Csv::Options& options = Csv::Options())
+			: m_stream(std::string(path), std::ios::binary), m_execution{ options.execution }
+		{
+			if (!m_stream.is_open())
+				throw std::runtime_error(std::format("Could not open file: {}", path));
+
+			// The header and the first data line, which gives the number of columns
+			size_t dataLine = std::string::npos;
+			while (true) {
+				std::vector<std::string> names;
+				const char* end = m_text.data() + m_text.size();
+				const char* data = Csv::Detail::skipPreamble(m_text.data(), end, options, names);
+				for (const char* p = data; p < end && this->complete(p); p = Csv::Detail::nextLine(p, end)) {
+					if (Csv::Detail::holdsData(p, end, options.delimiter, options.comment)) {
+						dataLine = (size_t)(p - m_text.data());
+						break;
+					}
+				}
+				if (dataLine != std::string::npos || m_done) {
+					m_begin = (size_t)(data - m_text.data());
+					m_layout = Csv::Detail::layoutOf(data, end, options, names);
+					break;
+				}
+				this->fill();
+			}
+			m_rowShape = Shape{ m_layout.nColumns };
+		}
+
+		ndArray<T> read(size_t nRows) override
+		{
+			// Whole data lines, reading more text until there are enough of them
+			size_t rows = 0;
+			size_t p = m_begin;
+			while (rows < nRows) {
+				const char* text = m_text.data();
+				const char* end = text + m_text.size();
+				if (p == m_text.size() || !this->complete(text + p)) {
+					if (m_done)
+						break;
+					const size_t consumed = m_begin;
+					this->fill();
+					p -= consumed;
+					continue;
+				}
+				rows += Csv::Detail::holdsData(text + p, end, m_layout.delimiter, m_layout.comment);
+				p = (size_t)(Csv::Detail::nextLine(text + p, end) - text);
+			}
+
+			ndArray<T> block = Csv::Detail::parseRows<T>(m_text.data() + m_begin, m_text.data() + p, m_layout, m_execution, m_row);
+			m_begin = p;
+			m_row += rows;
+			return block;
+		}
+
+		const Shape& rowShape()const override { return m_rowShape; }
+
+	private:
+		// Whether the line at p ends within the text read so far
+		bool complete(const char* p)const
+		{
+			return m_done || std::memchr(p, '\n', (size_t)(m_text.data() + m_text.size() - p)) != nullptr;
+		}
+
+		// Drops the text before m_begin, and reads more
+		void fill()
+		{
+			m_text.erase(0, m_begin);
+			m_begin = 0;
+
+			const size_t size = m_text.size();
+			const size_t more = std::max<size_t>(readSize, size);
+			m_text.resize(size + more);
+			m_stream.read(m_text.data() + size, (std::streamsize)more);
+			m_text.resize(size + (size_t)m_stream.gcount());
+			m_done = m_stream.eof();
+		}
+
+		static constexpr size_t readSize = 1 << 20;
+
+	private:
+		std::ifstream m_stream;
+		Execution m_execution;
+		Csv::Detail::Layout m_layout{ ',', '#', {} };
+		Shape m_rowShape;
+		std::string m_text;
+		size_t m_begin = 0;
+		size_t m_row = 0;
+		bool m_done = false;
+	};
+
+
+	//--------------------------
+	// Blocks
+	// -------------------------
+
+	/*
+		Iterates a source in blocks of rowsPerBlock rows, the last of which may be shorter. With prefetching, the next block
+		is read on another thread while the current one is used, which holds at most two blocks in memory.
+
+			ndArray<double> block;
+			while (blocks.next(block)) { ... }
+	*/
+	template<typename T>
+	class Blocks
+	{
+	public:
+		Blocks(std::unique_ptr<Source<T>> source, size_t rowsPerBlock, bool prefetch = true)
+			: m_source{ std::move(source) }, m_rowsPerBlock{ rowsPerBlock }, m_prefetch{ prefetch }
+		{
+			assert(rowsPerBlock > 0);
+		}
+
+		static Blocks npy(std::string_view path, size_t rowsPerBlock, bool prefetch = true)
+		{
+			return Blocks(std::make_unique<NpySource<T>>(path), rowsPerBlock, prefetch);
+		}
+		static Blocks text(std::string_view path, size_t rowsPerBlock, const Csv::Options& options = Csv::Options(), bool prefetch = true)
+		{
+			return Blocks(std::make_unique<TextSource<T>>(path, options), rowsPerBlock, prefetch);
+		}
+
+		// Moves the next block into block, or returns false at the end
+		bool next(ndArray<T>& block)
+		{
+			block = m_pending.valid() ? m_pending.get() : m_source->read(m_rowsPerBlock);
+			m_firstRow += m_rows;
+			m_rows = (block.size() == 0) ? 0 : block.size() / std::max<size_t>(1, this->rowLength());
+			if (m_rows == 0)
+				return false;
+
+			if (m_prefetch) {
+				Source<T>* source = m_source.get();
+				const size_t rowsPerBlock = m_rowsPerBlock;
+				m_pending = std::async(std::launch::async, [source, rowsPerBlock]() { return source->read(rowsPerBlock); });
+			}
+			return true;
+		}
+
+		// The index of the first row of the current block in the file
+		size_t firstRow()const { return m_firstRow; }
+
+		const Shape& rowShape()const { return m_source->rowShape(); }
+		size_t rowLength()const
+		{
+			size_t n = 1;
+			for (int dim : this->rowShape()) n *= (size_t)dim;
+			return n;
+		}
+
+	private:
+		std::unique_ptr<Source<T>> m_source;
+		std::future<ndArray<T>> m_pending;
+		size_t m_rowsPerBlock;
+		size_t m_firstRow = 0;
+		size_t m_rows = 0;
+		bool m_prefetch;
+	};
+
+
+	//--------------------------
+	// Transforms
+	// -------------------------
+
+	// Calls fn(block, firstRow) for every block
+	template<typename T, typename Function>
+	void forEach(Blocks<T>& blocks, Function fn)
+	{
+		ndArray<T> block;
+		while (blocks.next(block)) {
+			fn(block, blocks.firstRow());
+		}
+	}
+
+	/*
+		Calls fn(block) to change every block in place, and passes the changed blocks to sink(block) in order, e.g. to write
+		them to an Npy::Writer with -1 rows, or to Csv::write() with append set.
+	*/
+	template<typename T, typename Function, typename Sink>
+	void transform(Blocks<T>& blocks, Function fn, Sink sink)
+	{
+		ndArray<T> block;
+		while (blocks.next(block)) {
+			fn(block);
+			sink(static_cast<const ndArray<T>&>(block));
+		}
+	}
+
+
+	//--------------------------
+	// Reductions
+	// -------------------------
+
+	/*
+		Reduces along an axis with the operation, block by block. Along axis 0 all rows fold into a single row of rowLength()
+		elements, along axis 1 each row folds into a single value, which gives one value per row of the file.
+	*/
+	template<typename T, typename Operation>
+	ndArray<T> reduce(Blocks<T>& blocks, int axis, T initValue, Operation op)
+	{
+		assert(axis == 0 || axis == 1);
+		const size_t rowLength = blocks.rowLength();
+		Memory::Buffer<T> out((axis == 0) ? rowLength : 0, initValue);
+
+		ndArray<T> block;
+		while (blocks.next(block)) {
+			const T* data = block.data();
+			const size_t nRows = block.size() / rowLength;
+			if (axis == 0) {
+				for (size_t i = 0; i < nRows; i++) {
+					for (size_t j = 0; j < rowLength; j++) {
+						out[j] = op(out[j], data[i * rowLength + j]);
+					}
+				}
+			}
+			else {
+				for (size_t i = 0; i < nRows; i++) {
+					T acc = initValue;
+					for (size_t j = 0; j < rowLength; j++) {
+						acc = op(acc, data[i * rowLength + j]);
+					}
+					out.push_back(acc);
+				}
+			}
+		}
+		const int length = (int)out.size();
+		return ndArray<T>(std::move(out), Shape{ length });
+	}
+
+	/*
+		The count, sum, extremes, mean and variance of every column, that is of every element of a row, over all rows.
+		Means and variances are kept with Welford's method and merged with Chan's formula, which stays accurate over
+		billions of rows where a sum of squares would not.
+	*/
+	template<typename T>
+	class Summary
+	{
+	public:
+		using Real = std::conditional_t<std::is_floating_point_v<T>, T, double>;
+
+		Summary() = default;
+		explicit Summary(size_t rowLength)
+			: m_sum(rowLength, Real(0)), m_mean(rowLength, Real(0)), m_m2(rowLength, Real(0)),
+			m_min(rowLength, std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max()),
+			m_max(rowLength, std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest())
+		{
+		}
+
+		// Adds nRows rows of rowLength() elements each
+		Summary& add(const T* rows, size_t nRows)
+		{
+			if (nRows == 0)
+				return *this;
+			const size_t rowLength = m_sum.size();
+			Summary part(rowLength);
+			part.m_count = nRows;
+			for (size_t i = 0; i < nRows; i++) {
+				const T* row = rows + i * rowLength;
+				for (size_t j = 0; j < rowLength; j++) {
+					part.m_sum[j] += (Real)row[j];
+					part.m_min[j] = std::min(part.m_min[j], row[j]);
+					part.m_max[j] = std::max(part.m_max[j], row[j]);
+				}
+			}
+			for (size_t j = 0; j < rowLength; j++) {
+				part.m_mean[j] = part.m_sum[j] / (Real)nRows;
+			}
+			for (size_t i = 0; i < nRows; i++) {
+				const T* row = rows + i * rowLength;
+				for (size_t j = 0; j < rowLength; j++) {
+					const Real delta = (Real)row[j] - part.m_mean[j];
+					part.m_m2[j] += delta * delta;
+				}
+			}
+			return this->merge(part);
+		}
+
+		// Adds the rows of the block, in parallel chunks which are merged in order
+		Summary& add(const ndArray<T>& block, Execution execution = Parallel::defaultExecution())
+		{
+			const size_t rowLength = m_sum.size();
+			const size_t nRows = (rowLength == 0) ? 0 : block.size() / rowLength;
+			std::vector<Summary> parts = Parallel::mapChunks<Summary>(nRows * rowLength, execution, [&](size_t begin, size_t end) {
+				// The rows that start in the chunk
+				const size_t first = (begin + rowLength - 1) / rowLength;
+				const size_t last = (end + rowLength - 1) / rowLength;
+				Summary part(rowLength);
+				part.add(block.data() + first * rowLength, last - first);
+				return part;
+			});
+			for (const Summary& part : parts) {
+				this->merge(part);
+			}
+			return *this;
+		}
+
+		Summary& merge(const Summary& other)
+		{
+			if (other.m_count == 0)
+				return *this;
+			if (m_count == 0)
+				return *this = other;
+
+			const Real n = (Real)(m_count + other.m_count);
+			const Real weight = (Real)m_count * (Real)other.m_count / n;
+			for (size_t j = 0; j < m_sum.size(); j++) {
+				const Real delta = other.m_mean[j] - m_mean[j];
+				m_mean[j] += delta * (Real)other.m_count / n;
+				m_m2[j] += other.m_m2[j] + delta * delta * weight;
+				m_sum[j] += other.m_sum[j];
+				m_min[j] = std::min(m_min[j], other.m_min[j]);
+				m_max[j] = std::max(m_max[j], other.m_max[j]);
+			}
+			m_count += other.m_count;
+			return *this;
+		}
+
+		size_t count()const { return m_count; }
+		ndArray<Real> sum()const { return toArray(m_sum); }
+		ndArray<Real> mean()const { return toArray(m_mean); }
+		ndArray<T> min()const { return toArray(m_min); }
+		ndArray<T> max()const { return toArray(m_max); }
+
+		// Divided by count() - ddof, so 1 gives the unbiased sample variance
+		ndArray<Real> variance(int ddof = 0)const
+		{
+			std::vector<Real> out(m_m2.size());
+			for (size_t j = 0; j < out.size(); j++) {
+				out[j] = m_m2[j] / (Real)((long long)m_count - ddof);
+			}
+			return toArray(out);
+		}
+		ndArray<Real> standardDeviation(int ddof = 0)const
+		{
+			ndArray<Real> out = this->variance(ddof);
+			for (Real& value : out) {
+				value = std::sqrt(value);
+			}
+			return out;
+		}
+
+	private:
+		template<typename U>
+		static ndArray<U> toArray(const std::vector<U>& values)
+		{
+			return ndArray<U>(Memory::Buffer<U>(values.begin(), values.end()), Shape{ (int)values.size() });
+		}
+
+	private:
+		size_t m_count = 0;
+		std::vector<Real> m_sum;
+		std::vector<Real> m_mean;
+		std::vector<Real> m_m2;
+		std::vector<T> m_min;
+		std::vector<T> m_max;
+	};
+
+	template<typename T>
+	Summary<T> summarize(Blocks<T>& blocks, Execution execution = Parallel::defaultExecution())
+	{
+		Summary<T> summary(blocks.rowLength());
+		ndArray<T> block;
+		while (blocks.next(block)) {
+			summary.add(block, execution);
+		}
+		return summary;
+	}
+}
+}
@@ -0,0 +1,302 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <assert.h>
+#include "Simd.h"
+#include "Parallel.h"
+#include "ndView.h"
+
+namespace Cnum
+{
+namespace Transpose
+{
+	/*
+		How is a matrix transposed?
+			Reading the rows of the source means writing the columns of the destination, which touches a new cache line for
+			every element. Instead the matrix is split in halves along its longer side, recursively, until the blocks are small
+			enough for both the source and destination lines of a block to stay in the L1 cache, whatever its size is.
+			The blocks are in turn transposed in 8x8 (32 bit elements) or 4x4 (64 bit elements) tiles held in vector registers.
+
+		How is an N-d array permuted?
+			The source is contiguous along its last axis and the destination along the source axis that becomes its last axis.
+			Hence any permutation is a batch of 2d transposes of the planes spanned by these two axes, or, if the last axis
+			stays last, a batch of contiguous row copies.
+	*/
+
+	// Blocks with at most this many rows and columns are transposed directly
+	constexpr size_t leafSize = 64;
+
+	// dst[j * ldd + i] = src[i * lds + j] for a rows x cols block
+	template<typename T>
+	void blockScalar(const T* src, size_t lds, T* dst, size_t ldd, size_t rows, size_t cols)
+	{
+		for (size_t i = 0; i < rows; i++) {
+			for (size_t j = 0; j < cols; j++) {
+				dst[j * ldd + i] = src[i * lds + j];
+			}
+		}
+	}
+
+#if CNUM_SIMD_X86
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+namespace Detail
+{
+	CNUM_TARGET("avx2") inline void tile(const float* src, size_t lds, float* dst, size_t ldd)
+	{
+		__m256 r0 = _mm256_loadu_ps(src + 0 * lds);
+		__m256 r1 = _mm256_loadu_ps(src + 1 * lds);
+		__m256 r2 = _mm256_loadu_ps(src + 2 * lds);
+		__m256 r3 = _mm256_loadu_ps(src + 3 * lds);
+		__m256 r4 = _mm256_loadu_ps(src + 4 * lds);
+		__m256 r5 = _mm256_loadu_ps(src + 5 * lds);
+		__m256 r6 = _mm256_loadu_ps(src + 6 * lds);
+		__m256 r7 = _mm256_loadu_ps(src + 7 * lds);
+
+		// Interleave pairs of rows, then pairs of pairs, and finally swap the 128 bit halves
+		__m256 t0 = _mm256_unpacklo_ps(r0, r1);
+		__m256 t1 = _mm256_unpackhi_ps(r0, r1);
+		__m256 t2 = _mm256_unpacklo_ps(r2, r3);
+		__m256 t3 = _mm256_unpackhi_ps(r2, r3);
+		__m256 t4 = _mm256_unpacklo_ps(r4, r5);
+		__m256 t5 = _mm256_unpackhi_ps(r4, r5);
+		__m256 t6 = _mm256_unpacklo_ps(r6, r7);
+		__m256 t7 = _mm256_unpackhi_ps(r6, r7);
+
+		__m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+		__m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+		__m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+		__m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+		_mm256_storeu_ps(dst + 0 * ldd, _mm256_permute2f128_ps(s0, s4, 0x20));
+		_mm256_storeu_ps(dst + 1 * ldd, _mm256_permute2f128_ps(s1, s5, 0x20));
+		_mm256_storeu_ps(dst + 2 * ldd, _mm256_permute2f128_ps(s2, s6, 0x20));
+		_mm256_storeu_ps(dst + 3 * ldd, _mm256_permute2f128_ps(s3, s7, 0x20));
+		_mm256_storeu_ps(dst + 4 * ldd, _mm256_permute2f128_ps(s0, s4, 0x31));
+		_mm256_storeu_ps(dst + 5 * ldd, _mm256_permute2f128_ps(s1, s5, 0x31));
+		_mm256_storeu_ps(dst + 6 * ldd, _mm256_permute2f128_ps(s2, s6, 0x31));
+		_mm256_storeu_ps(dst + 7 * ldd, _mm256_permute2f128_ps(s3, s7, 0x31));
+	}
+
+	CNUM_TARGET("avx2") inline void tile(const double* src, size_t lds, double* dst, size_t ldd)
+	{
+		__m256d r0 = _mm256_loadu_pd(src + 0 * lds);
+		__m256d r1 = _mm256_loadu_pd(src + 1 * lds);
+		__m256d r2 = _mm256_loadu_pd(src + 2 * lds);
+		__m256d r3 = _mm256_loadu_pd(src + 3 * lds);
+
+		__m256d t0 = _mm256_unpacklo_pd(r0, r1);
+		__m256d t1 = _mm256_unpackhi_pd(r0, r1);
+		__m256d t2 = _mm256_unpacklo_pd(r2, r3);
+		__m256d t3 = _mm256_unpackhi_pd(r2, r3);
+
+		_mm256_storeu_pd(dst + 0 * ldd, _mm256_permute2f128_pd(t0, t2, 0x20));
+		_mm256_storeu_pd(dst + 1 * ldd, _mm256_permute2f128_pd(t1, t3, 0x20));
+		_mm256_storeu_pd(dst + 2 * ldd, _mm256_permute2f128_pd(t0, t2, 0x31));
+		_mm256_storeu_pd(dst + 3 * ldd, _mm256_permute2f128_pd(t1, t3, 0x31));
+	}
+
+	// Elements of 4 or 8 bytes are moved as floats or doubles, since the tiles only move bits
+	template<typename T>
+	inline void blockTiled(const T* src, size_t lds, T* dst, size_t ldd, size_t rows, size_t cols)
+	{
+		using Bits = std::conditional_t<sizeof(T) == 4, float, double>;
+		constexpr size_t W = 32 / sizeof(T);
+
+		size_t i = 0;
+		for (; i + W <= rows; i += W) {
+			size_t j = 0;
+			for (; j + W <= cols; j += W) {
+				tile((const Bits*)(src + i * lds + j), lds, (Bits*)(dst + j * ldd + i), ldd);
+			}
+			blockScalar(src + i * lds + j, lds, dst + j * ldd + i, ldd, W, cols - j);
+		}
+		blockScalar(src + i * lds, lds, dst + i, ldd, rows - i, cols);
+	}
+
+	template<typename T>
+	CNUM_TARGET("avx2") CNUM_FLATTEN void blockAvx2(const T* src, size_t lds, T* dst, size_t ldd, size_t rows, size_t cols)
+	{
+		blockTiled(src, lds, dst, ldd, rows, cols);
+	}
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif
+
+	template<typename T>
+	using BlockKernel = void(*)(const T*, size_t, T*, size_t, size_t, size_t);
+
+	template<typename T>
+	BlockKernel<T> blockKernel()
+	{
+#if CNUM_SIMD_X86
+		if constexpr (std::is_trivially_copyable_v<T> && (sizeof(T) == 4 || sizeof(T) == 8)) {
+			if (Simd::activeIsa() != Simd::Isa::Scalar)
+				return &Detail::blockAvx2<T>;
+		}
+#endif
+		return &blockScalar<T>;
+	}
+
+	// Halves the longer side until the block is a leaf
+	template<typename T>
+	void recurse(const T* src, size_t lds, T* dst, size_t ldd, size_t rows, size_t cols, BlockKernel<T> block)
+	{
+		if (rows <= leafSize && cols <= leafSize) {
+			block(src, lds, dst, ldd, rows, cols);
+		}
+		else if (rows >= cols) {
+			const size_t half = rows / 2;
+			recurse(src, lds, dst, ldd, half, cols, block);
+			recurse(src + half * lds, lds, dst + half, ldd, rows - half, cols, block);
+		}
+		else {
+			const size_t half = cols / 2;
+			recurse(src, lds, dst, ldd, rows, half, block);
+			recurse(src + half, lds, dst + half * ldd, ldd, rows, cols - half, block);
+		}
+	}
+
+
+	//--------------------------
+	// Interface
+	// -------------------------
+
+	// Writes the transpose of the rows x cols matrix src to dst. Rows are lds apart in src, and the cols rows of dst ldd apart
+	template<typename T>
+	void transpose2d(const T* src, size_t lds, T* dst, size_t ldd, size_t rows, size_t cols, Execution execution = Parallel::defaultExecution())
+	{
+		BlockKernel<T> block = blockKernel<T>();
+		Parallel::forChunks(rows, execution, [&](size_t begin, size_t end) {
+			recurse(src + begin * lds, lds, dst + begin, ldd, end - begin, cols, block);
+		}, cols);
+	}
+
+	// Transposes the n x n matrix in place, by swapping blocks across the diagonal through a small buffer
+	template<typename T>
+	void inPlaceSquare(T* data, size_t n)
+	{
+		constexpr size_t B = leafSize;
+		BlockKernel<T> block = blockKernel<T>();
+		std::vector<T> buffer(std::min(n, B) * std::min(n, B));
+
+		for (size_t bi = 0; bi < n; bi += B) {
+			const size_t rows = std::min(B, n - bi);
+
+			for (size_t i = bi; i < bi + rows; i++) {
+				for (size_t j = i + 1; j < bi + rows; j++) {
+					std::swap(data[i * n + j], data[j * n + i]);
+				}
+			}
+
+			for (size_t bj = bi + B; bj < n; bj += B) {
+				const size_t cols = std::min(B, n - bj);
+				T* upper = data + bi * n + bj;
+				T* lower = data + bj * n + bi;
+
+				block(upper, n, buffer.data(), rows, rows, cols);
+				block(lower, n, upper, n, cols, rows);
+				for (size_t r = 0; r < cols; r++) {
+					std::copy(buffer.data() + r * rows, buffer.data() + (r + 1) * rows, lower + r * n);
+				}
+			}
+		}
+	}
+
+	/*
+		Writes src, of the given shape, to dst with its axes permuted so that axis j of dst is axis permutation[j] of src.
+		src and dst must not overlap.
+	*/
+	template<typename T>
+	void permute(const T* src, T* dst, const Shape& shape, const Shape& permutation,
+		Execution execution = Parallel::defaultExecution())
+	{
+		const int rank = (int)shape.size();
+		assert((int)permutation.size() == rank && rank > 0);
+
+		Shape newShape(rank);
+		for (int j = 0; j < rank; j++) {
+			newShape[j] = shape[permutation[j]];
+		}
+
+		// The stride in src, and in dst, of every axis of src
+		Shape srcStrides(rank, 1);
+		Shape dstStrides(rank, 1);
+		Shape newStrides(rank, 1);
+		for (int i = rank - 2; i >= 0; i--) {
+			srcStrides[i] = srcStrides[i + 1] * shape[i + 1];
+			newStrides[i] = newStrides[i + 1] * newShape[i + 1];
+		}
+		for (int j = 0; j < rank; j++) {
+			dstStrides[permutation[j]] = newStrides[j];
+		}
+
+		const int srcInner = rank - 1;
+		const int dstInner = permutation[rank - 1];
+
+		// The remaining axes select one plane, or one row, at a time
+		Shape outerShape, outerSrcStrides, outerDstStrides;
+		for (int i = 0; i < rank; i++) {
+			if (i == srcInner || i == dstInner)
+				continue;
+			outerShape.push_back(shape[i]);
+			outerSrcStrides.push_back(srcStrides[i]);
+			outerDstStrides.push_back(dstStrides[i]);
+		}
+
+		size_t nOuter = 1;
+		for (int d : outerShape) {
+			nOuter *= d;
+		}
+		if (nOuter == 0 || shape[srcInner] == 0 || shape[dstInner] == 0)
+			return;
+
+		std::vector<std::ptrdiff_t> srcOffsets(nOuter);
+		std::vector<std::ptrdiff_t> dstOffsets(nOuter);
+		IndexCounter srcCounter(outerShape, outerSrcStrides);
+		IndexCounter dstCounter(outerShape, outerDstStrides);
+		for (size_t k = 0; k < nOuter; k++) {
+			srcOffsets[k] = srcCounter.offset();
+			dstOffsets[k] = dstCounter.offset();
+			srcCounter.next();
+			dstCounter.next();
+		}
+
+		if (dstInner == srcInner) {
+			const size_t rowLength = (size_t)shape[srcInner];
+			Parallel::forChunks(nOuter, execution, [&](size_t begin, size_t end) {
+				for (size_t k = begin; k < end; k++) {
+					std::copy(src + srcOffsets[k], src + srcOffsets[k] + rowLength, dst + dstOffsets[k]);
+				}
+			}, rowLength);
+			return;
+		}
+
+		const size_t rows = (size_t)shape[dstInner];
+		const size_t cols = (size_t)shape[srcInner];
+		if (nOuter == 1) {
+			transpose2d(src, (size_t)srcStrides[dstInner], dst, (size_t)dstStrides[srcInner], rows, cols, execution);
+			return;
+		}
+		Parallel::forChunks(nOuter, execution, [&](size_t begin, size_t end) {
+			for (size_t k = begin; k < end; k++) {
+				transpose2d(src + srcOffsets[k], (size_t)srcStrides[dstInner], dst + dstOffsets[k], (size_t)dstStrides[srcInner],
+					rows, cols, Execution::Serial);
+			}
+		}, rows * cols);
+	}
+}
+}
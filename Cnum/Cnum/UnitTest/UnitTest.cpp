@@ -1,7 +1,11 @@
 #include "pch.h"
 #include "CppUnitTest.h"
+#include <filesystem>
+#include <fstream>
 #include "../Cnum.h"
 #include "../ndArray.h"
+#include "../Box.h"
+#include "../kdTree.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -32,6 +36,85 @@ namespace UnitTest
 			Assert::IsTrue(res2.isEqualTo(arr2));
 		}
 
+		TEST_METHOD(Test_box)
+		{
+			Box<double, 3> box({ 0.0, 0.0, 0.0 }, { 1.0, 2.0, 3.0 });
+			Assert::IsTrue(box.contains(Vector3<double>(1.0, 2.0, 3.0)) && !box.contains(Vector3<double>(1.0, 2.5, -0.1)));
+			Assert::AreEqual(6.0, box.volume());
+			Assert::IsTrue(box.center() == Vector3<double>(0.5, 1.0, 1.5));
+
+			Box<double, 3> other({ 0.5, 1.0, 3.0 }, { 4.0, 4.0, 4.0 });
+			Assert::IsTrue(box.overlaps(other) && other.overlaps(box));
+			Assert::IsTrue(box.intersect(other) == Box<double, 3>({ 0.5, 1.0, 3.0 }, { 1.0, 2.0, 3.0 }));
+			Assert::IsTrue(box.unite(other) == Box<double, 3>({ 0.0, 0.0, 0.0 }, { 4.0, 4.0, 4.0 }));
+			Assert::IsTrue(box.unite(other).contains(box) && !box.contains(other));
+
+			// A box that has no corner inside the other, but crosses it
+			Box<double, 3> cross({ -1.0, 0.5, 0.5 }, { 2.0, 1.0, 1.0 });
+			Assert::IsTrue(box.overlaps(cross));
+
+			// Empty boxes
+			Box<double, 3> apart({ 5.0, 5.0, 5.0 }, { 6.0, 6.0, 6.0 });
+			Assert::IsTrue(!box.overlaps(apart) && box.intersect(apart).isEmpty() && box.intersect(apart).volume() == 0.0);
+			Assert::IsTrue(Box<double, 3>().isEmpty() && Box<double, 3>().unite(box) == box);
+
+			// Batched tests, with enough points for the vector loop and a remainder
+			for (const int n : { 1, 7, 100, 1000 }) {
+				fArray points(Shape{ n,3 }, 0.0f);
+				for (int i = 0; i < (int)points.size(); i++) {
+					points.data()[i] = (float)((i * 37) % 11) - 3.0f;
+				}
+				Box<float, 3> region({ -2.0f, -1.0f, 0.0f }, { 4.0f, 5.0f, 6.0f });
+				ndMask inside = region.contains(points);
+				Simd::setMaxIsa(Simd::Isa::Scalar);
+				ndMask scalar = region.contains(points);
+				Simd::setMaxIsa(Simd::Isa::Avx512);
+				Assert::IsTrue(inside.isEqualTo(scalar));
+				for (int i = 0; i < n; i++) {
+					Assert::AreEqual(region.contains(points.data() + 3 * i), inside.test(i));
+				}
+				Assert::IsTrue(inside.count() > 0 || n == 1);
+			}
+			Assert::IsTrue(Box<int, 2>::bounding(Array::initializedArray<int>({ 3,1, -2,4, 0,0 }, { 3,2 })) == Box<int, 2>(FixedArray<int, 2>(-2, 0), FixedArray<int, 2>(3, 4)));
+
+			std::vector<Box<double, 3>> boxes{ other, apart, cross, box };
+			ndMask overlapping = box.overlaps(boxes);
+			Assert::IsTrue(overlapping.test(0) && !overlapping.test(1) && overlapping.test(2) && overlapping.test(3));
+		}
+
+		TEST_METHOD(Test_broadcast)
+		{
+			dArray points = Array::initializedArray<double>({ 1,2,3, 4,5,6, 7,8,9, 10,11,12 }, { 4,3 });
+			dArray offset = Array::initializedArray<double>({ 1,2,3 }, { 1,3 });
+			dArray scale = Array::initializedArray<double>({ 1,2,3,4 }, { 4,1 });
+
+			// A row is repeated for every row, and a column for every column
+			dArray moved = points - offset;
+			Assert::IsTrue(moved.isEqualTo(Array::initializedArray<double>({ 0,0,0, 3,3,3, 6,6,6, 9,9,9 }, { 4,3 })));
+
+			dArray outer = scale * offset;
+			Assert::IsTrue(outer.isEqualTo(Array::initializedArray<double>({ 1,2,3, 2,4,6, 3,6,9, 4,8,12 }, { 4,3 })));
+
+			dArray nested = (points - offset) / scale + 1.0;
+			Assert::IsTrue(nested.isEqualTo(Array::initializedArray<double>({ 1,1,1, 2.5,2.5,2.5, 3,3,3, 3.25,3.25,3.25 }, { 4,3 })));
+
+			// A view of the first column, of shape (4,1), is repeated along the rows
+			dArray shifted = points + points.slice(1, 0, 1);
+			Assert::IsTrue(shifted.isEqualTo(Array::initializedArray<double>({ 2,3,4, 8,9,10, 14,15,16, 20,21,22 }, { 4,3 })));
+
+			points -= offset;
+			Assert::IsTrue(points.isEqualTo(moved));
+
+			// Comparisons and blending
+			ndMask above = moved > Array::initializedArray<double>({ 1,5,8 }, { 1,3 });
+			Assert::AreEqual((size_t)6, above.count());
+			Assert::IsTrue(above.test(3) && !above.test(4) && above.test(6) && !above.test(8));
+
+			dArray blended = moved;
+			blended.blend_if(offset, scale > 2.5);
+			Assert::IsTrue(blended.isEqualTo(Array::initializedArray<double>({ 0,0,0, 3,3,3, 1,2,3, 1,2,3 }, { 4,3 })));
+		}
+
 		TEST_METHOD(Test_concatenation)
 		{
 			iArray arr = Array::uniformArray({ 3,3 }, 0);
@@ -59,6 +142,107 @@ namespace UnitTest
 				auto result = Array::initializedArray<int>({ 0,0,1,2,3,0,0,4,5,6,0,0,7,8,9,0,0,10,11,12 }, { 2,2,5 });
 				Assert::IsTrue(arr.isEqualTo(result));
 			}
+			{
+				// Many arrays at once, of different widths
+				iArray a = Array::initializedArray<int>({ 1,2,3,4 }, { 2,2 });
+				iArray b = Array::initializedArray<int>({ 5,6 }, { 2,1 });
+				iArray c = Array::initializedArray<int>({ 7,8,9,10,11,12 }, { 2,3 });
+				iArray joined = Array::concatenate<int>({ a, b, c }, 1);
+				Assert::IsTrue(joined.isEqualTo(Array::initializedArray<int>({ 1,2,5,7,8,9,3,4,6,10,11,12 }, { 2,6 })));
+				Assert::IsTrue(Array::concatenate<int>({ a, a }, 0).isEqualTo(Array::initializedArray<int>({ 1,2,3,4,1,2,3,4 }, { 4,2 })));
+				Assert::IsTrue(Array::hstack<int>({ a, b }).isEqualTo(Array::initializedArray<int>({ 1,2,5,3,4,6 }, { 2,3 })));
+			}
+			{
+				// New axes, and 1d arrays
+				iArray x{ 1,2,3 };
+				iArray y{ 4,5,6 };
+				Assert::IsTrue(Array::stack<int>({ x, y }, 0).isEqualTo(Array::initializedArray<int>({ 1,2,3,4,5,6 }, { 2,3 })));
+				Assert::IsTrue(Array::stack<int>({ x, y }, 1).isEqualTo(Array::initializedArray<int>({ 1,4,2,5,3,6 }, { 3,2 })));
+				Assert::IsTrue(Array::vstack<int>({ x, y, x }).shape() == std::vector<int>({ 3,3 }));
+				Assert::IsTrue(Array::hstack<int>({ x, y }).isEqualTo(iArray{ 1,2,3,4,5,6 }));
+			}
+			{
+				// Hundreds of column blocks
+				std::vector<iArray> blocks;
+				for (int k = 0; k < 300; k++) {
+					blocks.push_back(iArray(std::vector<int>{ 1000, 1 + k % 3 }, k));
+				}
+				iArray features = Array::concatenate(blocks, 1, Execution::Parallel);
+				Assert::IsTrue(features.shape() == std::vector<int>({ 1000, 600 }));
+				Assert::IsTrue(features.at({ 999, 599 }) == 299 && features.at({ 500, 3 }) == 2 && features.at({ 0, 0 }) == 0);
+			}
+		}
+
+		TEST_METHOD(Test_csv)
+		{
+			const std::string text =
+				"# sensor dump\n"
+				"time, x, y, label\n"
+				"0, 1.5, -2, 7\n"
+				"\n"
+				"1, +2.5, 3e2, 8\r\n"
+				"  # paused\n"
+				"2, , 4, 9";
+
+			Csv::Options options;
+			options.header = true;
+			dArray all = Csv::parse<double>(text, options);
+			Assert::IsTrue(all.shape() == std::vector<int>({ 3,4 }));
+			Assert::AreEqual(300.0, all.at({ 1,2 }));
+			Assert::IsTrue(std::isnan(all.at({ 2,1 })));
+
+			options.columnNames = { "y", "time" };
+			options.columns = { 3 };
+			iArray selected = Csv::parse<int>(text, options);
+			Assert::IsTrue(selected.isEqualTo(Array::initializedArray<int>({ 7,-2,0, 8,300,1, 9,4,2 }, { 3,3 })));
+
+			Csv::Options spaces;
+			spaces.delimiter = ' ';
+			Assert::IsTrue(Csv::parse<float>("1 2\t 3 \n4  5 6\n", spaces).isEqualTo(Array::initializedArray<float>({ 1,2,3,4,5,6 }, { 2,3 })));
+
+			bool threw = false;
+			try { Csv::parse<double>("1,2\n3\n"); }
+			catch (const std::runtime_error&) { threw = true; }
+			Assert::IsTrue(threw);
+
+			// Large enough to be parsed in several chunks, which must agree with a serial parse
+			std::string large;
+			for (int i = 0; i < 60000; i++) {
+				large += std::to_string(i) + "," + std::to_string(i * 0.25) + ((i % 1000 == 0) ? "\n# checkpoint\n" : "\n");
+			}
+			Csv::Options parallel;
+			parallel.execution = Execution::Parallel;
+			dArray rows = Csv::parse<double>(large, parallel);
+			Assert::IsTrue(rows.shape() == std::vector<int>({ 60000,2 }));
+			Assert::AreEqual(59999 * 0.25, rows.at({ 59999,1 }));
+			parallel.execution = Execution::Serial;
+			Assert::IsTrue(rows.isEqualTo(Csv::parse<double>(large, parallel)));
+
+			// Written by toFile, and read back from the file
+			const std::string path = (std::filesystem::temp_directory_path() / "cnum_test.txt").string();
+			dArray table = Array::initializedArray<double>({ 1,2,3,4,5,6 }, { 2,3 });
+			toFile(path, table);
+			Assert::IsTrue(fromFile<double>(path).isEqualTo(table));
+			std::filesystem::remove(path);
+
+			// Writing, where higher ranks are written as rows of the last axis
+			Csv::WriteOptions format;
+			format.header = { "a", "b" };
+			Assert::AreEqual(std::string("a,b\n0.1,-2\n3,1e+20\n"), Csv::format(Array::initializedArray<double>({ 0.1,-2,3,1e20 }, { 2,2 }), format));
+			format.header.clear();
+			format.delimiter = ' ';
+			format.precision = 2;
+			format.notation = std::chars_format::fixed;
+			Assert::AreEqual(std::string("0.33 1.00\n2.50 -1.00\n"), Csv::format(Array::initializedArray<float>({ 1 / 3.0f, 1, 2.5f, -1 }, { 2,2 }), format));
+			iArray cube = Array::initializedArray<int>({ 1,2,3,4,5,6,7,8 }, { 2,2,2 });
+			Assert::AreEqual(std::string("1,2\n3,4\n5,6\n7,8\n"), Csv::format(cube));
+
+			Csv::WriteOptions exact;
+			exact.execution = Execution::Parallel;
+			const std::string written = Csv::format(rows, exact);
+			exact.execution = Execution::Serial;
+			Assert::IsTrue(written == Csv::format(rows, exact));
+			Assert::IsTrue(Csv::parse<double>(written).isEqualTo(rows));
 		}
 
 		TEST_METHOD(Test_erase) {
@@ -72,6 +256,36 @@ namespace UnitTest
 			Assert::IsTrue(arr2.isEqualTo(iArray{ 1,3,4,5,5 }));
 		}
 
+		TEST_METHOD(Test_expression) {
+			iArray a = Array::initializedArray<int>({ 1,2,3,4,5,6 }, { 2,3 });
+			iArray b = Array::initializedArray<int>({ 2,2,2,3,3,3 }, { 2,3 });
+			iArray c = Array::initializedArray<int>({ 1,0,1,0,1,0 }, { 2,3 });
+
+			iArray res = a * b + c * 2 - a;
+			Assert::IsTrue(res.isEqualTo(Array::initializedArray<int>({ 3,2,5,8,12,12 }, { 2,3 })));
+
+			// Assigning an expression referring to the target itself
+			a = -(a + b) / 2;
+			Assert::IsTrue(a.isEqualTo(Array::initializedArray<int>({ -1,-2,-2,-3,-4,-4 }, { 2,3 })));
+
+			dArray d{ 1.5, 2.5 };
+			auto sum = (d + d).eval();
+			Assert::IsTrue(sum.isEqualTo(dArray{ 3.0, 5.0 }));
+
+			// Compound assignments update the array in place
+			const int* storage = b.data();
+			b += c;
+			b *= 3;
+			b -= c * 2 + 1;
+			b /= 2;
+			Assert::IsTrue(b.isEqualTo(Array::initializedArray<int>({ 3,2,3,4,4,4 }, { 2,3 })));
+			Assert::IsTrue(storage == b.data());
+
+			d -= 0.5;
+			d *= d;
+			Assert::IsTrue(d.isEqualTo(dArray{ 1.0, 4.0 }));
+		}
+
 		TEST_METHOD(Test_find) {
 			iArray arr = Array::initializedArray<int>({ 2,4,2,2,6,2,6,1,36,2563,6,2,36, 13,2,13 }, { 2,2,4 });
 			iArray indices = arr.find(arr > 2);
@@ -101,6 +315,58 @@ namespace UnitTest
 			Assert::IsTrue(indices2.isEqualTo(res2));
 		}
 
+		TEST_METHOD(Test_fixedArray)
+		{
+			constexpr Vector3<double> x{ 1.0, 0.0, 0.0 };
+			constexpr Vector3<double> y{ 0.0, 1.0, 0.0 };
+			static_assert(cross(x, y) == Vector3<double>(0.0, 0.0, 1.0));
+			static_assert(dot(x + y, y * 2.0) == 2.0);
+			static_assert(Matrix3<int>::identity().at(2, 2) == 1 && Matrix3<int>::count == 9);
+
+			FixedArray<int, 2, 3> a{ 1,2,3,4,5,6 };
+			FixedArray<int, 3, 2> b = transpose(a);
+			Assert::IsTrue(matrixMul(a, b) == FixedArray<int, 2, 2>(14, 32, 32, 77));
+			Assert::IsTrue(matrixMul(Matrix3<int>::identity(), Vector3<int>(4, 5, 6)) == Vector3<int>(4, 5, 6));
+
+			// To and from ndArray
+			iArray arr = a.toArray();
+			Assert::IsTrue(arr.isEqualTo(Array::initializedArray<int>({ 1,2,3,4,5,6 }, { 2,3 })));
+			Assert::IsTrue((FixedArray<int, 2, 3>(arr) == a));
+			Assert::IsTrue((Vector3<int>(iArray{ 7,8,9 }) == Vector3<int>(7, 8, 9)));
+
+			// Rotations
+			const Vector3<double> rotated = Quaternion<double>::fromAxisAngle({ 0.0, 0.0, 2.0 }, Constants::pi / 2).rotate({ 2.0, 0.0, 0.0 });
+			Assert::AreEqual(0.0, rotated[0], 1e-12);
+			Assert::AreEqual(2.0, rotated[1], 1e-12);
+			Assert::AreEqual(0.0, rotated[2], 1e-12);
+
+			Quaternion<double> q = Quaternion<double>::fromAxisAngle({ 1.0, 2.0, 3.0 }, 0.7);
+			Vector3<double> p{ 0.5, -1.0, 2.0 };
+			Vector3<double> viaProduct = (q * p * q.inverse()).imag();
+			Assert::AreEqual(0.0, (viaProduct - q.rotate(p)).norm(), 1e-12);
+			Assert::AreEqual(p.norm(), q.rotate(p).norm(), 1e-12);
+
+			dArray point{ 0.0, 1.0, 0.0 };
+			point.rotate(Rotation::Axis::X, Rotation::Degrees(90.0));
+			Assert::AreEqual(1.0, point.data()[2], 1e-12);
+			Assert::AreEqual(0.0, point.data()[1], 1e-12);
+		}
+
+		TEST_METHOD(Test_indexing)
+		{
+			iArray arr = Array::initializedArray<int>({ 1,2,3,4,5,6,7,8,9,10,11,12 }, { 2,2,3 });
+			Assert::IsTrue(arr.at({ 1,0,2 }) == 9);
+			Assert::IsTrue(arr.argMax().isEqualTo(iArray{ 1,1,2 }));
+
+			// The strides follow the shape through reshapes and transposes
+			arr.reshape({ 3,4 });
+			Assert::IsTrue(arr.getStride(0) == 4);
+			Assert::IsTrue(arr.at({ 2,1 }) == 10);
+			arr.transpose();
+			Assert::IsTrue(arr.getStride(0) == 3);
+			Assert::IsTrue(arr.at({ 1,2 }) == 10);
+		}
+
 		TEST_METHOD(Test_insert)
 		{
 
@@ -131,6 +397,173 @@ namespace UnitTest
 			}
 		}
 
+		TEST_METHOD(Test_kdTree)
+		{
+			const int n = 5000;
+			dArray points(Shape{ n,3 }, 0.0);
+			unsigned state = 12345;
+			for (int i = 0; i < (int)points.size(); i++) {
+				state = state * 1664525u + 1013904223u;
+				points.data()[i] = (state >> 8) % 1000 / 10.0;
+			}
+			kdTree<double> tree(points, 8);
+			Assert::AreEqual(n, tree.size());
+
+			// Every node covers its children, and the leaves hold the points in order
+			for (const auto& node : tree.nodes()) {
+				if (node.isLeaf()) {
+					Assert::IsTrue(node.end - node.begin <= 8);
+				}
+				else {
+					const auto& left = tree.nodes()[&node - tree.nodes().data() + 1];
+					const auto& right = tree.nodes()[node.right];
+					Assert::IsTrue(left.begin == node.begin && left.end == right.begin && right.end == node.end);
+					for (int i = node.begin; i < node.end; i++) {
+						Assert::IsTrue(i < left.end ? tree.axis(node.axis)[i] <= node.split : tree.axis(node.axis)[i] >= node.split);
+					}
+				}
+			}
+
+			const double boxes[][6] = { { 10,20,30, 40,60,50 }, { 0,0,0, 100,100,100 }, { 50,50,50, 50.5,99,51 }, { 70,10,0, 60,20,100 } };
+			for (const auto& box : boxes) {
+				std::vector<int> expected;
+				for (int i = 0; i < n; i++) {
+					bool inside = true;
+					for (int k = 0; k < 3; k++) {
+						inside &= box[k] <= points.at({ i,k }) && points.at({ i,k }) <= box[3 + k];
+					}
+					if (inside) expected.push_back(i);
+				}
+				iArray found = tree.query(box, box + 3);
+				std::vector<int> sorted(found.begin(), found.end());
+				std::sort(sorted.begin(), sorted.end());
+				Assert::IsTrue(sorted == expected);
+				Assert::IsTrue(tree.query(Box<double, 3>(box, box + 3)).isEqualTo(found));
+			}
+
+			// Nearest neighbours and radius searches against brute force, where the coarse grid makes ties common
+			const int m = 200, k = 7;
+			dArray queries(Shape{ m,3 }, 0.0);
+			for (int i = 0; i < (int)queries.size(); i++) {
+				state = state * 1664525u + 1013904223u;
+				queries.data()[i] = (state >> 8) % 1100 / 10.0 - 5.0;
+			}
+			auto nearest = tree.knn(queries, k);
+			Assert::IsTrue(nearest.indices.shape() == std::vector<int>({ m,k }) && nearest.distances.shape() == std::vector<int>({ m,k }));
+			for (int q = 0; q < m; q++) {
+				std::vector<std::pair<double, int>> all;
+				for (int i = 0; i < n; i++) {
+					double squared = 0;
+					for (int a = 0; a < 3; a++) {
+						const double diff = points.at({ i,a }) - queries.at({ q,a });
+						squared = squared + diff * diff;
+					}
+					all.push_back({ squared, i });
+				}
+				std::sort(all.begin(), all.end());
+				for (int j = 0; j < k; j++) {
+					Assert::AreEqual(all[j].second, nearest.indices.at({ q,j }));
+					Assert::AreEqual(std::sqrt(all[j].first), nearest.distances.at({ q,j }));
+				}
+
+				iArray close = tree.radius(queries.data() + 3 * q, 6.0);
+				std::vector<int> sorted(close.begin(), close.end()), expected;
+				std::sort(sorted.begin(), sorted.end());
+				for (const auto& [squared, i] : all) {
+					if (squared <= 36.0) expected.push_back(i);
+				}
+				std::sort(expected.begin(), expected.end());
+				Assert::IsTrue(sorted == expected);
+			}
+			Assert::IsTrue(tree.radius(queries, 6.0)[17].isEqualTo(tree.radius(queries.data() + 3 * 17, 6.0)));
+
+			Simd::setMaxIsa(Simd::Isa::Scalar);
+			auto scalar = tree.knn(queries, k);
+			Simd::setMaxIsa(Simd::Isa::Avx512);
+			Assert::IsTrue(scalar.indices.isEqualTo(nearest.indices));
+			Assert::IsTrue(std::ranges::equal(scalar.distances, nearest.distances));
+
+			// A parallel build and parallel batches of queries give the same result as serially
+			dArray many(Shape{ 60000,3 }, 0.0);
+			for (int i = 0; i < (int)many.size(); i++) {
+				state = state * 1664525u + 1013904223u;
+				many.data()[i] = (state >> 8) % 1000 / 10.0;
+			}
+			kdTree<double> parallel(many, 16, Execution::Parallel);
+			kdTree<double> serial(many, 16, Execution::Serial);
+			Assert::AreEqual(serial.nodes().size(), parallel.nodes().size());
+			for (size_t i = 0; i < serial.nodes().size(); i++) {
+				const auto& a = serial.nodes()[i];
+				const auto& b = parallel.nodes()[i];
+				Assert::IsTrue(a.begin == b.begin && a.end == b.end && a.axis == b.axis && a.split == b.split && a.right == b.right);
+			}
+			for (int i = 0; i < serial.size(); i++) {
+				Assert::AreEqual(serial.index(i), parallel.index(i));
+			}
+
+			auto batched = parallel.knn(queries, k, Execution::Parallel);
+			Assert::IsTrue(batched.indices.isEqualTo(serial.knn(queries, k, Execution::Serial).indices));
+			auto inRadius = parallel.radius(queries, 2.0, Execution::Parallel);
+			auto inRadiusSerial = serial.radius(queries, 2.0, Execution::Serial);
+			std::vector<Box<double, 3>> regions;
+			for (int q = 0; q < m; q++) {
+				Assert::IsTrue(inRadius[q].isEqualTo(inRadiusSerial[q]));
+				regions.emplace_back(queries.data() + 3 * q, queries.data() + 3 * q);
+				for (int a = 0; a < 3; a++) regions.back().high(a) += 3.0;
+			}
+			auto inBoxes = parallel.query(regions, Execution::Parallel);
+			for (int q = 0; q < m; q++) {
+				Assert::IsTrue(inBoxes[q].isEqualTo(parallel.query(regions[q])));
+			}
+
+			// Identical points cannot be split
+			kdTree<float> same(fArray(Shape{ 100,2 }, 1.0f), 4);
+			Assert::AreEqual((size_t)1, same.nodes().size());
+			Assert::AreEqual((size_t)100, same.query(fArray{ 1,1 }, fArray{ 2,2 }).size());
+			Assert::AreEqual((size_t)100, same.radius(fArray{ 1,1 }.data(), 0.0f).size());
+
+			// More neighbours than points
+			kdTree<float> few(Array::initializedArray<float>({ 0,0, 3,4 }, { 2,2 }));
+			auto all = few.knn(fArray{ 0,0 }, 3);
+			Assert::IsTrue(all.indices.isEqualTo(iArray{ 0,1,-1 }));
+			Assert::IsTrue(all.distances.at({ 1 }) == 5.0f && std::isinf(all.distances.at({ 2 })));
+		}
+
+		TEST_METHOD(Test_mask)
+		{
+			// Spans two full words and a partial one
+			iArray arr = Array::arange<int>(0, 130, 1);
+			iArray halves = arr / 2 * 2;
+			ndMask even = halves == arr;
+			ndMask large = arr >= 100;
+
+			Assert::AreEqual((size_t)65, even.count());
+			Assert::AreEqual((size_t)30, large.count());
+			Assert::AreEqual((size_t)15, (even && large).count());
+			Assert::AreEqual((size_t)80, (even || large).count());
+			Assert::AreEqual((size_t)65, (even ^ large).count());
+			Assert::AreEqual((size_t)65, (!even).count());
+			Assert::IsTrue((even || !even).all());
+			Assert::IsFalse((even && !even).any());
+
+			// Selection, blending and erasing with a mask
+			iArray selected = arr[large && even];
+			Assert::IsTrue(selected.isEqualTo(Array::arange<int>(100, 130, 2)));
+
+			iArray blended = arr;
+			blended.blend_if(iArray(std::vector<int>{ 1, 130 }, -1), !even);
+			Assert::AreEqual(64 * 65 - 65, blended.reduce(0, std::plus<>()));
+
+			iArray kept = arr;
+			kept.erase_if(arr < 120 || !even);
+			Assert::IsTrue(kept.isEqualTo(iArray{ 120,122,124,126,128 }));
+
+			// A mask still converts to an array of 0s and 1s
+			iArray flags = large;
+			Assert::AreEqual(30, flags.reduce(0, std::plus<>()));
+			Assert::IsTrue(arr.find(large).isEqualTo(arr.find(large.toArray())));
+		}
+
 		TEST_METHOD(Test_matMul) {
 
 			iArray arr = { {1,2,3,4,5,6,7,8,9}, {3,3} };
@@ -145,6 +578,115 @@ namespace UnitTest
 
 			Assert::IsTrue(result.isEqualTo(correctResult));
 
+			// The inner dimension differs from the number of rows
+			iArray tall = { {1,2,3,4,5,6}, {3,2} };
+			iArray wide = { {1,2,3,4,5,6,7,8}, {2,4} };
+			iArray tallResult = Array::initializedArray<int>({
+				11,14,17,20,
+				23,30,37,44,
+				35,46,57,68 }, { 3,4 });
+			Assert::IsTrue(matrixMul(tall, wide).isEqualTo(tallResult));
+
+			// Sizes which are not multiples of the block sizes, with transposes, alpha and beta
+			const int m = 103, n = 70, k = 300;
+			auto value = [](int i, int j) { return (double)((i * 31 + j * 17) % 23) / 7.0 - 1.5; };
+			dArray A(std::vector<int>{ k, m }, 0.0);
+			dArray B(std::vector<int>{ n, k }, 0.0);
+			dArray C(std::vector<int>{ m, n }, 0.0);
+			for (int i = 0; i < k * m; i++) A.data()[i] = value(i / m, i % m);
+			for (int i = 0; i < n * k; i++) B.data()[i] = value(i % k + 5, i / k);
+			for (int i = 0; i < m * n; i++) C.data()[i] = value(i, 3);
+
+			dArray expected = C;
+			for (int i = 0; i < m; i++) {
+				for (int j = 0; j < n; j++) {
+					double sum = 0;
+					for (int p = 0; p < k; p++) {
+						sum += A.data()[p * m + i] * B.data()[j * k + p];
+					}
+					expected.data()[i * n + j] = 2.0 * sum - 0.5 * C.data()[i * n + j];
+				}
+			}
+
+			gemm(true, true, 2.0, A, B, -0.5, C);
+			Assert::IsTrue(C.isEqualTo(expected));
+
+			fArray Af(std::vector<int>{ m, k }, 0.0f);
+			fArray Bf(std::vector<int>{ k, n }, 0.0f);
+			for (int i = 0; i < m * k; i++) Af.data()[i] = (float)value(i / k, i % k);
+			for (int i = 0; i < k * n; i++) Bf.data()[i] = (float)value(i / n + 5, i % n);
+			fArray product = matrixMul(Af, Bf);
+			for (int i = 0; i < m; i += 17) {
+				for (int j = 0; j < n; j += 13) {
+					float sum = 0;
+					for (int p = 0; p < k; p++) {
+						sum += Af.data()[i * k + p] * Bf.data()[p * n + j];
+					}
+					Assert::AreEqual(sum, product.data()[i * n + j], 1e-3f);
+				}
+			}
+
+		}
+
+		TEST_METHOD(Test_memory)
+		{
+			auto isAligned = [](const void* p) { return reinterpret_cast<size_t>(p) % Memory::alignment == 0; };
+
+			fArray values = Array::linspace<float>(0.0f, 1.0f, 1001);
+			Assert::IsTrue(isAligned(values.data()));
+			Assert::IsTrue(isAligned((values * 2.0f).eval().data()));
+
+			// Everything made in the scope is bump allocated from the arena, including copies
+			Memory::Arena arena(1 << 16);
+			{
+				Memory::ScopedResource scope(arena);
+				fArray doubled = values * 2.0f;
+				fArray copy = values;
+				Assert::IsTrue(doubled.buffer().get_allocator().resource() == &arena);
+				Assert::IsTrue(copy.buffer().get_allocator().resource() == &arena);
+				Assert::IsTrue(isAligned(doubled.data()) && isAligned(copy.data()));
+				Assert::AreEqual(2.0f, doubled.data()[1000]);
+				Assert::IsTrue(copy.isEqualTo(values));
+			}
+			Assert::IsTrue(values.buffer().get_allocator().resource() == &Memory::aligned());
+			arena.reset();
+
+			// An array from outside the scope that is assigned a result inside it keeps its own memory
+			fArray kept;
+			{
+				Memory::ScopedResource scope(arena);
+				kept = values * 2.0f;
+			}
+			arena.reset();
+			Assert::IsTrue(kept.buffer().get_allocator().resource() == &Memory::aligned());
+			Assert::AreEqual(2.0f, kept.data()[1000]);
+
+			// The elements still copy out to a plain vector
+			std::vector<float> plain = values.raw();
+			Assert::IsTrue(plain.size() == values.size() && plain[1000] == values.data()[1000]);
+
+			// After a reset the same memory is handed out again
+			const size_t reserved = arena.bytesReserved();
+			const float* first = nullptr;
+			for (int frame = 0; frame < 3; frame++) {
+				{
+					Memory::ScopedResource scope(arena);
+					fArray temporary = values + 1.0f;
+					if (frame == 0) first = temporary.data();
+					Assert::IsTrue(first == temporary.data());
+					Assert::AreEqual(2.0f, temporary.data()[1000]);
+				}
+				arena.reset();
+			}
+			Assert::AreEqual(reserved, arena.bytesReserved());
+
+			// Large blocks in huge pages
+			{
+				Memory::ScopedResource scope(Memory::hugePages());
+				dArray large((size_t)1 << 19, 1.0);
+				Assert::IsTrue(isAligned(large.data()));
+				Assert::AreEqual((double)(1 << 19), large.reduce(0.0, std::plus<>()));
+			}
 		}
 
 		TEST_METHOD(Test_norm) {
@@ -157,6 +699,114 @@ namespace UnitTest
 			Assert::IsTrue(arr2.isEqualTo(fArray{1.41421, 2.23606, 5}));
 		}
 
+		TEST_METHOD(Test_npy)
+		{
+			const std::string npyPath = (std::filesystem::temp_directory_path() / "cnum_test.npy").string();
+			const std::string npzPath = (std::filesystem::temp_directory_path() / "cnum_test.npz").string();
+
+			dArray arr(Shape{ 2,3,4 }, 0.0);
+			for (int i = 0; i < (int)arr.size(); i++) {
+				arr.data()[i] = i * 0.5 - 3;
+			}
+			Npy::save(npyPath, arr);
+			dArray loaded = Npy::load<double>(npyPath);
+			Assert::IsTrue(loaded.shape() == arr.shape());
+			Assert::IsTrue(loaded.isEqualTo(arr));
+
+			// Mapped in place, and converted while loading
+			{
+				Npy::Mapped<double> mapped = Npy::map<double>(npyPath);
+				Assert::IsTrue(mapped.shape() == arr.shape());
+				Assert::AreEqual(arr.data()[17], mapped.data()[17]);
+				Assert::IsTrue(mapped.toArray().isEqualTo(arr));
+				Assert::IsTrue(mapped.view().slice(2, 1, 2).eval().isEqualTo(arr.view().slice(2, 1, 2).eval()));
+			}
+			fArray asFloat = Npy::load<float>(npyPath);
+			Assert::AreEqual(-3.0f, asFloat.data()[0]);
+			Assert::AreEqual(8.5f, asFloat.data()[23]);
+
+			iArray line{ 4,-5,6 };
+			Npy::save(npyPath, line);
+			iArray lineLoaded = Npy::load<int>(npyPath);
+			Assert::AreEqual(1, lineLoaded.nDims());
+			Assert::IsTrue(lineLoaded.isEqualTo(line));
+
+			// Column major and big endian files, as numpy may write them
+			{
+				std::ofstream file(npyPath, std::ios::binary);
+				const std::string header = Npy::encodeHeader(">i4", Shape{ 2,3 }, true);
+				file.write(header.data(), header.size());
+				for (int i = 0; i < 6; i++) {
+					const char bytes[4] = { 0, 0, 0, (char)i };
+					file.write(bytes, 4);
+				}
+			}
+			iArray fortran = Npy::load<int>(npyPath);
+			Assert::IsTrue(fortran.isEqualTo(Array::initializedArray<int>({ 0,2,4,1,3,5 }, { 2,3 })));
+			{
+				std::ofstream file(npyPath, std::ios::binary);
+				const std::string header = Npy::encodeHeader(Npy::descrOf<int>(), Shape{ 2,3 }, true);
+				file.write(header.data(), header.size());
+				for (int i = 0; i < 6; i++) {
+					file.write(reinterpret_cast<const char*>(&i), sizeof(int));
+				}
+			}
+			Assert::IsTrue(Npy::load<int>(npyPath).isEqualTo(fortran));
+			Assert::IsTrue(Npy::map<int>(npyPath).toArray().isEqualTo(fortran));
+
+			Npy::ArchiveWriter writer(npzPath);
+			writer.add("points", arr).add("line", line);
+			writer.close();
+
+			Npy::Archive archive(npzPath);
+			Assert::IsTrue(archive.names() == std::vector<std::string>{ "points", "line" });
+			Assert::IsTrue(archive.load<double>("points").isEqualTo(arr));
+			Assert::IsTrue(archive.load<int>("line.npy").isEqualTo(line));
+			Assert::IsTrue(archive.map<double>("points").toArray().isEqualTo(arr));
+
+			std::filesystem::remove(npyPath);
+			std::filesystem::remove(npzPath);
+		}
+
+		TEST_METHOD(Test_parallel)
+		{
+			// Large enough to be split into several chunks
+			const int n = 300001;
+			iArray arr((size_t)n);
+			for (int i = 0; i < n; i++) {
+				arr.data()[i] = (int)((int64_t)i * 7919 % 100003) - 50000;
+			}
+			iArray copy = arr;
+
+			Assert::AreEqual(arr.reduce(0, std::plus<>(), Execution::Serial), arr.reduce(0, std::plus<>(), Execution::Parallel));
+			Assert::AreEqual(arr.min(Execution::Serial), arr.min(Execution::Parallel));
+			Assert::AreEqual(arr.max(Execution::Serial), arr.max(Execution::Parallel));
+
+			iArray serial = (arr * 3 - copy).eval(Execution::Serial);
+			iArray parallel = (arr * 3 - copy).eval(Execution::Parallel);
+			Assert::IsTrue(serial.isEqualTo(parallel));
+
+			iArray sorted = copy;
+			sorted.sort(Execution::Serial);
+			arr.sort(Execution::Parallel);
+			Assert::IsTrue(sorted.isEqualTo(arr));
+
+			// Along an axis the lanes are spread over the threads
+			copy.erase(0).reshape({ 500, 600 });
+			iArray serialLanes = copy;
+			iArray parallelLanes = copy;
+			serialLanes.sort(0, Execution::Serial);
+			parallelLanes.sort(0, Execution::Parallel);
+			Assert::IsTrue(serialLanes.isEqualTo(parallelLanes));
+			Assert::IsTrue(copy.argSort(1, Execution::Serial).isEqualTo(copy.argSort(1, Execution::Parallel)));
+
+			// Floating point reductions are the same from one run to another
+			dArray values = Array::linspace<double>(0.0, 1.0, n);
+			double sum = values.reduce(0.0, std::plus<>(), Execution::Parallel);
+			Assert::AreEqual(sum, values.reduce(0.0, std::plus<>(), Execution::Parallel));
+			Assert::AreEqual(n / 2.0, sum, 1e-6);
+		}
+
 		TEST_METHOD(Test_raiseTo) 
 		{
 			iArray arr{ 1,2,3,4 };
@@ -192,6 +842,49 @@ namespace UnitTest
 			Assert::IsTrue(res3.isEqualTo(arr3));
 		}
 
+		TEST_METHOD(Test_reductions)
+		{
+			iArray arr = Array::arange<int>(0, 24, 1).reshape({ 2,3,4 });
+
+			// A fold starts from the initial value, whatever the operation
+			iArray signs{ -1, 3, -2, 5 };
+			Assert::AreEqual(2, signs.reduce(0, [](int count, int v) { return count + (v > 0); }));
+			Assert::AreEqual(39, signs.reduce(0, [](int acc, int v) { return acc + v * v; }));
+
+			Assert::IsTrue(arr.sum({ 0 }).isEqualTo(Array::initializedArray<int>({ 12,14,16,18,20,22,24,26,28,30,32,34 }, { 3,4 })));
+			Assert::IsTrue(arr.sum({ 0,2 }).isEqualTo(iArray{ 60,92,124 }));
+			Assert::IsTrue(arr.sum({ 1 }, true).isEqualTo(Array::initializedArray<int>({ 12,15,18,21,48,51,54,57 }, { 2,1,4 })));
+			Assert::IsTrue(arr.sum({}).isEqualTo(iArray{ 276 }));
+			Assert::IsTrue(arr.max({ 2 }).isEqualTo(Array::initializedArray<int>({ 3,7,11,15,19,23 }, { 2,3 })));
+			Assert::IsTrue(arr.min({ 0,1 }).isEqualTo(iArray{ 0,1,2,3 }));
+			Assert::IsTrue(arr.mean({ 2 }).isEqualTo(Array::initializedArray<int>({ 1,5,9,13,17,21 }, { 2,3 })));
+			Assert::IsTrue((arr + 1).eval().prod({ 0 }).isEqualTo(Array::initializedArray<int>({ 13,28,45,64,85,108,133,160,189,220,253,288 }, { 3,4 })));
+
+			dArray values = Array::initializedArray<double>({ 3,0,4,1,-2,1,0,2,-2 }, { 3,3 });
+			Assert::IsTrue(values.norm({ 1 }, false).isEqualTo(dArray{ 5,std::sqrt(6.0),std::sqrt(8.0) }));
+			Assert::IsTrue(values.argMin(0).isEqualTo(iArray{ 2,1,2 }));
+			Assert::IsTrue(values.argMax(1, true).isEqualTo(Array::initializedArray<int>({ 2,0,1 }, { 3,1 })));
+			Assert::IsTrue(values.any({ 0 }).isEqualTo(ndMask({ 1,3 }, true)));
+			Assert::IsTrue(values.all({ 1 }).count() == 1);
+
+			// Per column statistics of a tall array, split between the threads
+			iArray tall(std::vector<int>{ 100000, 16 }, 0);
+			for (int i = 0; i < (int)tall.size(); i++) {
+				tall.data()[i] = (int)((int64_t)i * 7919 % 1009) - 500;
+			}
+			Assert::IsTrue(tall.sum({ 0 }, false, Execution::Parallel).isEqualTo(tall.sum({ 0 }, false, Execution::Serial)));
+			Assert::IsTrue(tall.min({ 0 }, false, Execution::Parallel).isEqualTo(tall.min({ 0 }, false, Execution::Serial)));
+			Assert::IsTrue(tall.argMax(0, false, Execution::Parallel).isEqualTo(tall.argMax(0, false, Execution::Serial)));
+			Assert::IsTrue(tall.max({ 1 }, false, Execution::Parallel).isEqualTo(tall.max({ 1 }, false, Execution::Serial)));
+
+			iArray column = tall.sum({ 0 }).reshape({ 16 });
+			int expected = 0;
+			for (int i = 0; i < 100000; i++) {
+				expected += tall.data()[i * 16 + 5];
+			}
+			Assert::AreEqual(expected, column.at(5));
+		}
+
 		TEST_METHOD(Test_reverse) {
 			iArray arr{ 1,2,3,4 }; 
 			arr.reverse();
@@ -204,6 +897,111 @@ namespace UnitTest
 
 		}
 
+		TEST_METHOD(Test_rotate)
+		{
+			// A cloud of points, long enough for whole vector blocks and a partial one
+			const int n = 1001;
+			dArray points(std::vector<int>{ n, 3 }, 0.0);
+			for (int i = 0; i < 3 * n; i++) {
+				points.data()[i] = std::sin(0.37 * i);
+			}
+
+			// By a single quaternion
+			const Quaternion<double> q = Quaternion<double>::fromAxisAngle({ 1.0, -2.0, 0.5 }, 1.1);
+			dArray rotated = points;
+			rotated.rotate(q, Execution::Parallel);
+			for (int i = 0; i < n; i++) {
+				const Vector3<double> expected = q.rotate({ points.at({ i,0 }), points.at({ i,1 }), points.at({ i,2 }) });
+				for (int c = 0; c < 3; c++) {
+					Assert::AreEqual(expected[c], rotated.at({ i,c }), 1e-12);
+				}
+			}
+
+			// By one quaternion per point, here the inverse rotation for every point
+			dArray inverses(std::vector<int>{ n, 4 }, 0.0);
+			for (int i = 0; i < n; i++) {
+				inverses.at({ i,0 }) = q.real();
+				for (int c = 0; c < 3; c++) {
+					inverses.at({ i,c + 1 }) = -q.imag()[c];
+				}
+			}
+			rotated.rotate(inverses, Execution::Parallel);
+			for (int i = 0; i < 3 * n; i++) {
+				Assert::AreEqual(points.data()[i], rotated.data()[i], 1e-12);
+			}
+
+			// A single point keeps its orientation
+			dArray column = Array::initializedArray<double>({ 1,0,0 }, { 3,1 });
+			column.rotate(Quaternion<double>::fromAxisAngle({ 0.0, 0.0, 1.0 }, Constants::pi));
+			Assert::IsTrue(column.shape() == Shape({ 3,1 }));
+			Assert::AreEqual(-1.0, column.data()[0], 1e-12);
+		}
+
+		TEST_METHOD(Test_shape)
+		{
+			Shape shape{ 2,3,4 };
+			Assert::IsTrue(shape == std::vector<int>({ 2,3,4 }));
+			shape.insert(shape.begin() + 1, 1);
+			shape.erase(shape.begin());
+			shape.push_back(5);
+			Assert::IsTrue(shape == Shape({ 1,3,4,5 }));
+			std::vector<int> copy = shape;
+			Assert::AreEqual((size_t)4, copy.size());
+
+			// The shape and strides live inside the array, up to the highest rank
+			iArray arr(std::vector<int>(Shape::maxRank, 2), 1);
+			Assert::AreEqual(1 << Shape::maxRank, (int)arr.size());
+			Assert::AreEqual(Shape::maxRank, arr.nDims());
+			arr.at({ 1,1,1,1,1,1,1,1 }) = 7;
+			Assert::AreEqual(7, arr.data()[arr.size() - 1]);
+			Assert::IsTrue(arr.sum({ 0,2,4,6 }).shape() == Shape(4, 2));
+			Assert::IsTrue(arr.argMax().isEqualTo(iArray(std::vector<int>(Shape::maxRank, 1))));
+
+			// Higher ranks are refused rather than truncated
+			bool threw = false;
+			try { iArray tooHigh(std::vector<int>(Shape::maxRank + 1, 2), 1); }
+			catch (const std::length_error&) { threw = true; }
+			Assert::IsTrue(threw);
+			threw = false;
+			try { shape.insert(shape.begin(), (size_t)Shape::maxRank, 1); }
+			catch (const std::length_error&) { threw = true; }
+			Assert::IsTrue(threw && shape == Shape({ 1,3,4,5 }));
+		}
+
+		TEST_METHOD(Test_simd)
+		{
+			// 37 elements, so that every vector width leaves a remainder
+			fArray a = Array::linspace<float>(-9.0f, 9.0f, 37);
+			fArray b = Array::arange<float>(0.0f, 37.0f, 1.0f);
+			iArray c = Array::arange<int>(-18, 19, 1);
+
+			auto compute = [&]() {
+				fArray sum = a + b;
+				fArray quotient = 2.0f / (b + 1.0f);
+				iArray product = c * 3;
+				iArray less = a < b;
+				iArray equal = c == 0;
+				fArray absolute = a;
+				absolute.abs();
+				return std::make_tuple(sum, quotient, product, less, equal, absolute);
+			};
+
+			auto vectorized = compute();
+			Simd::setMaxIsa(Simd::Isa::Scalar);
+			auto scalar = compute();
+			Simd::setMaxIsa(Simd::Isa::Avx512);
+
+			Assert::IsTrue(std::get<0>(vectorized).isEqualTo(std::get<0>(scalar)));
+			Assert::IsTrue(std::get<1>(vectorized).isEqualTo(std::get<1>(scalar)));
+			Assert::IsTrue(std::get<2>(vectorized).isEqualTo(std::get<2>(scalar)));
+			Assert::IsTrue(std::get<3>(vectorized).isEqualTo(std::get<3>(scalar)));
+			Assert::IsTrue(std::get<4>(vectorized).isEqualTo(std::get<4>(scalar)));
+			Assert::IsTrue(std::get<5>(vectorized).isEqualTo(std::get<5>(scalar)));
+
+			Assert::AreEqual(1, std::get<4>(vectorized).reduce(0, std::plus<>()));
+			Assert::AreEqual(9.0f, std::get<5>(vectorized).max());
+			Assert::AreEqual(0.0f, std::get<5>(vectorized).min());
+		}
 		TEST_METHOD(Test_sort)
 		{
 
@@ -280,8 +1078,98 @@ namespace UnitTest
 				Assert::IsTrue(sorted.isEqualTo(result));
 			}
 
+			// Equal values keep their order, along strided and contiguous lanes
+			{
+				iArray ties = Array::initializedArray<int>({ 2,1,2,1,2,1,1,2,0 }, { 3,3 });
+				Assert::IsTrue(ties.argSort(0).isEqualTo(Array::initializedArray<int>({ 1,0,2,2,1,1,0,2,0 }, { 3,3 })));
+				Assert::IsTrue(ties.argSort(1).isEqualTo(Array::initializedArray<int>({ 1,0,2,0,2,1,2,0,1 }, { 3,3 })));
+				Assert::IsTrue(iArray{ 3,1,3,1 }.argsort().isEqualTo(iArray{ 1,3,0,2 }));
+				Assert::IsTrue(dArray{ 0.5,-2.0,0.5,-2.0 }.argsort().isEqualTo(iArray{ 1,3,0,2 }));
+			}
+
+			// Many lanes, spread over the threads
+			{
+				iArray many(std::vector<int>{ 400, 257 }, 0);
+				for (int i = 0; i < (int)many.size(); i++) {
+					many.data()[i] = (i * 7919) % 1009;
+				}
+				iArray rows = many, columns = many;
+				rows.sort(1, Execution::Parallel);
+				columns.sort(0, Execution::Parallel);
+
+				bool sorted = true;
+				for (int i = 0; i < 400; i++) {
+					sorted = sorted && std::is_sorted(rows.data() + i * 257, rows.data() + (i + 1) * 257);
+				}
+				for (int j = 0; j < 257; j++) {
+					for (int i = 1; i < 400; i++) {
+						sorted = sorted && columns.at({ i - 1, j }) <= columns.at({ i, j });
+					}
+				}
+				Assert::IsTrue(sorted);
+				Assert::IsTrue(rows.sum({ 1 }).isEqualTo(many.sum({ 1 })));
+				Assert::IsTrue(columns.sum({ 0 }).isEqualTo(many.sum({ 0 })));
+
+				iArray order = many.argSort(1, Execution::Parallel);
+				Assert::IsTrue(order.at({ 7,0 }) == (int)(std::min_element(many.data() + 7 * 257, many.data() + 8 * 257) - (many.data() + 7 * 257)));
+			}
+		}
+		TEST_METHOD(Test_stream)
+		{
+			const std::string npyPath = (std::filesystem::temp_directory_path() / "cnum_stream.npy").string();
+			const std::string outPath = (std::filesystem::temp_directory_path() / "cnum_stream_out.npy").string();
+			const std::string csvPath = (std::filesystem::temp_directory_path() / "cnum_stream.csv").string();
+
+			dArray arr(Shape{ 1000,3 }, 0.0);
+			for (int i = 0; i < (int)arr.size(); i++) {
+				arr.data()[i] = (i * 7919) % 1009 * 0.5 - 200;
+			}
+			Npy::save(npyPath, arr);
+
+			// Statistics of the columns, a block at a time
+			auto blocks = Stream::Blocks<double>::npy(npyPath, 128);
+			Stream::Summary<double> summary = Stream::summarize(blocks);
+			Assert::AreEqual((size_t)1000, summary.count());
+			Assert::IsTrue(summary.sum().isEqualTo(arr.sum({ 0 })));
+			Assert::IsTrue(summary.min().isEqualTo(arr.min({ 0 })));
+			Assert::IsTrue(summary.max().isEqualTo(arr.max({ 0 })));
+			dArray centered = arr - arr.mean({ 0 }, true);
+			Assert::IsTrue(summary.variance().isEqualTo(dArray(centered * centered).mean({ 0 })));
 
+			auto rows = Stream::Blocks<double>::npy(npyPath, 300);
+			Assert::IsTrue(Stream::reduce(rows, 1, 0.0, std::plus<>()).isEqualTo(arr.sum({ 1 })));
+
+			// Transformed block by block into a file whose length is counted as it is written
+			{
+				Npy::Writer<double> writer(outPath, Shape{ -1,3 });
+				auto in = Stream::Blocks<double>::npy(npyPath, 333);
+				Stream::transform(in, [](dArray& block) { block *= 2.0; }, [&](const dArray& block) { writer.write(block); });
+				writer.close();
+			}
+			Assert::IsTrue(Npy::load<double>(outPath).isEqualTo(arr * 2.0));
+
+			// Text, with blocks that end in the middle of what has been read
+			Csv::WriteOptions format;
+			format.header = { "a", "b", "c" };
+			Csv::write(csvPath, arr, format);
+			Csv::Options options;
+			options.header = true;
+			options.columnNames = { "c", "a" };
+			auto lines = Stream::Blocks<float>::text(csvPath, 77, options);
+			std::vector<fArray> parts;
+			Stream::forEach(lines, [&](const fArray& block, size_t firstRow) {
+				Assert::AreEqual((size_t)(77 * parts.size()), firstRow);
+				parts.push_back(block);
+			});
+			fArray text = Array::concatenate(parts, 0);
+			Assert::IsTrue(text.shape() == std::vector<int>({ 1000,2 }));
+			Assert::AreEqual((float)arr.at({ 999,2 }), text.at({ 999,0 }));
+
+			std::filesystem::remove(npyPath);
+			std::filesystem::remove(outPath);
+			std::filesystem::remove(csvPath);
 		}
+
 		TEST_METHOD(Test_transpose)
 		{
 			{
@@ -298,9 +1186,70 @@ namespace UnitTest
 				dArray answer = Array::initializedArray<double>({ 0.64, 0.87, 0.31, 0.49,0.17, 0.02, 0.34, 0.28, 0.74, 0.29, 0.08, 0.45, 0.60, 0.69, 0.04, 0.23, 0.76, 0.44, 0.89, 0.60 }, { 5,4 });
 				Assert::IsTrue(arr.isEqualTo(answer));
 			}
+			{
+				// Sizes which are not multiples of the tiles, through the blocked kernels
+				fArray arr = Array::arange<float>(0.0f, 70.0f * 131.0f, 1.0f).reshape({ 70, 131 });
+				fArray original = arr;
+				arr.transpose();
+				Assert::IsTrue(arr.shape() == std::vector<int>({ 131, 70 }));
+				bool same = true;
+				for (int i = 0; i < 70; i++) {
+					for (int j = 0; j < 131; j++) {
+						same = same && arr.data()[j * 70 + i] == original.data()[i * 131 + j];
+					}
+				}
+				Assert::IsTrue(same);
+			}
+			{
+				// Square matrices are transposed in place, twice gives the original back
+				dArray arr = Array::arange<double>(0.0, 150.0 * 150.0, 1.0).reshape({ 150, 150 });
+				dArray original = arr;
+				arr.transpose();
+				Assert::IsTrue(arr.at({ 3,97 }) == original.at({ 97,3 }));
+				arr.transpose();
+				Assert::IsTrue(arr.isEqualTo(original));
+			}
+			{
+				// Moving the last axis to the front, and keeping it last
+				iArray arr = Array::arange<int>(0, 24, 1).reshape({ 2,3,4 });
+				iArray front = arr;
+				front.transpose({ 2,0,1 });
+				Assert::IsTrue(front.shape() == std::vector<int>({ 4,2,3 }));
+				Assert::IsTrue(front.at({ 3,1,2 }) == arr.at({ 1,2,3 }));
+				arr.transpose({ 1,0,2 });
+				Assert::IsTrue(arr.isEqualTo(Array::initializedArray<int>({ 0,1,2,3,12,13,14,15,4,5,6,7,16,17,18,19,8,9,10,11,20,21,22,23 }, { 3,2,4 })));
+			}
 
 		}
-		
-		
+
+		TEST_METHOD(Test_view)
+		{
+			iArray arr = Array::initializedArray<int>({ 1,2,3,4,5,6,7,8,9,10,11,12 }, { 3,4 });
+
+			// Every second column, first forwards then backwards
+			auto columns = arr.slice(1, 0, -1, 2);
+			Assert::IsTrue(columns.eval().isEqualTo(Array::initializedArray<int>({ 1,3,5,7,9,11 }, { 3,2 })));
+			auto reversed = arr.slice(1, 0, -1, -2);
+			Assert::IsTrue(reversed.eval().isEqualTo(Array::initializedArray<int>({ 3,1,7,5,11,9 }, { 3,2 })));
+
+			// Views take part in expressions and reductions
+			iArray sum = arr.slice(0, 0, 2) + arr.slice(0, 1, -1);
+			Assert::IsTrue(sum.isEqualTo(Array::initializedArray<int>({ 6,8,10,12,14,16,18,20 }, { 2,4 })));
+			Assert::IsTrue(arr.slice(1, 3).reduce(0, std::plus<>()) == 24);
+
+			// Writing through a view changes the array
+			arr.slice(0, 1, 2).fill(0);
+			Assert::IsTrue(arr.isEqualTo(Array::initializedArray<int>({ 1,2,3,4,0,0,0,0,9,10,11,12 }, { 3,4 })));
+
+			arr.roll(1, 1);
+			Assert::IsTrue(arr.isEqualTo(Array::initializedArray<int>({ 4,1,2,3,0,0,0,0,12,9,10,11 }, { 3,4 })));
+
+			// Assigning a view of an array to the array itself reads every element before it is overwritten
+			iArray sequence{ 1,2,3,4,5,6 };
+			sequence = sequence.slice(1, 0, -1, -1);
+			Assert::IsTrue(sequence.isEqualTo(iArray{ 6,5,4,3,2,1 }));
+			sequence = sequence + sequence.slice(1, 0, -1, -1);
+			Assert::IsTrue(sequence.isEqualTo(iArray{ 7,7,7,7,7,7 }));
+		}
 	};
 }
@@ -1,99 +1,585 @@
 #pragma once
 #include <vector>
-#include <memory>
-#include "Cnum.h"
+#include <numeric>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <type_traits>
+#include <assert.h>
+#include "Shape.h"
+#include "Memory.h"
+#include "Simd.h"
+#include "Box.h"
+#include "Parallel.h"
 
-template<typename objType, typename posType>
-class kdTree
+namespace Cnum
 {
-public:
+	template<typename T>
+	class ndArray;
 
-	kdTree(int dim, Cnum::Rect<posType>& bdry)
-		: m_boundary(bdry), m_dim(dim)
+	/*
+		What is a kd-tree?
+			A binary tree over points in d dimensions. Every node splits its points in two halves at the median along the
+			axis where they are most spread out, until a node holds at most leafSize points, which makes it a leaf.
+			A query only visits the nodes whose region can hold an answer, which for a small box is O(log n) of them.
+
+		How is it laid out?
+			The nodes are stored in one array in depth first order, so the left child of a node is the next node, and each
+			node keeps the index of its right child. The points are reordered to the order of the leaves, such that every
+			node covers a contiguous range of them, and stored one axis after another, so the coordinates of a leaf are d
+			short contiguous runs. The tree holds no pointers.
+
+				kdTree<double> tree(points);                  // points of shape (N, d)
+				iArray inside = tree.query(low, high);        // indices into points, of the points in the box
+				auto nearest = tree.knn(queries, 5);          // the 5 nearest points to each row of queries
+				iArray close = tree.radius(point, 0.5);       // the points within 0.5 of point
+
+		Building takes O(n log n) time: each level of the tree partitions all points with std::nth_element. Large trees are
+		built in parallel, and batches of queries are spread over the thread pool, both with the same result as serially.
+
+		How are the nearest neighbours found?
+			The k best points so far are kept in a max heap, whose top is the distance to beat. The search goes down to the
+			child on the side of the query point first, and visits the other child only if its region is closer than the
+			top of the heap. The offsets from the query point to the region are kept up to date one axis at a time: crossing
+			a split only changes the offset along its axis. The distances to all points of a leaf are computed at once by
+			Simd::squaredDistance, which reads the coordinates one axis after another just as they are stored.
+			Ties are broken by the smaller index, so the result does not depend on the layout of the tree.
+	*/
+	template<typename T>
+	class kdTree
 	{
-		for (int i = 0; i < std::pow(2, dim); i++) {
-			m_children.push_back(nullptr);
+	public:
+
+		struct Node
+		{
+			// The points of the node are [begin, end) in tree order
+			int begin;
+			int end;
+
+			// The split axis, or -1 for a leaf
+			int axis = -1;
+
+			// The points of the left child are at most split along the axis, those of the right child at least split
+			T split = T(0);
+
+			// The left child is the next node
+			int right = -1;
+
+			bool isLeaf()const { return axis < 0; }
+		};
+
+		//--------------------------
+		// Constructors
+		// -------------------------
+
+		// Builds the tree over the rows of the (N, d) array
+		explicit kdTree(const ndArray<T>& points, int leafSize = 16, Execution execution = Parallel::defaultExecution())
+			: m_leafSize{ std::max(1, leafSize) }
+		{
+			assert(points.shape().size() == 2);
+			m_size = points.shape()[0];
+			m_dims = points.shape()[1];
+			assert(m_dims > 0);
+
+			std::vector<int> order((size_t)m_size);
+			std::iota(order.begin(), order.end(), 0);
+			m_nodes.reserve(2 * (size_t)m_size / m_leafSize + 1);
+			if (Parallel::isParallel((size_t)m_size * m_dims, execution)) {
+				this->buildParallel(order, points.data());
+			}
+			else if (m_size > 0) {
+				this->build(order, 0, m_size, points.data(), m_nodes);
+			}
+
+			// Coordinates in tree order, one axis at a time
+			m_points.resize((size_t)m_size * m_dims);
+			Parallel::forChunks((size_t)m_size, execution, [&](size_t begin, size_t end) {
+				for (int k = 0; k < m_dims; k++) {
+					T* axis = m_points.data() + (size_t)k * m_size;
+					for (size_t i = begin; i < end; i++) {
+						axis[i] = points.data()[(size_t)order[i] * m_dims + k];
+					}
+				}
+			}, (size_t)m_dims);
+			m_indices.assign(order.begin(), order.end());
+
+			m_low.assign((size_t)m_dims, std::numeric_limits<T>::max());
+			m_high.assign((size_t)m_dims, std::numeric_limits<T>::lowest());
+			for (int k = 0; k < m_dims; k++) {
+				const T* axis = this->axis(k);
+				for (int i = 0; i < m_size; i++) {
+					m_low[k] = std::min(m_low[k], axis[i]);
+					m_high[k] = std::max(m_high[k], axis[i]);
+				}
+			}
+		}
+
+		//--------------------------
+		// Queries
+		// -------------------------
+
+		// The indices of the points in the closed box [low, high], in tree order
+		ndArray<int> query(const T* low, const T* high)const
+		{
+			Memory::Buffer<int> found;
+			if (m_size > 0) {
+				std::vector<T> regionLow = m_low;
+				std::vector<T> regionHigh = m_high;
+				this->query(0, low, high, regionLow.data(), regionHigh.data(), found);
+			}
+			const int n = (int)found.size();
+			return ndArray<int>(std::move(found), Shape{ n });
+		}
+		ndArray<int> query(const ndArray<T>& low, const ndArray<T>& high)const
+		{
+			assert((int)low.size() == m_dims && (int)high.size() == m_dims);
+			return this->query(low.data(), high.data());
+		}
+		template<int D>
+		ndArray<int> query(const Box<T, D>& box)const
+		{
+			assert(D == m_dims);
+			return this->query(box.data(), box.data() + D);
 		}
-	};
 
-	void insert(objType& object, ndArray_<posType>& pos) {
-		if (!m_boundary.Contains(pos)) {
-			return;
+		// The points in each of the boxes
+		template<int D>
+		std::vector<ndArray<int>> query(const std::vector<Box<T, D>>& boxes, Execution execution = Parallel::defaultExecution())const
+		{
+			std::vector<ndArray<int>> result(boxes.size());
+			Parallel::forChunks(boxes.size(), execution, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++) {
+					result[i] = this->query(boxes[i]);
+				}
+			}, workPerQuery);
+			return result;
 		}
 
-		if (m_objects.size() < m_capacity) {
-			m_objects.push_back(object);
-			m_positions.push_back(pos);
+		// The k nearest points and their distances, nearest first. If the tree has fewer than k points, the missing ones
+		// have index -1 and an infinite distance
+		struct Neighbours
+		{
+			ndArray<int> indices;
+			ndArray<T> distances;
+		};
+
+		// The k nearest points to point, of shape (k)
+		Neighbours knn(const T* point, int k)const
+		{
+			Neighbours result{ ndArray<int>(Shape{ k }, -1), ndArray<T>(Shape{ k }, T(0)) };
+			Search search(*this);
+			search.knn(point, k, result.indices.data(), result.distances.data());
+			return result;
 		}
-		else {
-			if (!m_divided) {
-				Subdivide();
+
+		// The k nearest points to each row of the (M, d) array of points, of shape (M, k)
+		Neighbours knn(const ndArray<T>& points, int k, Execution execution = Parallel::defaultExecution())const
+		{
+			const int m = this->rows(points);
+			Neighbours result{ ndArray<int>(Shape{ m, k }, -1), ndArray<T>(Shape{ m, k }, T(0)) };
+			Parallel::forChunks((size_t)m, execution, [&](size_t begin, size_t end) {
+				Search search(*this);
+				for (size_t i = begin; i < end; i++) {
+					search.knn(points.data() + i * m_dims, k, result.indices.data() + i * k, result.distances.data() + i * k);
+				}
+			}, workPerQuery);
+			return result;
+		}
+
+		// The indices of the points within distance r of point, in tree order
+		ndArray<int> radius(const T* point, T r)const
+		{
+			Memory::Buffer<int> found;
+			Search search(*this);
+			search.radius(point, r, found);
+			const int n = (int)found.size();
+			return ndArray<int>(std::move(found), Shape{ n });
+		}
+
+		// The points within distance r of each row of the (M, d) array of points
+		std::vector<ndArray<int>> radius(const ndArray<T>& points, T r, Execution execution = Parallel::defaultExecution())const
+		{
+			const int m = this->rows(points);
+			std::vector<ndArray<int>> result((size_t)m);
+			Parallel::forChunks((size_t)m, execution, [&](size_t begin, size_t end) {
+				Search search(*this);
+				for (size_t i = begin; i < end; i++) {
+					Memory::Buffer<int> found;
+					search.radius(points.data() + i * m_dims, r, found);
+					const int n = (int)found.size();
+					result[i] = ndArray<int>(std::move(found), Shape{ n });
+				}
+			}, workPerQuery);
+			return result;
+		}
+
+		//--------------------------
+		// Layout
+		// -------------------------
+
+		int size()const { return m_size; }
+		int dims()const { return m_dims; }
+		int leafSize()const { return m_leafSize; }
+
+		const std::vector<Node>& nodes()const { return m_nodes; }
+
+		// The coordinates along the axis of all points, in tree order
+		const T* axis(int k)const { return m_points.data() + (size_t)k * m_size; }
+
+		// The index in the original array of the point at position i in tree order
+		int index(int i)const { return m_indices[i]; }
+
+	private:
+
+		// Splits the points [begin, end) of node at the median along the axis of largest spread, and returns the first point of
+		// the right child, or -1 if the node is a leaf
+		int partition(std::vector<int>& order, int begin, int end, const T* points, Node& node)const
+		{
+			if (end - begin <= m_leafSize)
+				return -1;
+
+			int axis = 0;
+			T widest = T(0);
+			for (int k = 0; k < m_dims; k++) {
+				T low = points[(size_t)order[begin] * m_dims + k];
+				T high = low;
+				for (int i = begin + 1; i < end; i++) {
+					const T value = points[(size_t)order[i] * m_dims + k];
+					low = std::min(low, value);
+					high = std::max(high, value);
+				}
+				if (high - low > widest) {
+					widest = high - low;
+					axis = k;
+				}
 			}
+			if (!(widest > T(0)))
+				return -1;
+
+			const int mid = begin + (end - begin) / 2;
+			std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](int a, int b) {
+				return points[(size_t)a * m_dims + axis] < points[(size_t)b * m_dims + axis];
+			});
 
-			for (auto& child : m_children)
-				child->insert(object, pos);
+			node.axis = axis;
+			node.split = points[(size_t)order[mid] * m_dims + axis];
+			return mid;
 		}
-	}
 
-	std::vector<objType> Query(Cnum::Rect<posType>& query_boundary) {
-		std::vector<objType> found; 
-		return Query(query_boundary, found);
-	}
+		// Appends the subtree over the points [begin, end) to nodes in depth first order, with indices relative to its root
+		int build(std::vector<int>& order, int begin, int end, const T* points, std::vector<Node>& nodes)const
+		{
+			const int node = (int)nodes.size();
+			nodes.push_back(Node{ begin, end });
+			const int mid = this->partition(order, begin, end, points, nodes[node]);
+			if (mid < 0)
+				return node;
 
-	std::vector<objType> Query(Cnum::Rect<posType>& query_boundary, std::vector<objType>& found)
-	{
+			this->build(order, begin, mid, points, nodes);
+			const int right = this->build(order, mid, end, points, nodes);
+			nodes[node].right = right;
+			return node;
+		}
+
+		/*
+			How is the tree built in parallel?
+				Splitting a node only reorders its own points, so the nodes of one level are split at the same time, from the root
+				down until there are several subtrees for each thread. Those are then built as independent tasks, each into its
+				own vector, and finally spliced into the depth first order with their indices shifted. Every node is split
+				exactly as in the serial build, so the tree is identical to it for any number of threads.
+		*/
+		void buildParallel(std::vector<int>& order, const T* points)
+		{
+			const size_t nThreads = ThreadPool::global().nThreads();
+			const int subtreeSize = (int)std::max<size_t>({ (size_t)m_leafSize, Parallel::chunkLength((size_t)m_dims), (size_t)m_size / (8 * nThreads) });
+
+			// The top levels in breadth first order, where the left child of a node is left[node], and a node that is left
+			// to a task has its index in task[node]
+			std::vector<Node> top{ Node{ 0, m_size } };
+			std::vector<int> left{ -1 };
+			std::vector<int> task{ -1 };
+			std::vector<int> tasks;
 
-		if (!m_boundary.IsOverlappingWith(query_boundary)) {
-			return found;
+			std::vector<int> level;
+			auto schedule = [&](int node) {
+				if (top[node].end - top[node].begin > subtreeSize) {
+					level.push_back(node);
+				}
+				else {
+					task[node] = (int)tasks.size();
+					tasks.push_back(node);
+				}
+			};
+			schedule(0);
+
+			while (!level.empty()) {
+				std::vector<int> mids(level.size());
+				ThreadPool::global().run(level.size(), [&](size_t i) {
+					const Node& node = top[level[i]];
+					mids[i] = this->partition(order, node.begin, node.end, points, top[level[i]]);
+				});
+
+				const std::vector<int> current = std::move(level);
+				level.clear();
+				for (size_t i = 0; i < current.size(); i++) {
+					if (mids[i] < 0)
+						continue;
+					const int node = current[i];
+					const int begin = top[node].begin;
+					const int end = top[node].end;
+					left[node] = (int)top.size();
+					top[node].right = (int)top.size() + 1;
+					top.push_back(Node{ begin, mids[i] });
+					top.push_back(Node{ mids[i], end });
+					left.insert(left.end(), { -1, -1 });
+					task.insert(task.end(), { -1, -1 });
+					schedule(left[node]);
+					schedule(top[node].right);
+				}
+			}
+
+			std::vector<std::vector<Node>> subtrees(tasks.size());
+			ThreadPool::global().run(tasks.size(), [&](size_t i) {
+				const Node& node = top[tasks[i]];
+				subtrees[i].reserve(2 * (size_t)(node.end - node.begin) / m_leafSize + 1);
+				this->build(order, node.begin, node.end, points, subtrees[i]);
+			});
+
+			// Depth first, as the serial build orders them
+			auto splice = [&](auto& self, int node) -> int {
+				const int index = (int)m_nodes.size();
+				if (task[node] >= 0) {
+					for (Node n : subtrees[task[node]]) {
+						n.right = n.isLeaf() ? -1 : n.right + index;
+						m_nodes.push_back(n);
+					}
+					return index;
+				}
+				m_nodes.push_back(top[node]);
+				if (m_nodes[index].isLeaf())
+					return index;
+				self(self, left[node]);
+				const int right = self(self, top[node].right);
+				m_nodes[index].right = right;
+				return index;
+			};
+			splice(splice, 0);
 		}
-		else {
-			if (!m_divided) {
-				for (int i = 0; i < m_positions.size(); i++) {
-					if (query_boundary.Contains(m_positions[i])) {
-						found.push_back(m_objects[i]);
+
+		void query(int node, const T* low, const T* high, T* regionLow, T* regionHigh, Memory::Buffer<int>& found)const
+		{
+			const Node& n = m_nodes[node];
+
+			// The whole region is inside the box, or only some of the points of a leaf
+			bool inside = true;
+			for (int k = 0; k < m_dims; k++) {
+				inside &= (low[k] <= regionLow[k]) & (regionHigh[k] <= high[k]);
+			}
+			if (inside) {
+				found.insert(found.end(), m_indices.begin() + n.begin, m_indices.begin() + n.end);
+				return;
+			}
+			if (n.isLeaf()) {
+				for (int i = n.begin; i < n.end; i++) {
+					bool contained = true;
+					for (int k = 0; k < m_dims; k++) {
+						const T value = m_points[(size_t)k * m_size + i];
+						contained &= (low[k] <= value) & (value <= high[k]);
 					}
+					if (contained)
+						found.push_back(m_indices[i]);
 				}
+				return;
+			}
+
+			const int axis = n.axis;
+			if (low[axis] <= n.split) {
+				const T saved = regionHigh[axis];
+				regionHigh[axis] = n.split;
+				this->query(node + 1, low, high, regionLow, regionHigh, found);
+				regionHigh[axis] = saved;
 			}
-			else {
-				for (auto& child : m_children)
-					child->Query(query_boundary, found);
+			if (n.split <= high[axis]) {
+				const T saved = regionLow[axis];
+				regionLow[axis] = n.split;
+				this->query(n.right, low, high, regionLow, regionHigh, found);
+				regionLow[axis] = saved;
 			}
+		}
 
-			return found;
+		// The number of query points in an (M, d) array, where a 1d array is one point
+		int rows(const ndArray<T>& points)const
+		{
+			if (points.nDims() == 1) {
+				assert((int)points.size() == m_dims);
+				return 1;
+			}
+			assert(points.shape().size() == 2 && points.shape()[1] == m_dims);
+			return points.shape()[0];
 		}
-	}
 
+		/*
+			The state of a nearest neighbour or radius search, reused from one query point to the next.
+			The squared distance from the query point to the region of the current node is the sum of the squared offsets
+			along each axis, where the offset is zero if the point is inside the region along that axis.
+		*/
+		class Search
+		{
+		public:
+			explicit Search(const kdTree& tree)
+				: m_tree{ tree }, m_offsets((size_t)tree.m_dims)
+			{
+				static_assert(std::is_floating_point_v<T>, "Distances need a floating point type");
+			}
 
-private:
+			// Writes the k nearest points, nearest first
+			void knn(const T* point, int k, int* indices, T* distances)
+			{
+				m_heap.clear();
+				if (k > 0 && m_tree.m_size > 0) {
+					m_point = point;
+					m_k = (size_t)k;
+					this->start();
+					this->nearest(0);
+				}
 
-	void Subdivide() {
+				std::sort_heap(m_heap.begin(), m_heap.end());
+				for (size_t i = 0; i < (size_t)k; i++) {
+					indices[i] = i < m_heap.size() ? m_heap[i].index : -1;
+					distances[i] = i < m_heap.size() ? std::sqrt(m_heap[i].distance) : std::numeric_limits<T>::infinity();
+				}
+			}
 
-		// Creating the children with smart pointers
-		std::vector<Cnum::Rect> childrenRects = m_boundary.SubDivide();
-		for (int i = 0; i < std::pow(2, m_dim); i++)
-			m_children[i] = std::make_unique<kdTree>(m_dim, childrenRects[i]);
+			// Appends the points within distance r
+			void radius(const T* point, T r, Memory::Buffer<int>& found)
+			{
+				if (m_tree.m_size > 0 && r >= T(0)) {
+					m_point = point;
+					this->start();
+					this->within(0, r * r, found);
+				}
+			}
 
-		// Re-distribute the points in the parent to the children
-		for (int i = 0; i < m_positions.size(); i++) {
-			for (auto& child : m_children)
-				child->insert(m_objects[i], m_positions[i]);
-		}
+		private:
 
-		// Remove all the data from the parent
-		m_objects.clear();
-		m_positions.clear();
-		m_divided = true;
-	}
+			struct Candidate
+			{
+				T distance;
+				int index;
 
-private:
-	Cnum::Rect<posType> m_boundary;
-	int m_capacity = 1; 
-	std::vector<objType> m_objects;
-	std::vector<ndArray_<posType>> m_positions;
-	bool m_divided = false;
-	int m_dim = 0;
+				bool operator<(const Candidate& other)const
+				{
+					return distance < other.distance || (distance == other.distance && index < other.index);
+				}
+			};
 
-	std::vector<std::unique_ptr<kdTree>> m_children; 
-	
-};
+			// The offsets to the bounding box of all points
+			void start()
+			{
+				for (int k = 0; k < m_tree.m_dims; k++) {
+					m_offsets[k] = std::max({ m_tree.m_low[k] - m_point[k], T(0), m_point[k] - m_tree.m_high[k] });
+				}
+			}
 
+			// The squared distance to the current region. It is summed in the same order as the distances to the points, so it
+			// is never above the distance to a point in the region, even after rounding
+			T regionDistance()const
+			{
+				T distance = T(0);
+				for (int k = 0; k < m_tree.m_dims; k++) {
+					distance = distance + m_offsets[k] * m_offsets[k];
+				}
+				return distance;
+			}
+
+			// Visits the near child, then the far one if its region is within bound, with the offset along the split axis
+			// set to the distance to the split
+			template<typename Bound, typename Visit>
+			void descend(const Node& n, int node, Bound bound, Visit visit)
+			{
+				const int axis = n.axis;
+				const T offset = m_point[axis] - n.split;
+				visit(offset <= T(0) ? node + 1 : n.right);
+
+				const T saved = m_offsets[axis];
+				m_offsets[axis] = std::abs(offset);
+				if (this->regionDistance() <= bound()) {
+					visit(offset <= T(0) ? n.right : node + 1);
+				}
+				m_offsets[axis] = saved;
+			}
+
+			// The squared distances to the points [begin, end) of a leaf. Leaves of identical points may exceed the leaf size
+			const T* leafDistances(const Node& n)
+			{
+				if (m_distances.size() < (size_t)(n.end - n.begin))
+					m_distances.resize((size_t)(n.end - n.begin));
+				Simd::squaredDistance(m_tree.m_points.data() + n.begin, (size_t)m_tree.m_size, m_tree.m_dims, (size_t)(n.end - n.begin), m_point, m_distances.data());
+				return m_distances.data();
+			}
+
+			void nearest(int node)
+			{
+				const Node& n = m_tree.m_nodes[node];
+				if (n.isLeaf()) {
+					const T* distances = this->leafDistances(n);
+					for (int i = n.begin; i < n.end; i++) {
+						const Candidate candidate{ distances[i - n.begin], m_tree.m_indices[i] };
+						if (m_heap.size() < m_k) {
+							m_heap.push_back(candidate);
+							std::push_heap(m_heap.begin(), m_heap.end());
+						}
+						else if (candidate < m_heap.front()) {
+							std::pop_heap(m_heap.begin(), m_heap.end());
+							m_heap.back() = candidate;
+							std::push_heap(m_heap.begin(), m_heap.end());
+						}
+					}
+					return;
+				}
+				// A region as far as the worst candidate may still hold a tie with a smaller index
+				auto bound = [this] { return m_heap.size() < m_k ? std::numeric_limits<T>::infinity() : m_heap.front().distance; };
+				this->descend(n, node, bound, [this](int child) { this->nearest(child); });
+			}
+
+			void within(int node, T bound, Memory::Buffer<int>& found)
+			{
+				const Node& n = m_tree.m_nodes[node];
+				if (n.isLeaf()) {
+					const T* distances = this->leafDistances(n);
+					for (int i = n.begin; i < n.end; i++) {
+						if (distances[i - n.begin] <= bound)
+							found.push_back(m_tree.m_indices[i]);
+					}
+					return;
+				}
+				this->descend(n, node, [bound] { return bound; }, [&](int child) { this->within(child, bound, found); });
+			}
+
+		private:
+			const kdTree& m_tree;
+			const T* m_point = nullptr;
+			size_t m_k = 0;
+			std::vector<T> m_offsets;
+			std::vector<T> m_distances;
+			std::vector<Candidate> m_heap;
+		};
+
+	private:
+
+		// A query counts as this many elements for the execution policy, so that a chunk holds a few dozen queries
+		static constexpr size_t workPerQuery = 1 << 10;
+
+		int m_size = 0;
+		int m_dims = 0;
+		int m_leafSize;
+
+		std::vector<Node> m_nodes;
+		Memory::Buffer<T> m_points;
+		Memory::Buffer<int> m_indices;
+
+		// The bounding box of all points
+		std::vector<T> m_low;
+		std::vector<T> m_high;
+	};
+}
@@ -12,6 +12,20 @@
 #include "Meta.h"
 #include <assert.h>
 #include "Quaternion.h"
+#include "Simd.h"
+#include "Parallel.h"
+#include "Memory.h"
+#include "Shape.h"
+#include "Expression.h"
+#include "ndView.h"
+#include "ndMask.h"
+#include "Broadcast.h"
+#include "Transpose.h"
+#include "Reduction.h"
+#include "Concatenate.h"
+#include "Npy.h"
+#include "Csv.h"
+#include "Stream.h"
 
 namespace Cnum
 {
@@ -21,6 +35,8 @@ class ndArray
 {
 public:
 
+	using value_type = T;
+
 	//--------------------------
 	// Constructors
 	// -------------------------
@@ -30,13 +46,15 @@ public:
 	ndArray(const ArrayLike_1d auto& init)
 	{
 		std::copy(init.begin(), init.end(), std::back_inserter(m_data));
-		m_shape = std::vector<int>{ 1, (int)init.size() };
+		m_shape = Shape{ 1, (int)init.size() };
+		this->updateLayout();
 	}
 	ndArray(const ArrayLike_1d auto& init, const iArrayLike_1d auto& shape)
 	{
 		try {
 			std::copy(init.begin(), init.end(), std::back_inserter(m_data));
 			std::copy(shape.begin(), shape.end(), std::back_inserter(m_shape));
+			this->updateLayout();
 		}
 		catch (const std::exception& ex) {
 			std::cout << ex.what() << std::endl;
@@ -47,32 +65,66 @@ public:
 	{
 		std::copy(shape.begin(), shape.end(), std::back_inserter(m_shape));
 		if (m_shape.size() == 1) {
-			m_shape = std::vector<int>{ 1, m_shape[0] };
+			m_shape = Shape{ 1, m_shape[0] };
 		}
 
-		m_data = std::vector<T>(this->getNumberOfElements(), initialValue);
+		this->updateLayout();
+		m_data = Memory::Buffer<T>(this->getNumberOfElements(), initialValue);
 	}
 
 	// Creation by initializer list
 	ndArray(const std::initializer_list<T>& init)
-		: m_data{std::vector(init)}, m_shape{std::vector<int>{1, (int)init.size()}}
-	{}
+		: m_data(init.begin(), init.end()), m_shape{Shape{1, (int)init.size()}}
+	{
+		this->updateLayout();
+	}
 	ndArray(const std::initializer_list<T>& init, const std::initializer_list<int>& shape)
-		: m_data{std::vector(init)}, m_shape{std::vector(shape)}
-	{}
+		: m_data(init.begin(), init.end()), m_shape{std::vector(shape)}
+	{
+		this->updateLayout();
+	}
 	ndArray(const std::initializer_list<int>& shape, T initialValue)
-		: m_data{std::vector(getNumberOfElements(std::vector(shape)), initialValue )}, m_shape{std::vector(shape)}
-	{};
+		: m_data((size_t)getNumberOfElements(std::vector(shape)), initialValue), m_shape{std::vector(shape)}
+	{
+		this->updateLayout();
+	};
 
 	// Creation by size
 	ndArray(const size_t size)
-		: m_shape{ std::vector{1, (int)size} }, m_data{std::vector<T>(size)}
-	{}
+		: m_shape{ std::vector{1, (int)size} }, m_data(size)
+	{
+		this->updateLayout();
+	}
 
 	
 	ndArray(const size_t size, const T initialValue)
-		: m_shape{ std::vector<int>{1, (int)size} }, m_data{ std::vector<T>(size, initialValue) }
-	{}
+		: m_shape{ Shape{1, (int)size} }, m_data(size, initialValue)
+	{
+		this->updateLayout();
+	}
+
+	// Creation by taking over a buffer, which holds the elements of the shape in row major order
+	ndArray(Memory::Buffer<T>&& data, Shape shape)
+		: m_data{ std::move(data) }, m_shape{ std::move(shape) }
+	{
+		if (m_shape.size() == 1) {
+			m_shape = Shape{ 1, m_shape[0] };
+		}
+		this->updateLayout();
+		assert((size_t)this->getNumberOfElements() == this->size());
+	}
+
+	// Creation by evaluating an expression, see Expression.h
+	template<Expression::Node E>
+	ndArray(const E& expr, Execution execution = Parallel::defaultExecution())
+		: m_data(expr.size()), m_shape(expr.shape().begin(), expr.shape().end())
+	{
+		if (m_shape.size() == 1) {
+			m_shape = Shape{ 1, m_shape[0] };
+		}
+		this->updateLayout();
+		Expression::evaluate(expr, m_data.data(), execution);
+	}
 
 	// Copy Constructor
 	ndArray(const ndArray<T>& src) = default;
@@ -94,13 +146,22 @@ public:
 	T& operator[](const iArray& index)const
 	{
 		assert(this->nDims() == index.size());
-		return (T&)m_data.at(flattenIndex(ndArray{ index }));
+		return (T&)m_data.at(flattenIndex(index));
  	}
 	T& operator[](int index)const
 	{
 		assert(this->nDims() == 1);
 		return (T&)m_data.at(index);
 	}
+	const ndArray<T> operator[](const ndMask& mask)const {
+
+		assert(this->size() == mask.size());
+
+		Memory::Buffer<T> selected;
+		selected.reserve(mask.count());
+		mask.forEachSet([&](size_t i) { selected.push_back(m_data[i]); });
+		return fromSelection(std::move(selected));
+	}
 	const ndArray<T> operator[](iArray&& logicalIndices)const {
 
 		assert(this->sameShapeAs(logicalIndices));
@@ -150,206 +211,171 @@ public:
 	// Assignment
 	ndArray<T>& operator=(ndArray<T> other) 
 	{
-		// Copy and swap idiom. Copy is made in the parameter list
-		swap(*this, other); 
+		// Copy and move idiom. Copy is made in the parameter list, and moved into the storage of this array
+		this->take(std::move(other));
 		return *this;
 	}
 
-	// Addition
-	friend ndArray<T> operator+(const ndArray& lhs, const ndArray& rhs)
-	{
-		assert(lhs.sameShapeAs(rhs)); 
-		return binaryOperation(lhs, rhs, std::plus<>());
-	}
-	friend ndArray<T> operator+(const ndArray&& lhs, const ndArray&& rhs)
+	// Assignment of an expression, see Expression.h
+	template<Expression::Node E>
+	ndArray<T>& operator=(const E& expr)
 	{
-		return lhs + rhs;
+		// The expression may refer to this array, so it cannot be evaluated into resized storage, nor in place if it reads
+		// the elements of this array out of order
+		if (m_data.size() != expr.size() || Expression::aliases(expr, m_data.data(), m_data.data() + m_data.size())) {
+			this->take(ndArray<T>(expr));
+			return *this;
+		}
+		Expression::evaluate(expr, m_data.data());
+		m_shape.assign(expr.shape().begin(), expr.shape().end());
+		if (m_shape.size() == 1) {
+			m_shape = Shape{ 1, m_shape[0] };
+		}
+		this->updateLayout();
+		return *this;
 	}
-	friend ndArray<T> operator+(const ndArray& lhs, const T value)
+
+	// Addition
+	ndArray<T>& operator+=(const ndArray<T>& rhs)
 	{
-		return lhs + ndArray<T>(lhs.shape(), value);
+		if (m_shape != rhs.m_shape) {
+			assert(Broadcast::shape(m_shape, rhs.m_shape) == m_shape);
+			return *this = *this + rhs;
+		}
+		return this->compoundAssign<Simd::Arith::Add>(rhs.data(), false);
 	}
-	void operator+=(const ndArray& rhs)
-	{
-		*this = *this + rhs;
+	ndArray<T>& operator+=(const T value) {
+		return this->compoundAssign<Simd::Arith::Add>(&value, true);
 	}
-	void operator+=(const ndArray&& rhs)
+	template<Expression::Node E>
+	ndArray<T>& operator+=(const E& expr)
 	{
-		*this = *this + rhs;
-	}
-	void operator+=(const T value) {
-		*this = *this + value;
+		assert(this->size() == expr.size());
+		return *this = *this + expr;
 	}
 
 	// Subtraction
-	friend ndArray<T> operator-(const ndArray& lhs, const ndArray& rhs)
-	{
-		assert(lhs.sameShapeAs(rhs));
-		return binaryOperation(lhs, rhs, std::minus<>());
-	}
-	friend ndArray<T> operator-(const ndArray&& lhs, const ndArray&& rhs)
-	{
-		return lhs - rhs;
-	}
-	friend ndArray<T> operator-(const ndArray& lhs, const T value)
-	{
-		return lhs - ndArray<T>(lhs.shape(), value);
-	}
-	void operator-=(const ndArray& rhs)
+	ndArray<T>& operator-=(const ndArray<T>& rhs)
 	{
-		*this = *this - rhs;
-	}
-	void operator-=(const ndArray&& rhs)
-	{
-		*this = *this - rhs;
+		if (m_shape != rhs.m_shape) {
+			assert(Broadcast::shape(m_shape, rhs.m_shape) == m_shape);
+			return *this = *this - rhs;
+		}
+		return this->compoundAssign<Simd::Arith::Subtract>(rhs.data(), false);
 	}
-	void operator-=(const T value) {
-		*this = *this - value;
+	ndArray<T>& operator-=(const T value) {
+		return this->compoundAssign<Simd::Arith::Subtract>(&value, true);
 	}
-	ndArray<T> operator-()
+	template<Expression::Node E>
+	ndArray<T>& operator-=(const E& expr)
 	{
-		return unaryOperation(*this, [](T t) {return t *= -1; }); 
+		assert(this->size() == expr.size());
+		return *this = *this - expr;
 	}
 
 	// Multiplication
-	friend ndArray<T> operator*(const ndArray& lhs, const ndArray& rhs)
-	{
-		assert(lhs.sameShapeAs(rhs));
-		return binaryOperation(lhs, rhs, std::multiplies<>());
-	}
-	friend ndArray<T> operator*(const ndArray&& lhs, const ndArray&& rhs)
+	ndArray<T>& operator*=(const ndArray<T>& rhs)
 	{
-		return lhs * rhs;
-	}
-	friend ndArray<T> operator*(const T value, const ndArray& rhs)
-	{
-		return rhs * ndArray<T>(rhs.shape(), value);
-	}
-	friend ndArray<T> operator*(const ndArray& lhs, const T value)
-	{
-		return value * lhs;
+		if (m_shape != rhs.m_shape) {
+			assert(Broadcast::shape(m_shape, rhs.m_shape) == m_shape);
+			return *this = *this * rhs;
+		}
+		return this->compoundAssign<Simd::Arith::Multiply>(rhs.data(), false);
 	}
-	void operator*=(const ndArray& rhs)
-	{
-		*this = *this * rhs;
+	ndArray<T>& operator*=(const T value) {
+		return this->compoundAssign<Simd::Arith::Multiply>(&value, true);
 	}
-	void operator*=(const ndArray&& rhs)
+	template<Expression::Node E>
+	ndArray<T>& operator*=(const E& expr)
 	{
-		*this = *this * rhs;
-	}
-	void operator*=(const T value) {
-		*this = *this * value;
+		assert(this->size() == expr.size());
+		return *this = *this * expr;
 	}
 
 	// Division
-	friend ndArray<T> operator/(const ndArray& lhs, const ndArray& rhs)
+	ndArray<T>& operator/=(const ndArray<T>& rhs)
 	{
-		assert(lhs.sameShapeAs(rhs));
-		assert(rhs[rhs == 0].size() == 0); 
-		return binaryOperation(lhs, rhs, std::divides<>());
-	}
-	friend ndArray<T> operator/(const ndArray&& lhs, const ndArray&& rhs)
-	{
-		return lhs / rhs;
-	}
-	friend ndArray<T> operator/(const ndArray& rhs, const T value)
-	{
-		return rhs / ndArray<T>(rhs.shape(), value);;
+		if (m_shape != rhs.m_shape) {
+			assert(Broadcast::shape(m_shape, rhs.m_shape) == m_shape);
+			return *this = *this / rhs;
+		}
+		assert(std::find(rhs.begin(), rhs.end(), T(0)) == rhs.end());
+		return this->compoundAssign<Simd::Arith::Divide>(rhs.data(), false);
 	}
-	void operator/=(const ndArray& rhs)
-	{
-		*this = *this / rhs;
+	ndArray<T>& operator/=(const T value) {
+		return this->compoundAssign<Simd::Arith::Divide>(&value, true);
 	}
-	void operator/=(const ndArray&& rhs)
+	template<Expression::Node E>
+	ndArray<T>& operator/=(const E& expr)
 	{
-		*this = *this / rhs;
-	}
-	void operator/=(const T value) {
-		*this = *this / value;
+		assert(this->size() == expr.size());
+		return *this = *this / expr;
 	}
 
 	// Equailty
-	iArray operator==(const ndArray<T>& rhs)const
-	{
-		return *this == std::move(rhs);
-	}
-	iArray operator==(const ndArray<T>&& rhs)const
+	ndMask operator==(const ndArray<T>& rhs)const
 	{
-		assert(this->sameShapeAs(rhs)); 
-		return createLogicalArray(*this, std::move(rhs), std::equal_to<>());
+		if (m_shape != rhs.m_shape)
+			return this->compareBroadcast<Simd::Compare::Equal>(rhs);
+		return this->compare<Simd::Compare::Equal>(rhs.data(), false);
 	}
-	iArray operator==(const T value)const {
-		return createLogicalArray(*this, ndArray<T>(this->shape(), value), std::equal_to<>());
+	ndMask operator==(const T value)const {
+		return this->compare<Simd::Compare::Equal>(&value, true);
 	}
-				 
+
 	// Anti-Equality
-	iArray operator!=(const ndArray<T>& rhs)const
+	ndMask operator!=(const ndArray<T>& rhs)const
 	{
-		return *this != std::move(rhs);
-	}
-	iArray operator!=(const ndArray<T>&& rhs)const
-	{
-		
-		return createLogicalArray(*this, std::move(rhs), std::not_equal_to<>());
+		if (m_shape != rhs.m_shape)
+			return this->compareBroadcast<Simd::Compare::NotEqual>(rhs);
+		return this->compare<Simd::Compare::NotEqual>(rhs.data(), false);
 	}
-	iArray operator!=(const T value)const {
-		return createLogicalArray(*this, ndArray<T>(this->shape(), value), std::not_equal_to<>());
+	ndMask operator!=(const T value)const {
+		return this->compare<Simd::Compare::NotEqual>(&value, true);
 	}
-				 
-	// Less than 
-	iArray operator < (T value)const {
-		return *this < ndArray<T>(this->shape(), value);
-	}
-	iArray operator < (const ndArray<T>& rhs)const
+
+	// Less than
+	ndMask operator < (const ndArray<T>& rhs)const
 	{
-		return *this < std::move(rhs);
+		if (m_shape != rhs.m_shape)
+			return this->compareBroadcast<Simd::Compare::Less>(rhs);
+		return this->compare<Simd::Compare::Less>(rhs.data(), false);
 	}
-	iArray operator < (const ndArray<T>&& rhs)const
-	{
-		assert(this->sameShapeAs(rhs));
-		return createLogicalArray(*this, std::move(rhs), std::less<>());
+	ndMask operator < (const T value)const {
+		return this->compare<Simd::Compare::Less>(&value, true);
 	}
-				 
+
 	// Larger than
-	iArray operator > (T value)const {
-		return *this > ndArray<T>(this->shape(), value); 
-	}
-	iArray operator > (const ndArray<T>& rhs)const
+	ndMask operator > (const ndArray<T>& rhs)const
 	{
-		return *this > std::move(rhs);
+		if (m_shape != rhs.m_shape)
+			return this->compareBroadcast<Simd::Compare::Greater>(rhs);
+		return this->compare<Simd::Compare::Greater>(rhs.data(), false);
 	}
-	iArray operator > (const ndArray<T>&& rhs)const
-	{
-		assert(this->sameShapeAs(rhs));
-		return createLogicalArray(*this, std::move(rhs), std::greater<>());
+	ndMask operator > (const T value)const {
+		return this->compare<Simd::Compare::Greater>(&value, true);
 	}
 
 	// Less or equal than
-	iArray operator <= (T value)const {
-		return *this <= ndArray<T>(this->shape(), value);
-	}
-	iArray operator <= (const ndArray<T>& rhs)const
+	ndMask operator <= (const ndArray<T>& rhs)const
 	{
-		return *this <= std::move(rhs);
+		if (m_shape != rhs.m_shape)
+			return this->compareBroadcast<Simd::Compare::LessEqual>(rhs);
+		return this->compare<Simd::Compare::LessEqual>(rhs.data(), false);
 	}
-	iArray operator <= (const ndArray<T>&& rhs)const
-	{
-		assert(this->sameShapeAs(rhs));
-		return createLogicalArray(*this, std::move(rhs), std::less_equal<>());
+	ndMask operator <= (const T value)const {
+		return this->compare<Simd::Compare::LessEqual>(&value, true);
 	}
 
 	// Larger or equal than
-	iArray operator >= (T value)const {
-		return *this >= ndArray<T>(this->shape(), value);
-	}
-	iArray operator >= (const ndArray<T>& rhs)const
+	ndMask operator >= (const ndArray<T>& rhs)const
 	{
-		return *this >= std::move(rhs);
+		if (m_shape != rhs.m_shape)
+			return this->compareBroadcast<Simd::Compare::GreaterEqual>(rhs);
+		return this->compare<Simd::Compare::GreaterEqual>(rhs.data(), false);
 	}
-	iArray operator >= (const ndArray<T>&& rhs)const
-	{
-		assert(this->sameShapeAs(rhs));
-		return createLogicalArray(*this, std::move(rhs), std::greater_equal<>());
+	ndMask operator >= (const T value)const {
+		return this->compare<Simd::Compare::GreaterEqual>(&value, true);
 	}
 
 	// Logical AND operator
@@ -394,7 +420,7 @@ public:
 	// Conversion, consider making explicit
 	operator std::vector<T>()const
 	{
-		return m_data;
+		return std::vector<T>(m_data.begin(), m_data.end());
 	}
 	operator std::initializer_list<T>()const
 	{
@@ -412,11 +438,14 @@ public:
 	ndArray<T>& flatten()
 	{
 		m_shape = { 1, (int)this->size() };
+		this->updateLayout();
 		return *this;
 	} 
 	ndArray<T>& abs()
 	{
-		std::transform(this->begin(), this->end(), this->begin(), [](T e) {return std::abs(e); });
+		Parallel::forChunks(this->size(), Parallel::defaultExecution(), [&](size_t begin, size_t end) {
+			Simd::abs(m_data.data() + begin, m_data.data() + begin, end - begin);
+		});
 		return *this;
 	}
 	ndArray<T>& reshape(iArray&& newShape)
@@ -424,6 +453,7 @@ public:
 		assert(this->size() == newShape.reduce(1, std::multiplies<>()));
 		m_shape.clear();
 		std::copy(newShape.begin(), newShape.end(), std::back_inserter(m_shape));
+		this->updateLayout();
 		return *this;	
 	}
 	ndArray<T>& reshape(iArray& newShape) {
@@ -451,6 +481,7 @@ public:
 
 		if (this->nDims() == 1) {
 			std::reverse(m_shape.begin(), m_shape.end()); 
+			this->updateLayout();
 			return *this; 
 		}
 		std::vector<int> permutation = std::vector<int>(this->nDims());
@@ -472,25 +503,25 @@ public:
 		assert(permutation.isPermutation(Cnum::Array::arange(this->nDims())));
 		assert(this->nDims() > 1);
 
-		std::vector<T> newData = std::vector<T>(this->size(), 0);
-		std::vector<int> newShape = std::vector<int>(this->nDims(), 0);
+		Shape perm(permutation.begin(), permutation.end());
+		Shape newShape = Shape(this->nDims(), 0);
 
 		// Update the shape based on the permutation
 		for (int j = 0; j < this->nDims(); j++) {
-			newShape.at(j) = this->shapeAlong(permutation.at(j));
+			newShape.at(j) = this->shapeAlong(perm[j]);
 		}
 
-		// Swap places of the data w.r.t the permutation
-		for (int i = 0; i < newData.size(); i++) {
-			iArray normalIndex = reconstructIndex(i);
-			iArray permutatedIndex(this->nDims(), 0);
-			for (int j = 0; j < permutatedIndex.size(); j++) {
-				permutatedIndex.at(j) = normalIndex.at(permutation.at(j));
-			}
-			newData.at(flattenIndex(permutatedIndex, newShape)) = m_data.at(i);
+		// A square matrix is swapped across its diagonal without a second buffer
+		if (this->nDims() == 2 && perm[0] == 1 && m_shape[0] == m_shape[1]) {
+			Transpose::inPlaceSquare(m_data.data(), (size_t)m_shape[0]);
+			return *this;
 		}
 
-		m_data = newData;  m_shape = newShape;
+		Memory::Buffer<T> newData(this->size());
+		Transpose::permute(m_data.data(), newData.data(), m_shape, perm);
+
+		m_data = std::move(newData);  m_shape = newShape;
+		this->updateLayout();
 		return *this;
 	} 
 
@@ -507,6 +538,7 @@ public:
 		assert(this->nDims() == 1);
 		m_data.insert(it, value);
 		m_shape[this->getDominantAxis_1d()]++;
+		this->updateLayout();
 		return *this;
 
 	}
@@ -526,31 +558,19 @@ public:
 	{
 		assert(this->nDims() > axis);
 
-		auto index = this->reconstructIndex(0);
-		for (int i = 0; i < this->getNonAxisNumberOfElements(axis); i++) {
-			auto nonAxisIndex = getNonAxisIndex(index, axis);
-			ndArray<T> extracted = extract(axis, nonAxisIndex);
-			std::reverse(extracted.begin(), extracted.end());
-			this->replaceAlong(extracted, axis, nonAxisIndex);
-			this->incrementExtractionIndex(index, axis, this->nDims() - 1);
-		}
+		this->forEachLane(axis, [](auto lane, auto) { std::reverse(lane.begin(), lane.end()); });
 		return *this;
 	}
 	ndArray<T>& roll(int shift, int axis)
 	{
 		assert(this->nDims() > axis); 
 
-		auto index = this->reconstructIndex(0);
-		for (int i = 0; i < this->getNonAxisNumberOfElements(axis); i++) {
-			auto nonAxisIndex = getNonAxisIndex(index, axis);
-			ndArray<T> extracted = extract(axis, nonAxisIndex);
-			if (shift > 0)
-				std::rotate(extracted.rbegin(), extracted.rbegin() + shift, extracted.rend());
-			else
-				std::rotate(extracted.begin(), extracted.begin() - shift, extracted.end());
-			this->replaceAlong(extracted, axis, nonAxisIndex);
-			this->incrementExtractionIndex(index, axis, this->nDims() - 1);
-		}
+		this->forEachLane(axis, [shift](auto lane, auto) {
+			// A shift to the right by shift is the same as a shift to the left by n - shift
+			int n = lane.shapeAlong(0);
+			int rightShift = ((shift % n) + n) % n;
+			std::rotate(lane.begin(), lane.end() - rightShift, lane.end());
+		});
 		return *this;
 	}
 
@@ -567,7 +587,7 @@ public:
 		}
 	}
 	ndArray<T>& rotate(const ndArray<T>&& axisOfRotation, Cnum::Rotation::Degrees theta) {
-		return this->rotate(axisOfRotation, Cnum::Rotation::toRadians(theta));
+		return this->rotate(ndArray<T>(axisOfRotation), Cnum::Rotation::toRadians(theta));
 	}
 	ndArray<T>& rotate(Cnum::Rotation::Axis axisOfRotation, Cnum::Rotation::Radians theta) {
 		switch (axisOfRotation) {
@@ -580,18 +600,64 @@ public:
 		}
 	}
 	ndArray<T>& rotate(ndArray<T>&& axisOfRotation, Cnum::Rotation::Radians theta) {
-		assert(this->size() == 3);
-		assert(this->nDims() == 1);
 		assert(axisOfRotation.size() == 3);
 		assert(axisOfRotation.nDims() == 1);
 
-		axisOfRotation.normalize();
-		Cnum::Quaternion<T> q1((T)std::cos(theta / 2), axisOfRotation * (T)std::sin(theta / 2));
-		*this = (q1 * (*this) * q1.inverse()).to3D().normalize();
+		return this->rotate(Cnum::Quaternion<T>::fromAxisAngle(Vector3<T>(axisOfRotation), (T)(theta * 1.0)));
+	}
+
+	/*
+		Rotates a single point, or every row of an (N,3) array of points, by the normalized quaternion.
+		A single point is rotated on the stack. Many points are multiplied by the rotation matrix of the quaternion, see Simd::transform3
+	*/
+	ndArray<T>& rotate(const Cnum::Quaternion<T>& q, Execution execution = Parallel::defaultExecution()) {
+		if (this->nDims() == 1 && this->size() == 3) {
+			// Written back in place, so a column stays a column
+			const Vector3<T> rotated = q.rotate(Vector3<T>(*this));
+			std::copy(rotated.begin(), rotated.end(), m_data.begin());
+			return *this;
+		}
+
+		assert(m_shape.size() == 2 && m_shape[1] == 3);
+		const Matrix3<T> matrix = q.toMatrix();
+		Parallel::forChunks((size_t)m_shape[0], execution, [&](size_t begin, size_t end) {
+			Simd::transform3(m_data.data() + 3 * begin, m_data.data() + 3 * begin, end - begin, matrix.data());
+		}, 3);
 		return *this;
 	}
 
-	ndArray<T>& blend_if(const ndArray<T>&& arr, const iArray&& condition) {
+	// Rotates row i of an (N,3) array of points by row i of an (N,4) array of normalized quaternions (w,x,y,z), see Simd::rotate
+	ndArray<T>& rotate(const ndArray<T>& quaternions, Execution execution = Parallel::defaultExecution()) {
+		assert(m_shape.size() == 2 && m_shape[1] == 3);
+		assert(quaternions.shape() == Shape({ m_shape[0], 4 }));
+
+		Parallel::forChunks((size_t)m_shape[0], execution, [&](size_t begin, size_t end) {
+			Simd::rotate(quaternions.data() + 4 * begin, m_data.data() + 3 * begin, end - begin);
+		}, 7);
+		return *this;
+	}
+
+	ndArray<T>& blend_if(const ndArray<T>& arr, const ndMask& condition) {
+
+		// Both arr and condition are broadcast to the shape of this array
+		assert(Broadcast::shape(m_shape, arr.m_shape) == m_shape);
+		assert(Broadcast::shape(m_shape, condition.shape()) == m_shape);
+
+		Broadcast::IndexMap arrMap(arr.m_shape, m_shape);
+		if (condition.size() == this->size()) {
+			condition.forEachSet([&](size_t i) { m_data[i] = arr.m_data[arrMap(i)]; });
+			return *this;
+		}
+
+		Broadcast::IndexMap conditionMap(condition.shape(), m_shape);
+		for (size_t i = 0; i < this->size(); i++) {
+			if (condition.test(conditionMap(i))) {
+				m_data[i] = arr.m_data[arrMap(i)];
+			}
+		}
+		return *this;
+	}
+	ndArray<T>& blend_if(const ndArray<T>& arr, const iArray&& condition) {
 		return this->blend_if(arr, condition);
 	}
 	ndArray<T>& blend_if(const ndArray<T>& arr, const iArray& condition) {
@@ -631,6 +697,7 @@ public:
 		assert(this->nDims() == 1);
 		m_data.erase(it);
 		m_shape[getDominantAxis_1d()]--;
+		this->updateLayout();
 		return *this;
 	}
 	ndArray<T>& erase(int index)
@@ -638,6 +705,7 @@ public:
 		assert(this->nDims() == 1); 
 		m_data.erase(m_data.begin() + index);
 		m_shape[getDominantAxis_1d()]--;
+		this->updateLayout();
 		return *this;
 	}
 	ndArray<T>& erase(int start, int end)
@@ -649,13 +717,38 @@ public:
 			m_data.erase(m_data.begin() + start);
 		}
 		m_shape[getDominantAxis_1d()] -= end-start;
+		this->updateLayout();
+		return *this;
+	}
+	ndArray<T>& erase_if(const ndMask& condition) {
+		assert(this->size() == condition.size());
+
+		// Compacts the kept elements to the front, a whole word of flags at a time
+		size_t kept = 0;
+		const uint64_t* words = condition.words();
+		for (size_t w = 0; w < condition.nWords(); w++) {
+			const size_t first = w * 64;
+			const size_t last = std::min(this->size(), first + 64);
+			const uint64_t erased = words[w];
+			if (erased == 0 && kept == first) {
+				kept = last;
+				continue;
+			}
+			for (size_t i = first; i < last; i++) {
+				if (((erased >> (i - first)) & 1) == 0) {
+					m_data[kept++] = m_data[i];
+				}
+			}
+		}
+		m_data.resize(kept);
+		*this = fromSelection(std::move(m_data));
 		return *this;
 	}
 	ndArray<T>& erase_if(const iArray&& condition) {
 		assert(this->size() == condition.size());
 		ndArray<T> out;
 		for (int i = 0; i < this->size(); i++) {
-			if (condition.raw()[i] == 0) {
+			if (condition.data()[i] == 0) {
 				out.append(m_data[i]);
 			}
 		}
@@ -678,7 +771,8 @@ public:
 
 		if (m_data.empty()) {
 			m_data.push_back(value);
-			m_shape = std::vector<int>{ 1,1 };
+			m_shape = Shape{ 1,1 };
+			this->updateLayout();
 			return;
 		}
 		assert(this->nDims() == 1); 
@@ -687,6 +781,7 @@ public:
 		}else {
 			m_shape.at(this->getDominantAxis_1d())++;
 		}
+		this->updateLayout();
 		m_data.push_back(value);
 	}
 	void append(const ndArray<T>& arr) {
@@ -695,9 +790,19 @@ public:
 	}
 
 	// Reductions
+	// Folds the elements in order, starting from initVal. Any op is allowed, unless the reduction is explicitly parallel
 	template<typename Operation>
-	T reduce(T initVal, Operation op)const {
-		return std::accumulate(m_data.begin(), m_data.end(), initVal, op);
+	T reduce(T initVal, Operation op, Execution execution = Execution::Serial)const 
+	{
+		if (!Parallel::isParallel(this->size(), execution)) {
+			return std::accumulate(m_data.begin(), m_data.end(), initVal, op);
+		}
+
+		// Each chunk is folded on its own and the partials are combined, so op must be associative and initVal its identity
+		std::vector<T> partials = Parallel::mapChunks<T>(this->size(), execution, [&](size_t begin, size_t end) {
+			return std::accumulate(m_data.begin() + begin + 1, m_data.begin() + end, m_data[begin], op);
+		});
+		return std::accumulate(partials.begin(), partials.end(), initVal, op);
 	}
 	T norm() {
 		assert(this->nDims() == 1); 
@@ -707,15 +812,7 @@ public:
 	ndArray<T>& norm(int axis) {
 		assert(this->nDims() > 1); 
 		assert(this->nDims() > axis);
-		int i;
-		iArray index = this->reconstructIndex(0);
-		for (i = 0; i < getNonAxisNumberOfElements(axis); i++) {
-			iArray nonAxisIndex = getNonAxisIndex(index, axis);
-			m_data.at(i) = this->extract(axis, nonAxisIndex).norm();
-			this->incrementExtractionIndex(index, axis, this->nDims() - 1);
-		}
-		m_data = std::vector<T>(m_data.begin(), m_data.begin() + i);
-		m_shape[axis] = 1;
+		*this = this->norm(std::vector<int>{ axis }, true);
 		return *this;
 	}
 
@@ -723,27 +820,58 @@ public:
 	ndArray<T>& reduceAlongAxis(int axis, T initValue, Operation op)
 	{
 		assert(this->nDims() > axis);
-		int i;
-		iArray index = this->reconstructIndex(0);
-		for (i = 0; i < getNonAxisNumberOfElements(axis); i++) {
-			iArray nonAxisIndex = getNonAxisIndex(index, axis);
-			m_data.at(i) = this->extract(axis, nonAxisIndex).reduce(initValue, op);
-			this->incrementExtractionIndex(index, axis, this->nDims() - 1);
-		}
-		m_data = std::vector<T>(m_data.begin(), m_data.begin() + i);
-		m_shape[axis] = 1;
+		*this = this->reduceAxes(Reduction::Generic<T, Operation>{ initValue, op }, { axis }, true, Parallel::defaultExecution());
 		return *this;
 	}
 
+	/*
+		Reductions over one or more axes, see Reduction.h. An empty list of axes reduces over all of them.
+		The reduced axes are removed from the shape, or kept with length 1 if keepDims is set.
+		Note that norm({ axis }) is norm(int), which reduces in place.
+	*/
+	ndArray<T> sum(const std::vector<int>& axes, bool keepDims = false, Execution execution = Parallel::defaultExecution())const {
+		return this->reduceAxes(Reduction::Sum<T>(), axes, keepDims, execution);
+	}
+	ndArray<T> prod(const std::vector<int>& axes, bool keepDims = false, Execution execution = Parallel::defaultExecution())const {
+		return this->reduceAxes(Reduction::Product<T>(), axes, keepDims, execution);
+	}
+	ndArray<T> mean(const std::vector<int>& axes, bool keepDims = false, Execution execution = Parallel::defaultExecution())const {
+		ndArray<T> sums = this->sum(axes, keepDims, execution);
+		const size_t count = (sums.size() > 0) ? this->size() / sums.size() : 0;
+		return sums /= (T)count;
+	}
+	ndArray<T> min(const std::vector<int>& axes, bool keepDims = false, Execution execution = Parallel::defaultExecution())const {
+		return this->reduceAxes(Reduction::Min<T>(), axes, keepDims, execution);
+	}
+	ndArray<T> max(const std::vector<int>& axes, bool keepDims = false, Execution execution = Parallel::defaultExecution())const {
+		return this->reduceAxes(Reduction::Max<T>(), axes, keepDims, execution);
+	}
+	ndArray<T> norm(const std::vector<int>& axes, bool keepDims = false, Execution execution = Parallel::defaultExecution())const {
+		ndArray<T> norms = this->reduceAxes(Reduction::SumOfSquares<T>(), axes, keepDims, execution);
+		for (T& value : norms.m_data) {
+			value = (T)std::sqrt(value);
+		}
+		return norms;
+	}
+	ndMask any(const std::vector<int>& axes, bool keepDims = false, Execution execution = Parallel::defaultExecution())const {
+		return this->reduceAxes(Reduction::Any<T>(), axes, keepDims, execution) != T(0);
+	}
+	ndMask all(const std::vector<int>& axes, bool keepDims = false, Execution execution = Parallel::defaultExecution())const {
+		return this->reduceAxes(Reduction::All<T>(), axes, keepDims, execution) != T(0);
+	}
+
+	// The index along the axis of the first smallest, or largest, element of every lane
+	iArray argMin(int axis, bool keepDims = false, Execution execution = Parallel::defaultExecution())const {
+		return this->argBestAlong(axis, keepDims, std::less<>(), execution);
+	}
+	iArray argMax(int axis, bool keepDims = false, Execution execution = Parallel::defaultExecution())const {
+		return this->argBestAlong(axis, keepDims, std::greater<>(), execution);
+	}
+
 	// Extractions
 	ndArray<T> extract(int start, int end)const {
 		assert(this->nDims() == 1); 
-		ndArray<T> out; 
-		end = (end < 0) ? m_shape.at(this->getDominantAxis_1d()) + end + 1: end;
-		for (int i = start; i < end; i++) {
-			out.append(m_data.at(i)); 
-		}
-		return out;
+		return ndArray<T>(this->flatView().slice(0, start, end));
 	}
 	ndArray<T> extract(int axis, int nonAxisIndex, int start, int end = -1)const 
 	{
@@ -763,12 +891,12 @@ public:
 		assert(this->nDims() > axis); 
 		assert(nonAxisIndex.size() == this->nDims() - 1);
 
-		auto start_stop = determineStartEndIndexForAxis(axis, nonAxisIndex, start, end);
-		int stride = getStride(axis);
+		auto lane = this->lane(axis, nonAxisIndex).slice(0, start, end);
 		ndArray<T> out;
-		for (int i = start_stop.first; i < start_stop.second; i += stride) {
-			if (pred(m_data.at(i)))
-				out.append(m_data.at(i)); // Potential error. Append now defaults to row vector perhaps it needs to be flipped
+		std::copy_if(lane.begin(), lane.end(), std::back_inserter(out.m_data), pred);
+		if (!out.m_data.empty()) {
+			out.m_shape = Shape{ 1, (int)out.size() };
+			out.updateLayout();
 		}
 		return out;
 	}
@@ -789,44 +917,32 @@ public:
 		assert(this->nDims() > 1); 
 		assert(this->nDims() > axis); 
 
-		iArray newShape = this->shape();
-		newShape[axis]--;
-		ndArray<T> out = Cnum::Array::uniformArray(newShape, 0);
-		iArray index = this->reconstructIndex(0);
-
-		for (int i = 0; i < this->getNonAxisNumberOfElements(axis); i++) {
-			iArray nonAxisIndex = getNonAxisIndex(index, axis);
-			ndArray<T> axisDiff = extract(axis, nonAxisIndex, 0).adjacentDiff(forwardDiff);
-			out.replaceAlong(axisDiff, axis, nonAxisIndex);
-			this->incrementExtractionIndex(index, axis, this->nDims() - 1);
-		}
-		*this = out;
+		// The differences are the view without the first element minus the view without the last element
+		auto next = this->view().slice(axis, 1, -1);
+		auto previous = this->view().slice(axis, 0, -2);
+		if (forwardDiff)
+			*this = next - previous;
+		else
+			*this = previous - next;
 		return *this; 
 	}
 
 	// Searching
-	iArray find(iArray&& condition)
+	iArray find(const ndMask& condition)const
+	{
+		assert(this->size() == condition.size());
+		const uint64_t* words = condition.words();
+		return this->findIndices([words](size_t i) { return (words[i / 64] >> (i % 64)) & 1; });
+	}
+	iArray find(iArray&& condition)const
 	{
 		assert(this->sameShapeAs(condition));
-		int axis = (this->nDims() > 1) ? 0 : 1;
-		iArray outIndices;
-		for (int i = 0; i < condition.size(); i++) {
-			if (condition.m_data.at(i)) {
-				outIndices.concatenate(this->reconstructIndex(i), axis);
-			}
-		}
-		return outIndices;
+		const int* flags = condition.data();
+		return this->findIndices([flags](size_t i) { return flags[i] != 0; });
 	}
 	iArray find_if(std::function<bool(T)>&& pred)
 	{
-		int axis = (this->nDims() > 1) ? 0 : 1;
-		iArray outIndices;
-		for (int i = 0; i < this->size(); i++) {
-			if (pred(m_data.at(i))) {
-				outIndices.concatenate(this->reconstructIndex(i), axis);
-			}
-		}
-		return outIndices;
+		return this->findIndices([&](size_t i) { return pred(m_data[i]); });
 	}
 
 	// Sorting
@@ -834,11 +950,10 @@ public:
 	{
 		assert(this->nDims() == 1); 
 		ndArray<int> out(this->shape(), 0);
-		std::iota(out.begin(), out.end(), 0);
-		std::stable_sort(out.begin(), out.end(), [&](int i1, int i2) { return m_data.at(i1) < m_data.at(i2);  });
+		ndArray<T>::argSortLane(this->flatView(), ndView<int>(out.data(), { (int)this->size() }, { 1 }));
 		return out;
 	}
-	iArray argSort(int axis) {
+	iArray argSort(int axis, Execution execution = Parallel::defaultExecution()) {
 
 		/*
 			What are the indices returned? 
@@ -853,44 +968,32 @@ public:
 		assert(this->nDims() > 1); 
 		assert(this->nDims() > axis);
 
-		ndArray<int> axisIdx({ this->shapeAlong(axis) }, 0);
 		ndArray<int> out(this->shape(), 0);
 
-		auto index = this->reconstructIndex(0);
-		for (int i = 0; i < this->getNonAxisNumberOfElements(axis); i++) {
-			auto nonAxisIndex = getNonAxisIndex(index, axis);
-			ndArray<T> data = this->extract(axis, nonAxisIndex);
-			std::iota(axisIdx.begin(), axisIdx.end(), 0);
-			std::stable_sort(axisIdx.begin(), axisIdx.end(), [&](int i1, int i2) { return data[i1] < data[i2];  });
-			out.replaceAlong(axisIdx, axis, nonAxisIndex);
-			this->incrementExtractionIndex(index, axis, this->nDims() - 1);
-		}
+		// The output has the same shape, and thereby the same lane offsets and strides, as this array
+		this->forEachLane(axis, [&](auto lane, size_t) {
+			ndArray<T>::argSortLane(lane, ndView<int>(out.data() + (lane.data() - m_data.data()), lane.shape(), lane.strides()));
+		}, execution);
 		return out;
 	}
-	ndArray<T>& sortFlat()
+	ndArray<T>& sortFlat(Execution execution = Parallel::defaultExecution())
 	{
-		std::sort(this->begin(), this->end()); 
+		Parallel::sort(m_data.data(), this->size(), execution);
 		this->flatten(); 
 		return *this;
 	}
-	ndArray<T>& sort()
+	ndArray<T>& sort(Execution execution = Parallel::defaultExecution())
 	{
 		assert(this->nDims() == 1); 
-		std::sort(this->begin(), this->end());
+		Parallel::sort(m_data.data(), this->size(), execution);
 		return *this;
 	}
-	ndArray<T>& sort(int axis) 
+	ndArray<T>& sort(int axis, Execution execution = Parallel::defaultExecution()) 
 	{
 		assert(this->nDims() > 1);
 		assert(this->nDims() > axis);
 
-		auto index = this->reconstructIndex(0);
-		for (int i = 0; i < this->getNonAxisNumberOfElements(axis); i++) {
-			auto nonAxisIndex = getNonAxisIndex(index, axis);
-			ndArray<T> sortedAxis = this->extract(axis, nonAxisIndex).sortFlat();
-			this->replaceAlong(sortedAxis, axis, nonAxisIndex);
-			this->incrementExtractionIndex(index, axis, this->nDims() - 1);
-		}
+		this->forEachLane(axis, [](auto lane, size_t) { ndArray<T>::sortLane(lane); }, execution);
 		return *this;
 	}
 
@@ -920,12 +1023,30 @@ public:
 		std::cout << ")" << std::endl;
 	}
 	
+	// Views
+	ndView<T> view()
+	{
+		return ndView<T>(m_data.data(), m_shape, this->rawStrides());
+	}
+	ndView<const T> view()const
+	{
+		return ndView<const T>(m_data.data(), m_shape, this->rawStrides());
+	}
+	ndView<T> slice(int axis, int start, int end = -1, int step = 1)
+	{
+		return this->view().slice(axis, start, end, step);
+	}
+	ndView<const T> slice(int axis, int start, int end = -1, int step = 1)const
+	{
+		return this->view().slice(axis, start, end, step);
+	}
+
 	// Getters
-	const std::vector<int>& shape()const 
+	const Shape& shape()const 
 	{ 
 		return m_shape;
 	}
-	std::vector<int> shape()
+	Shape shape()
 	{
 		return m_shape;
 	};
@@ -946,13 +1067,7 @@ public:
 		return toString(this->shape()); 
 	};
 	int nDims()const {
-		int dims = (int)std::count_if(m_shape.begin(), m_shape.end(), [](int dim) {return dim >= 1; });
-		if (dims == 0 && m_shape.at(0) == 1)
-			return 1;
-		else if (dims == 2 && (m_shape.at(0) == 1 || m_shape.at(1) == 1))
-			return 1;
-		else
-			return dims;
+		return m_nDims;
 	}
 	size_t size()const 
 	{
@@ -970,7 +1085,7 @@ public:
 		}
 		else {
 			assert(this->nDims() > axis);
-			return std::accumulate(m_shape.begin() + 1 + axis, m_shape.end(), 1, std::multiplies<>());
+			return m_strides[axis];
 		}
 			
 	}
@@ -1009,22 +1124,39 @@ public:
 		return m_data.rend();
 	}
 
-	const std::vector<T>& raw()const
+	T* data()
+	{
+		return m_data.data();
+	}
+	const T* data()const
+	{
+		return m_data.data();
+	}
+
+	// The elements in row major order, as a plain vector
+	std::vector<T> raw()const
 	{ 
-		return this->m_data;
-	};
-	std::vector<T> raw() 
+		return std::vector<T>(m_data.begin(), m_data.end());
+	}
+	// The storage itself, with the allocator that holds the memory resource of the array
+	const Memory::Buffer<T>& buffer()const
 	{
-		return this->m_data;
+		return m_data;
 	}
 
-	T min()const
+	T min(Execution execution = Parallel::defaultExecution())const
 	{ 
-		return *std::min_element(m_data.begin(), m_data.end());
+		std::vector<T> partials = Parallel::mapChunks<T>(this->size(), execution, [&](size_t begin, size_t end) {
+			return *std::min_element(m_data.begin() + begin, m_data.begin() + end);
+		});
+		return *std::min_element(partials.begin(), partials.end());
 	}
-	T max()const
+	T max(Execution execution = Parallel::defaultExecution())const
 	{ 
-		return *std::max_element(m_data.begin(), m_data.end());
+		std::vector<T> partials = Parallel::mapChunks<T>(this->size(), execution, [&](size_t begin, size_t end) {
+			return *std::max_element(m_data.begin() + begin, m_data.begin() + end);
+		});
+		return *std::max_element(partials.begin(), partials.end());
 	}
 
 	iArray argMin()const {
@@ -1044,10 +1176,6 @@ private:
 
 	// Indexing
 	int flattenIndex(const iArrayLike_1d auto& index)const
-	{
-		return this->flattenIndex(index, this->shape());
-	}
-	int flattenIndex(const iArrayLike_1d auto& index, iArray shape)const
 	{
 		/*
 		General Formula:
@@ -1059,51 +1187,258 @@ private:
 			Example: 4D index (1,2,1,0) where the shape is (4,4,4,4).
 
 			1 * 4*4*4 + 2 * 4*4 + 1 * 4 + 0	= 64 + 32 + 4 = 100
+
+			The products of the dimension-sizes are the cached strides
 		*/
 
-		int flatIndex = 0;
+		auto it = index.begin();
 
-		for (int j = 0; j < index.size() - 1; j++)
-			flatIndex += index.at(j) * std::accumulate(shape.begin() + j + 1, shape.end(), 1, std::multiplies<int>());
+		// A 1d array is indexed by a single index, even though its shape holds two dimensions
+		if (index.size() != m_strides.size()) {
+			assert(index.size() == 1);
+			return *it;
+		}
 
-		flatIndex += index.at((int)index.size() - 1);
+		int flatIndex = 0;
+		for (size_t j = 0; j < m_strides.size(); j++, it++)
+			flatIndex += *it * m_strides[j];
 		return flatIndex;
 	}
 
-	iArray getNonAxisIndex(int flatIndex, int axis)const {
-		auto index = reconstructIndex(flatIndex).erase(axis);
-		return index;
+	iArray reconstructIndex(int index)const 
+	{
+		if (this->nDims() == 1) {
+			return iArray{index};
+		}
 
+		iArray indices((size_t)m_shape.size());
+		int* out = indices.data();
+		for (int i = (int)m_shape.size() - 1; i >= 0; i--) {
+			out[i] = index % m_shape[i];
+			index /= m_shape[i];
+		}
+		return indices;
 	}
-	iArray getNonAxisIndex(iArray& index, int axis)const {
-		iArray idx = index;
-		idx.erase(idx.begin() + axis);
-		return idx;
 
+	// Layout
+	void updateLayout()
+	{
+		// Must be called whenever m_shape has changed
+		m_strides = ndArray<T>::stridesOf(m_shape);
+
+		int dims = (int)std::count_if(m_shape.begin(), m_shape.end(), [](int dim) {return dim >= 1; });
+		if (m_shape.empty())
+			m_nDims = 0;
+		else if (dims == 0 && m_shape.at(0) == 1)
+			m_nDims = 1;
+		else if (dims == 2 && (m_shape.at(0) == 1 || m_shape.at(1) == 1))
+			m_nDims = 1;
+		else
+			m_nDims = dims;
 	}
-	iArray reconstructIndex(int index)const 
+	static Shape stridesOf(const Shape& shape)
 	{
-		if (this->nDims() == 1) {
-			return iArray{index};
+		Shape strides(shape.size(), 1);
+		for (int i = (int)shape.size() - 2; i >= 0; i--) {
+			strides[i] = strides[i + 1] * shape[i + 1];
 		}
+		return strides;
+	}
 
-		iArray indices = Cnum::Array::uniformArray(this->nDims(), 0);
-		for (int i = 0; i < this->nDims(); i++) {
+	// Lanes
+	const Shape& rawStrides()const
+	{
+		// Unlike getStride(), these are the strides of the stored shape, also for 1d arrays
+		return m_strides;
+	}
+	// Moves the elements of other into this array. The buffer keeps its memory resource, so the elements are only
+	// copied when other comes from another resource, e.g. an Arena in a ScopedResource
+	void take(ndArray<T>&& other)
+	{
+		m_data = std::move(other.m_data);
+		m_shape = std::move(other.m_shape);
+		m_strides = std::move(other.m_strides);
+		m_nDims = other.m_nDims;
+	}
+	ndView<T> flatView()
+	{
+		return ndView<T>(m_data.data(), { (int)this->size() }, { 1 });
+	}
+	ndView<const T> flatView()const
+	{
+		return ndView<const T>(m_data.data(), { (int)this->size() }, { 1 });
+	}
+	int laneAxis(int axis)const
+	{
+		// Axis 0 of a 1d array is the axis holding the elements, whether it is a row or a column
+		return (this->nDims() == 1 && m_shape.size() == 2) ? this->getDominantAxis_1d() : axis;
+	}
+	ndView<const T> lane(int axis, const iArray& nonAxisIndex)const
+	{
+		if (this->nDims() == 1) {
+			return this->flatView();
+		}
 
-			int stride = getStride(i);
-			if (stride > index)
+		const auto& strides = this->rawStrides();
+		std::ptrdiff_t offset = 0;
+		for (int i = 0, j = 0; i < (int)m_shape.size(); i++) {
+			if (i == axis)
 				continue;
+			offset += (std::ptrdiff_t)nonAxisIndex.data()[j++] * strides[i];
+		}
+		return ndView<const T>(m_data.data() + offset, { m_shape[axis] }, { strides[axis] });
+	}
+	template<typename Function>
+	void forEachLane(int axis, Function fn)
+	{
+		this->view().forEachLane(this->laneAxis(axis), fn);
+	}
+	template<typename Function>
+	void forEachLane(int axis, Function fn)const
+	{
+		this->view().forEachLane(this->laneAxis(axis), fn);
+	}
 
-			int j = 0;
-			for (; j < m_shape.at(i) - 1 && index - stride >= 0; j++) {
-				index -= stride;
+	// Calls fn(lane, laneIndex) for every lane along the axis, where the lanes are spread over threads. The lanes never overlap
+	template<typename Function>
+	void forEachLane(int axis, Function fn, Execution execution)
+	{
+		axis = this->laneAxis(axis);
+		std::vector<std::ptrdiff_t> offsets;
+		offsets.reserve(this->size() / std::max(1, m_shape[axis]));
+		this->view().at(axis, 0).forEachOffset([&](std::ptrdiff_t offset) { offsets.push_back(offset); });
+
+		Parallel::forChunks(offsets.size(), execution, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				fn(ndView<T>(m_data.data() + offsets[i], { m_shape[axis] }, { m_strides[axis] }), i);
 			}
-			indices.at(i) = j;
+		}, (size_t)m_shape[axis]);
+	}
 
-			if (index < 0)
-				break;
+	// Reductions
+	std::vector<bool> reducedAxes(const std::vector<int>& axes)const
+	{
+		std::vector<bool> isReduced(m_shape.size(), axes.empty());
+		for (int axis : axes) {
+			axis = this->laneAxis((axis < 0) ? axis + this->nDims() : axis);
+			assert(axis >= 0 && axis < (int)m_shape.size());
+			isReduced[axis] = true;
 		}
-		return indices;
+		return isReduced;
+	}
+	Shape reducedShape(const std::vector<bool>& isReduced, bool keepDims)const
+	{
+		Shape shape;
+		for (size_t i = 0; i < m_shape.size(); i++) {
+			if (!isReduced[i])
+				shape.push_back(m_shape[i]);
+			else if (keepDims)
+				shape.push_back(1);
+		}
+		// A single value, or a single axis, is stored as a row
+		if (shape.size() < 2)
+			shape.insert(shape.begin(), 2 - shape.size(), 1);
+		return shape;
+	}
+	template<typename Reducer>
+	ndArray<T> reduceAxes(const Reducer& reducer, const std::vector<int>& axes, bool keepDims, Execution execution)const
+	{
+		const std::vector<bool> isReduced = this->reducedAxes(axes);
+		return ndArray<T>(Reduction::reduce(m_data.data(), m_shape, isReduced, reducer, execution), this->reducedShape(isReduced, keepDims));
+	}
+	template<typename Better>
+	iArray argBestAlong(int axis, bool keepDims, Better better, Execution execution)const
+	{
+		const std::vector<bool> isReduced = this->reducedAxes({ axis });
+		const int storedAxis = (int)(std::find(isReduced.begin(), isReduced.end(), true) - isReduced.begin());
+		return iArray(Reduction::argBest(m_data.data(), m_shape, storedAxis, better, execution), this->reducedShape(isReduced, keepDims));
+	}
+
+	// Sorting
+	static void sortLane(ndView<T> lane)
+	{
+		// A strided lane is gathered into a buffer which every thread reuses, so that the sort runs on contiguous memory
+		if (lane.strides()[0] == 1) {
+			std::sort(lane.data(), lane.data() + lane.size());
+			return;
+		}
+		static thread_local std::vector<T> scratch;
+		scratch.assign(lane.begin(), lane.end());
+		std::sort(scratch.begin(), scratch.end());
+		std::copy(scratch.begin(), scratch.end(), lane.begin());
+	}
+	static void argSortLane(ndView<T> lane, ndView<int> indices)
+	{
+		static thread_local std::vector<std::pair<T, int>> scratch, buffer;
+		scratch.resize(lane.size());
+		buffer.resize(lane.size());
+		int i = 0;
+		for (const T& value : lane) {
+			scratch[i] = { value, i };
+			i++;
+		}
+		ndArray<T>::stableSort(scratch.data(), buffer.data(), scratch.size(), [](const std::pair<T, int>& a, const std::pair<T, int>& b) {
+			return a.first < b.first;
+		});
+		std::transform(scratch.begin(), scratch.end(), indices.begin(), [](const std::pair<T, int>& p) { return p.second; });
+	}
+
+	// Bottom up merge sort of data, through a buffer of the same length, so unlike std::stable_sort it never allocates
+	template<typename V, typename Compare>
+	static void stableSort(V* data, V* buffer, size_t n, Compare comp)
+	{
+		// Short runs are insertion sorted first
+		constexpr size_t run = 16;
+		for (size_t begin = 0; begin < n; begin += run) {
+			V* first = data + begin;
+			V* last = data + std::min(n, begin + run);
+			for (V* it = first + 1; it < last; it++) {
+				V value = std::move(*it);
+				V* hole = it;
+				for (; hole > first && comp(value, hole[-1]); hole--) {
+					*hole = std::move(hole[-1]);
+				}
+				*hole = std::move(value);
+			}
+		}
+
+		V* from = data;
+		V* to = buffer;
+		for (size_t width = run; width < n; width *= 2) {
+			for (size_t begin = 0; begin < n; begin += 2 * width) {
+				const size_t mid = std::min(n, begin + width);
+				const size_t end = std::min(n, begin + 2 * width);
+				std::merge(from + begin, from + mid, from + mid, from + end, to + begin, comp);
+			}
+			std::swap(from, to);
+		}
+		if (from != data)
+			std::move(from, from + n, data);
+	}
+
+	// Searching
+	template<typename Predicate>
+	iArray findIndices(Predicate isFound)const
+	{
+		// The indices of the found elements are stacked as rows. A 1d array gives a single row of flat indices
+		const bool is1d = this->nDims() == 1;
+		const int rank = (int)m_shape.size();
+
+		std::vector<int> found;
+		IndexCounter counter(m_shape, m_strides);
+		for (size_t i = 0; i < this->size(); i++, counter.next()) {
+			if (!isFound(i))
+				continue;
+			if (is1d)
+				found.push_back((int)i);
+			else
+				found.insert(found.end(), counter.index().begin(), counter.index().end());
+		}
+
+		if (found.empty())
+			return iArray();
+		int nFound = is1d ? (int)found.size() : (int)found.size() / rank;
+		return is1d ? iArray(found, std::vector<int>{ 1, nFound }) : iArray(found, std::vector<int>{ nFound, rank });
 	}
 
 	// Element counts
@@ -1123,38 +1458,11 @@ private:
 
 	// Actions
 	template<typename Operation>
-	static ndArray<T> binaryOperation(const ndArray<T>& arr1, const ndArray<T>& arr2, Operation binaryOp)
-	{
-		ndArray<T> out(arr1.size());
-		std::transform(arr1.begin(), arr1.raw().end(), arr2.begin(), out.begin(), binaryOp);
-		return out.reshape(arr1.shape());
-	}
-	template<typename Operation>
-	static ndArray<T> unaryOperation(const ndArray<T>& arr, Operation unaryOp)
-	{
-		ndArray<T> out(arr.size());
-		std::transform(arr.begin(), arr.raw().end(), out.begin(), unaryOp);
-		return out.reshape(arr.shape());
-	}
-	template<typename Operation>
 	ndArray<T>& unaryOperation(ndArray<T>& arr, Operation unaryOp)
 	{
 		std::transform(arr.begin(), arr.end(), arr.begin(), unaryOp);
 		return arr;
 	}
-	void incrementExtractionIndex(ndArray<int>& index, int axis, int dim) {
-
-		if (dim == -1)
-			return;
-
-		if (index.at(dim) + 1 > this->shapeAlong(dim) - 1 || dim == axis) {
-			index.at(dim) = 0;
-			incrementExtractionIndex(index, axis, dim - 1);
-		}
-		else {
-			index.at(dim)++;
-		}
-	}
 	void printDim(ndArray<int>& index, int dim)const
 	{
 		// In the lowest recursion (max dim) level - do the print
@@ -1189,7 +1497,7 @@ private:
 				std::cout << std::endl;
 		}
 	}
-	ndArray<T>& join(ndArray<T>&& arr, int axis, int offset) {
+	ndArray<T>& join(const ndArray<T>& arr, int axis, int offset) {
 
 		// If the array is uninitialized i.e. empty, the join will simply act as assignment
 		if (m_data.empty()) {
@@ -1197,94 +1505,114 @@ private:
 			return *this;
 		}
 
-		int stride = this->getStride(axis);
-
-		// If the axis is 0 then the data can be put at the end of the array
-		if (axis == 0) {
-			auto startPoint = (offset == -1) ? this->end() : this->begin() + offset * stride;
-			m_data.insert(startPoint, arr.begin(), arr.end());
-			m_shape[axis] += arr.shapeAlong(axis);
-		}
-		else {
-
-			size_t newNumberOfElements = this->size() + arr.size();
-			int startIndex = (offset == -1) ? this->shapeAlong(axis) : offset;
-
-			// Update the shape first so that the stepLength can be computed correctly
-			m_shape[axis] += arr.shapeAlong(axis);
-			int stepLength = stride * this->shapeAlong(axis);
-			int j = 0;
-
-			for (size_t i = startIndex; i < newNumberOfElements; i += stepLength) {
-				for (int k = 0; k < arr.shapeAlong(axis); k++) {
-					m_data.insert(this->begin() + i + k, arr.at(arr.reconstructIndex(j)));
-					j++;
-				}
-			}
-		}
-		return *this;
-	}
-	ndArray<T>& replaceAlong(ndArray<T>& newData, int axis, iArray& nonAxisIndices) {
-		return this->replaceAlong(std::move(newData), axis, nonAxisIndices);
-	}
-	ndArray<T>& replaceAlong(ndArray<T>&& newData, int axis, iArray& nonAxisIndices) {
-
-		//assert(nonAxisIndices.size() == this->nDims() - 1);
-		//assert(newData.size() == this->shapeAlong(axis));
-
-		int stride = getStride(axis);
-		auto start_stop = determineStartEndIndexForAxis(axis, nonAxisIndices, 0, -1);
-		int j = 0;
-		for (int i = start_stop.first; i <= start_stop.second - stride; i += stride) {
-			m_data.at(i) = newData[j];
-			j++;
+		// Every row along the axis is split at the offset, and the rows of arr go in between, see Concatenate.h
+		assert(m_shape.size() == arr.m_shape.size());
+		size_t nRows = 1, inner = 1;
+		for (int i = 0; i < (int)m_shape.size(); i++) {
+			if (i < axis) nRows *= (size_t)m_shape[i];
+			if (i > axis) inner *= (size_t)m_shape[i];
 		}
+		const size_t length = (size_t)m_shape[axis];
+		const size_t split = (offset == -1) ? length : (size_t)offset;
+		const size_t insertion = (size_t)arr.m_shape[axis] * inner;
+		assert(split <= length);
+
+		std::vector<Concatenate::Source<T>> sources{
+			{ m_data.data(), split * inner, length * inner },
+			{ arr.m_data.data(), insertion, insertion },
+			{ m_data.data() + split * inner, (length - split) * inner, length * inner } };
+
+		Memory::Buffer<T> joined(this->size() + arr.size());
+		Concatenate::fill(sources, nRows, joined.data());
+		m_data = std::move(joined);
+		m_shape[axis] += arr.m_shape[axis];
+		this->updateLayout();
 		return *this;
 	}
-
 	// Creators
-	static iArray createLogicalArray(const ndArray<T>& arr1, const ndArray<T>&& arr2, std::function<bool(T, T)> func)
-	{
-		return createLogicalArray(arr1, arr2, func);
-	}
-	static iArray createLogicalArray(const ndArray<T>& arr1, const ndArray<T>& arr2, std::function<bool(T,T)> func)
+	template<typename Function>
+	static iArray createLogicalArray(const ndArray<T>& arr1, const ndArray<T>& arr2, Function func)
 	{
 		ndArray<int> out(arr1.size());
 		std::transform(arr1.begin(), arr1.end(), arr2.begin(), out.begin(), func);
 		return out.reshape(arr1.shape());
 	}
-	static iArray createLogicalArray(const ndArray<T>& arr, T value, std::function<bool(T)> func)
+	// Updates m_data in place with either an array of the same size, or a single value
+	template<Simd::Arith op>
+	ndArray<T>& compoundAssign(const T* rhs, bool rhsIsScalar)
 	{
-		ndArray<int> out(arr.size()); 
-		std::transform(arr.begin(), arr.end(), out.begin(), func);
-		return out.reshape(arr.shape());
+		Simd::Input<T> lhsInput{ m_data.data(), false };
+		Simd::Input<T> rhsInput{ rhs, rhsIsScalar };
+		Parallel::forChunks(this->size(), Parallel::defaultExecution(), [&](size_t begin, size_t end) {
+			Simd::arithmetic<op>(lhsInput.from(begin), rhsInput.from(begin), m_data.data() + begin, end - begin);
+		});
+		return *this;
+	}
+	// Element wise comparison with an array of another, broadcastable, shape
+	template<Simd::Compare op>
+	ndMask compareBroadcast(const ndArray<T>& rhs)const
+	{
+		Shape shape = Broadcast::shape(m_shape, rhs.m_shape);
+		Broadcast::IndexMap lhsMap(m_shape, shape);
+		Broadcast::IndexMap rhsMap(rhs.m_shape, shape);
+		ndMask out(shape);
+
+		// Row by row, where each operand either runs along the row or repeats one element
+		const size_t rowLength = shape.empty() ? 1 : (size_t)shape.back();
+		const size_t lhsStep = (size_t)lhsMap.innerStride();
+		const size_t rhsStep = (size_t)rhsMap.innerStride();
+		for (size_t first = 0; first < out.size(); first += rowLength) {
+			const T* lhsRow = m_data.data() + lhsMap(first);
+			const T* rhsRow = rhs.m_data.data() + rhsMap(first);
+			for (size_t j = 0; j < rowLength; j++) {
+				if (Simd::apply<op>(lhsRow[j * lhsStep], rhsRow[j * rhsStep])) {
+					out.set(first + j);
+				}
+			}
+		}
+		return out;
+	}
+	// Element wise comparison with either an array of the same size, or a single value
+	template<Simd::Compare op>
+	ndMask compare(const T* rhs, bool rhsIsScalar)const
+	{
+		ndMask out(m_shape);
+		Simd::Input<T> lhsInput{ m_data.data(), false };
+		Simd::Input<T> rhsInput{ rhs, rhsIsScalar };
+
+		// Chunks of whole words, so that no word is written by two threads
+		Parallel::forChunks(out.nWords(), Parallel::defaultExecution(), [&](size_t begin, size_t end) {
+			const size_t first = begin * 64;
+			const size_t last = std::min(this->size(), end * 64);
+			Simd::compare<op>(lhsInput.from(first), rhsInput.from(first), out.words() + begin, last - first);
+		}, 64);
+		return out;
 	}
 	
+	// A 1d array of selected elements. Nothing selected gives an empty array, as appending to one would
+	static ndArray<T> fromSelection(Memory::Buffer<T>&& selected)
+	{
+		ndArray<T> out;
+		if (!selected.empty()) {
+			out.m_shape = Shape{ 1, (int)selected.size() };
+			out.m_data = std::move(selected);
+			out.updateLayout();
+		}
+		return out;
+	}
+
 	// Misc
 	int getDominantAxis_1d()const
 	{
 		assert(nDims() == 1);
 		return (int)(std::max_element(m_shape.begin(), m_shape.end()) - m_shape.begin());
 	}
-	std::pair<int, int> determineStartEndIndexForAxis(int axis, const ndArray<int>& nonAxisIndex, int start, int end)const
-	{ 
-		if (this->nDims() == 1) {
-			end = (end < 0) ? m_shape.at(this->getDominantAxis_1d()) + end + 1 : end;
-			return std::make_pair(start, end);
-		}
-
-		auto startIndex = nonAxisIndex;
-		startIndex.insert(startIndex.begin()+axis, start);
-
-		auto endIndex = startIndex;
-		endIndex.at(axis) = (end < 0) ? m_shape.at(axis) + end + 1: end;
-
-		return std::make_pair(flattenIndex(startIndex), flattenIndex(endIndex)); 
-	}
 	void swap(ndArray<T>& arr1, ndArray<T>& arr2)
 	{
 		std::swap(arr1.m_data, arr2.m_data); 
 		std::swap(arr1.m_shape, arr2.m_shape);
+		std::swap(arr1.m_strides, arr2.m_strides);
+		std::swap(arr1.m_nDims, arr2.m_nDims);
 	}
 
 
@@ -1294,8 +1622,12 @@ private:
 	// Member variables
 	// -------------------------
 
-	std::vector<T> m_data; 
-	std::vector<int> m_shape; 
+	Memory::Buffer<T> m_data; 
+	Shape m_shape; 
+
+	// Cached from m_shape by updateLayout()
+	Shape m_strides;
+	int m_nDims = 0;
 
 };
 
@@ -1303,4 +1635,17 @@ typedef ndArray<int> iArray;
 typedef ndArray<float> fArray;
 typedef ndArray<double> dArray;
 
+
+inline ndArray<int> ndMask::toArray()const
+{
+	ndArray<int> out(m_shape, 0);
+	this->forEachSet([&](size_t i) { out.data()[i] = 1; });
+	return out;
+}
+
+inline ndMask::operator ndArray<int>()const
+{
+	return this->toArray();
+}
+
 }
\ No newline at end of file
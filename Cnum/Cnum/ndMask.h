@@ -0,0 +1,191 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <numeric>
+#include <algorithm>
+#include <functional>
+#include <bit>
+#include <assert.h>
+#include "Shape.h"
+#include "Simd.h"
+
+namespace Cnum
+{
+	template<typename T>
+	class ndArray;
+
+	/*
+		What is a mask?
+			The result of comparing an ndArray, with one bit per element, set where the comparison holds.
+			The bits are packed in 64 bit words in row major order, so a mask takes 1/32 of the memory of the equivalent iArray.
+
+			Example: (arr > 2) && (arr < 5) builds two masks and combines them word by word, 64 elements at a time.
+
+		Bits past size() in the last word are always kept cleared, so that counting and comparing can work on whole words.
+		A mask converts to an iArray of 0s and 1s, for code that still expects one.
+	*/
+	class ndMask
+	{
+	public:
+
+		//--------------------------
+		// Constructors
+		// -------------------------
+
+		ndMask() = default;
+
+		ndMask(Shape shape, bool value = false)
+			: m_shape{ std::move(shape) }
+		{
+			m_size = (size_t)std::accumulate(m_shape.begin(), m_shape.end(), 1, std::multiplies<int>());
+			m_words.assign(wordsFor(m_size), value ? ~uint64_t(0) : uint64_t(0));
+			this->clearTail();
+		}
+
+		//--------------------------
+		// Element access
+		// -------------------------
+
+		bool operator[](size_t flatIndex)const
+		{
+			return this->test(flatIndex);
+		}
+		bool test(size_t flatIndex)const
+		{
+			assert(flatIndex < m_size);
+			return (m_words[flatIndex / 64] >> (flatIndex % 64)) & 1;
+		}
+		ndMask& set(size_t flatIndex, bool value = true)
+		{
+			assert(flatIndex < m_size);
+			const uint64_t bit = uint64_t(1) << (flatIndex % 64);
+			m_words[flatIndex / 64] = value ? (m_words[flatIndex / 64] | bit) : (m_words[flatIndex / 64] & ~bit);
+			return *this;
+		}
+
+		//--------------------------
+		// Logical operators
+		// -------------------------
+
+		ndMask operator && (const ndMask& rhs)const { return this->combine<Simd::BitOp::And>(rhs); }
+		ndMask operator || (const ndMask& rhs)const { return this->combine<Simd::BitOp::Or>(rhs); }
+		ndMask operator & (const ndMask& rhs)const { return this->combine<Simd::BitOp::And>(rhs); }
+		ndMask operator | (const ndMask& rhs)const { return this->combine<Simd::BitOp::Or>(rhs); }
+		ndMask operator ^ (const ndMask& rhs)const { return this->combine<Simd::BitOp::Xor>(rhs); }
+		ndMask andNot(const ndMask& rhs)const { return this->combine<Simd::BitOp::AndNot>(rhs); }
+
+		ndMask& operator &= (const ndMask& rhs) { return this->combineInPlace<Simd::BitOp::And>(rhs); }
+		ndMask& operator |= (const ndMask& rhs) { return this->combineInPlace<Simd::BitOp::Or>(rhs); }
+		ndMask& operator ^= (const ndMask& rhs) { return this->combineInPlace<Simd::BitOp::Xor>(rhs); }
+
+		ndMask operator ! ()const
+		{
+			ndMask out = *this;
+			return out.flip();
+		}
+		ndMask operator ~ ()const
+		{
+			return !(*this);
+		}
+		ndMask& flip()
+		{
+			for (uint64_t& word : m_words) {
+				word = ~word;
+			}
+			this->clearTail();
+			return *this;
+		}
+
+		//--------------------------
+		// Queries
+		// -------------------------
+
+		size_t count()const
+		{
+			return Simd::popcount(m_words.data(), m_words.size());
+		}
+		bool any()const
+		{
+			return std::any_of(m_words.begin(), m_words.end(), [](uint64_t w) { return w != 0; });
+		}
+		bool all()const
+		{
+			return this->count() == m_size;
+		}
+		bool none()const
+		{
+			return !this->any();
+		}
+
+		// Calls fn(flatIndex) for every set bit, in increasing order
+		template<typename Function>
+		void forEachSet(Function fn)const
+		{
+			for (size_t w = 0; w < m_words.size(); w++) {
+				uint64_t word = m_words[w];
+				while (word != 0) {
+					fn(w * 64 + (size_t)std::countr_zero(word));
+					word &= word - 1;
+				}
+			}
+		}
+
+		// 0 or 1 for every element, in the shape of the mask
+		ndArray<int> toArray()const;
+		operator ndArray<int>()const;
+
+		//--------------------------
+		// Getters
+		// -------------------------
+
+		const Shape& shape()const { return m_shape; }
+		size_t size()const { return m_size; }
+		size_t nWords()const { return m_words.size(); }
+		const uint64_t* words()const { return m_words.data(); }
+		uint64_t* words() { return m_words.data(); }
+
+		bool sameShapeAs(const ndMask& other)const { return m_shape == other.m_shape; }
+		bool isEqualTo(const ndMask& other)const { return m_size == other.m_size && m_words == other.m_words; }
+
+		static size_t wordsFor(size_t nBits) { return (nBits + 63) / 64; }
+
+	private:
+
+		template<Simd::BitOp op>
+		ndMask combine(const ndMask& rhs)const
+		{
+			assert(m_size == rhs.m_size);
+			ndMask out;
+			out.m_shape = m_shape;
+			out.m_size = m_size;
+			out.m_words.resize(m_words.size());
+			Simd::bitwise<op>(m_words.data(), rhs.m_words.data(), out.m_words.data(), m_words.size());
+			return out;
+		}
+		template<Simd::BitOp op>
+		ndMask& combineInPlace(const ndMask& rhs)
+		{
+			assert(m_size == rhs.m_size);
+			Simd::bitwise<op>(m_words.data(), rhs.m_words.data(), m_words.data(), m_words.size());
+			return *this;
+		}
+
+		void clearTail()
+		{
+			if (m_size % 64 != 0) {
+				m_words.back() &= (uint64_t(1) << (m_size % 64)) - 1;
+			}
+		}
+
+	private:
+
+		//--------------------------
+		// Member variables
+		// -------------------------
+
+		Shape m_shape;
+		std::vector<uint64_t> m_words;
+		size_t m_size = 0;
+	};
+
+}
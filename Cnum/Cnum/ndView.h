@@ -0,0 +1,365 @@
+#pragma once
+#include <vector>
+#include <numeric>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <cmath>
+#include <assert.h>
+#include "Shape.h"
+#include "Meta.h"
+#include "Expression.h"
+
+namespace Cnum
+{
+
+	// Random access iterator over elements that are a fixed number of elements apart in memory
+	template<typename T>
+	class StridedIterator
+	{
+	public:
+		using iterator_category = std::random_access_iterator_tag;
+		using value_type = std::remove_const_t<T>;
+		using difference_type = std::ptrdiff_t;
+		using pointer = T*;
+		using reference = T&;
+
+		StridedIterator() = default;
+		StridedIterator(T* ptr, std::ptrdiff_t stride)
+			: m_ptr{ ptr }, m_stride{ stride }
+		{}
+
+		reference operator*()const { return *m_ptr; }
+		pointer operator->()const { return m_ptr; }
+		reference operator[](difference_type n)const { return m_ptr[n * m_stride]; }
+
+		StridedIterator& operator++() { m_ptr += m_stride; return *this; }
+		StridedIterator& operator--() { m_ptr -= m_stride; return *this; }
+		StridedIterator operator++(int) { auto copy = *this; ++(*this); return copy; }
+		StridedIterator operator--(int) { auto copy = *this; --(*this); return copy; }
+		StridedIterator& operator+=(difference_type n) { m_ptr += n * m_stride; return *this; }
+		StridedIterator& operator-=(difference_type n) { m_ptr -= n * m_stride; return *this; }
+
+		friend StridedIterator operator+(StridedIterator it, difference_type n) { return it += n; }
+		friend StridedIterator operator+(difference_type n, StridedIterator it) { return it += n; }
+		friend StridedIterator operator-(StridedIterator it, difference_type n) { return it -= n; }
+		friend difference_type operator-(const StridedIterator& lhs, const StridedIterator& rhs)
+		{
+			return (lhs.m_ptr - rhs.m_ptr) / lhs.m_stride;
+		}
+
+		friend bool operator==(const StridedIterator& lhs, const StridedIterator& rhs) { return lhs.m_ptr == rhs.m_ptr; }
+		friend auto operator<=>(const StridedIterator& lhs, const StridedIterator& rhs)
+		{
+			return (lhs.m_ptr <=> rhs.m_ptr) == 0 ? std::strong_ordering::equal :
+				((lhs - rhs) < 0 ? std::strong_ordering::less : std::strong_ordering::greater);
+		}
+
+	private:
+		T* m_ptr = nullptr;
+		std::ptrdiff_t m_stride = 1;
+	};
+
+
+	/*
+		Steps through all indices of a shape in row major order, like an odometer.
+		The memory offset for a set of strides is kept up to date on the way, so no index has to be flattened from scratch.
+	*/
+	class IndexCounter
+	{
+	public:
+		IndexCounter(const Shape& shape, const Shape& strides)
+			: m_shape{ shape }, m_strides{ strides }, m_index(shape.size(), 0)
+		{
+			assert(m_shape.size() == m_strides.size());
+		}
+
+		// Moves to the next index. Returns false, and starts over from zero, when the last index has been passed
+		bool next()
+		{
+			for (int dim = (int)m_shape.size() - 1; dim >= 0; dim--) {
+				m_offset += m_strides[dim];
+				if (++m_index[dim] < m_shape[dim])
+					return true;
+				m_offset -= (std::ptrdiff_t)m_strides[dim] * m_shape[dim];
+				m_index[dim] = 0;
+			}
+			return false;
+		}
+
+		const Shape& index()const { return m_index; }
+		std::ptrdiff_t offset()const { return m_offset; }
+
+	private:
+		Shape m_shape;
+		Shape m_strides;
+		Shape m_index;
+		std::ptrdiff_t m_offset = 0;
+	};
+
+
+	/*
+		What is a view?
+			A view refers to the data of an ndArray without owning it. It is described by a pointer to its first element,
+			a shape and a stride per axis, so slicing, reversing or picking out a single lane never copies any data.
+
+			Example: The ndArray with shape (3,4) has the strides (4,1). Slicing axis 1 with start 1, end -1 and step 2
+			gives a view with shape (3,2) and strides (4,2) starting at element 1.
+
+		A view takes part in expressions like an ndArray, and eval() materializes it into a new, contiguous ndArray.
+		The view must not outlive the array that it refers to, nor be used after that array has been reallocated.
+	*/
+	template<typename T>
+	class ndView : public Expression::NodeBase<ndView<T>>
+	{
+	public:
+
+		using value_type = std::remove_const_t<T>;
+
+		//--------------------------
+		// Constructors
+		// -------------------------
+
+		ndView(T* data, Shape shape, Shape strides)
+			: m_data{ data }, m_shape{ std::move(shape) }, m_strides{ std::move(strides) }
+		{
+			assert(m_shape.size() == m_strides.size());
+		}
+
+		// Views of mutable data can always be seen as views of constant data
+		operator ndView<const T>()const requires (!std::is_const_v<T>)
+		{
+			return ndView<const T>(m_data, m_shape, m_strides);
+		}
+
+		//--------------------------
+		// Slicing
+		// -------------------------
+
+		ndView<T> slice(int axis, int start, int end = -1, int step = 1)const
+		{
+			/*
+				Selects the elements start, start + step, ... up to, but not including, end along the axis.
+				As for extract(), a negative end is counted from the back, so that -1 means the end of the axis.
+				A negative step walks the same range backwards, starting from its last selected element.
+			*/
+
+			assert(axis >= 0 && axis < (int)m_shape.size());
+			assert(step != 0);
+
+			end = (end < 0) ? m_shape[axis] + end + 1 : end;
+			assert(start >= 0 && start <= end && end <= m_shape[axis]);
+
+			int absStep = std::abs(step);
+			int count = (end - start + absStep - 1) / absStep;
+			int first = (step > 0) ? start : start + (count - 1) * absStep;
+
+			Shape shape = m_shape;
+			Shape strides = m_strides;
+			shape[axis] = count;
+			strides[axis] = m_strides[axis] * step;
+
+			T* data = (count > 0) ? m_data + (std::ptrdiff_t)first * m_strides[axis] : m_data;
+			return ndView<T>(data, shape, strides);
+		}
+
+		// Fixes the index along the axis, which removes the axis from the view
+		ndView<T> at(int axis, int index)const
+		{
+			assert(axis >= 0 && axis < (int)m_shape.size());
+			assert(index >= 0 && index < m_shape[axis]);
+
+			Shape shape = m_shape;
+			Shape strides = m_strides;
+			shape.erase(shape.begin() + axis);
+			strides.erase(strides.begin() + axis);
+			return ndView<T>(m_data + (std::ptrdiff_t)index * m_strides[axis], shape, strides);
+		}
+
+		//--------------------------
+		// Element access
+		// -------------------------
+
+		// Element in row major order of the view, which is what the expressions use
+		T& operator[](size_t flatIndex)const
+		{
+			return m_data[offsetOf(flatIndex)];
+		}
+		T& at(const iArrayLike_1d auto& index)const
+		{
+			assert(index.size() == m_shape.size());
+			std::ptrdiff_t offset = 0;
+			for (int i = 0; i < (int)m_shape.size(); i++) {
+				assert(index[i] >= 0 && index[i] < m_shape[i]);
+				offset += (std::ptrdiff_t)index[i] * m_strides[i];
+			}
+			return m_data[offset];
+		}
+
+		// Iterators are only provided for 1d views i.e. lanes
+		StridedIterator<T> begin()const
+		{
+			assert(m_shape.size() == 1);
+			return StridedIterator<T>(m_data, m_strides[0]);
+		}
+		StridedIterator<T> end()const
+		{
+			assert(m_shape.size() == 1);
+			return StridedIterator<T>(m_data, m_strides[0]) + m_shape[0];
+		}
+
+		//--------------------------
+		// Mutations
+		// -------------------------
+
+		template<Expression::Node E>
+		const ndView<T>& assign(const E& expr)const requires (!std::is_const_v<T>)
+		{
+			assert(std::ranges::equal(m_shape, expr.shape()));
+			size_t i = 0;
+			this->forEachOffset([&](std::ptrdiff_t offset) { m_data[offset] = (T)expr[i++]; });
+			return *this;
+		}
+		template<typename S>
+		const ndView<T>& assign(const ndArray<S>& arr)const requires (!std::is_const_v<T>)
+		{
+			assert(this->size() == arr.size());
+			auto it = arr.begin();
+			this->forEachOffset([&](std::ptrdiff_t offset) { m_data[offset] = (T)*it++; });
+			return *this;
+		}
+		const ndView<T>& fill(value_type value)const requires (!std::is_const_v<T>)
+		{
+			this->forEachOffset([&](std::ptrdiff_t offset) { m_data[offset] = value; });
+			return *this;
+		}
+
+		//--------------------------
+		// Reductions
+		// -------------------------
+
+		template<typename Operation>
+		value_type reduce(value_type initVal, Operation op)const
+		{
+			this->forEachOffset([&](std::ptrdiff_t offset) { initVal = op(initVal, m_data[offset]); });
+			return initVal;
+		}
+		value_type norm()const
+		{
+			value_type squares = this->reduce(0, [](value_type acc, value_type v) { return acc + v * v; });
+			return (value_type)std::pow(squares, 0.5);
+		}
+		value_type min()const
+		{
+			assert(this->size() > 0);
+			value_type first = m_data[0];
+			return this->reduce(first, [](value_type a, value_type b) { return std::min(a, b); });
+		}
+		value_type max()const
+		{
+			assert(this->size() > 0);
+			value_type first = m_data[0];
+			return this->reduce(first, [](value_type a, value_type b) { return std::max(a, b); });
+		}
+
+		//--------------------------
+		// Traversal
+		// -------------------------
+
+		// Calls fn(lane, laneOffset) for every 1d lane along the axis, in the row major order of the remaining axes
+		template<typename Function>
+		void forEachLane(int axis, Function fn)const
+		{
+			assert(axis >= 0 && axis < (int)m_shape.size());
+
+			ndView<T> outer = this->at(axis, 0);
+			outer.forEachOffset([&](std::ptrdiff_t offset) {
+				fn(ndView<T>(m_data + offset, { m_shape[axis] }, { m_strides[axis] }), offset);
+			});
+		}
+
+		// Calls fn(offset) with the memory offset of every element, in row major order of the view
+		template<typename Function>
+		void forEachOffset(Function fn)const
+		{
+			if (this->size() == 0)
+				return;
+			if (m_shape.empty()) {
+				fn(0);
+				return;
+			}
+
+			const int rank = (int)m_shape.size();
+			const int innerSize = m_shape[rank - 1];
+			const std::ptrdiff_t innerStride = m_strides[rank - 1];
+
+			Shape index(rank, 0);
+			std::ptrdiff_t rowOffset = 0;
+			while (true) {
+				for (int j = 0; j < innerSize; j++) {
+					fn(rowOffset + j * innerStride);
+				}
+
+				// Step the outer index like an odometer
+				int dim = rank - 2;
+				for (; dim >= 0; dim--) {
+					rowOffset += m_strides[dim];
+					if (++index[dim] < m_shape[dim])
+						break;
+					rowOffset -= (std::ptrdiff_t)m_strides[dim] * m_shape[dim];
+					index[dim] = 0;
+				}
+				if (dim < 0)
+					return;
+			}
+		}
+
+		//--------------------------
+		// Getters
+		// -------------------------
+
+		const Shape& shape()const { return m_shape; }
+		const Shape& strides()const { return m_strides; }
+		int shapeAlong(int axis)const { return m_shape.at(axis); }
+		size_t size()const
+		{
+			return (size_t)std::accumulate(m_shape.begin(), m_shape.end(), 1, std::multiplies<int>());
+		}
+		T* data()const { return m_data; }
+
+		bool isContiguous()const
+		{
+			int expected = 1;
+			for (int i = (int)m_shape.size() - 1; i >= 0; i--) {
+				if (m_shape[i] != 1 && m_strides[i] != expected)
+					return false;
+				expected *= m_shape[i];
+			}
+			return true;
+		}
+
+	private:
+
+		std::ptrdiff_t offsetOf(size_t flatIndex)const
+		{
+			std::ptrdiff_t offset = 0;
+			for (int i = (int)m_shape.size() - 1; i >= 0; i--) {
+				offset += (std::ptrdiff_t)(flatIndex % m_shape[i]) * m_strides[i];
+				flatIndex /= m_shape[i];
+			}
+			return offset;
+		}
+
+	private:
+
+		//--------------------------
+		// Member variables
+		// -------------------------
+
+		T* m_data = nullptr;
+		Shape m_shape;
+		Shape m_strides;
+	};
+
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "../Cnum/Cnum.h"
+#include "../Cnum/FixedArray.h"
 // add concept to be only numeric
 
 template<typename T>
@@ -7,19 +8,27 @@ class RigidBody {
 
 public: 
 
+	using Vector3 = Cnum::Vector3<T>;
+	using Matrix3 = Cnum::Matrix3<T>;
+
 	struct timeDifferentiatedState {
-		DynamicArray<T> linearVelocity;
-		DynamicArray<T> ddt_rotationMatrix;
-		DynamicArray<T> ddt_linearMomentum;
-		DynamicArray<T> ddt_angularMomentum;
+		Vector3 linearVelocity;
+		Matrix3 ddt_rotationMatrix;
+		Vector3 ddt_linearMomentum;
+		Vector3 ddt_angularMomentum;
 	};
 	struct State {
-		DynamicArray<T> position;
-		DynamicArray<T> rotationMatrix;
-		DynamicArray<T> linearMomentum;
-		DynamicArray<T> angularMomentum;
+		Vector3 position;
+		Matrix3 rotationMatrix;
+		Vector3 linearMomentum;
+		Vector3 angularMomentum;
 	};
 
+	RigidBody(T mass, const Matrix3& localInertiaTensor, const Matrix3& localInertiaTensorInverse)
+		: m_mass{ mass }, m_localInertiaTensor{ localInertiaTensor }, m_localInertiaTensorInverse{ localInertiaTensorInverse }
+	{
+	}
+
 
 	void update(const State& state) {
 		m_globalPosition = state.position;
@@ -28,8 +37,8 @@ public:
 		m_angularMomentum = state.angularMomentum; 
 
 		m_translationalVelocity = state.linearMomentum / m_mass; 
-		m_globalInertiaTensorInverse = state.rotationMatrix * m_localInertiaTensorInverse * state.rotationMatrix.transpose(); 
-		m_angualarVelocity = m_globalInertiaTensorInverse * m_angularMomentum;
+		m_globalInertiaTensorInverse = Cnum::matrixMul(Cnum::matrixMul(state.rotationMatrix, m_localInertiaTensorInverse), Cnum::transpose(state.rotationMatrix)); 
+		m_angualarVelocity = Cnum::matrixMul(m_globalInertiaTensorInverse, m_angularMomentum);
 	}
 
 
@@ -38,22 +47,22 @@ private:
 
 	// Contant properties
 	const T m_mass; 
-	const DynamicArray<T> m_localInertiaTensor; 
-	const DynamicArray<T> m_localInertiaTensorInverse; 
+	const Matrix3 m_localInertiaTensor; 
+	const Matrix3 m_localInertiaTensorInverse; 
 
 	// State variables
-	DynamicArray<T> m_globalPosition;
-	DynamicArray<T> m_rotationMatrix;
-	DynamicArray<T> m_linearMomentum; 
-	DynamicArray<T> m_angularMomentum;
+	Vector3 m_globalPosition;
+	Matrix3 m_rotationMatrix;
+	Vector3 m_linearMomentum; 
+	Vector3 m_angularMomentum;
 
 	// Derived quantatties
-	DynamicArray<T> m_globalInertiaTensorInverse; 
-	DynamicArray<T> m_translationalVelocity; 
-	DynamicArray<T> m_angualarVelocity; 
+	Matrix3 m_globalInertiaTensorInverse; 
+	Vector3 m_translationalVelocity; 
+	Vector3 m_angualarVelocity; 
 
 	// Computed quantaties
-	DynamicArray<T> m_force; 
-	DynamicArray<T> m_torque; 
+	Vector3 m_force; 
+	Vector3 m_torque; 
 
 };